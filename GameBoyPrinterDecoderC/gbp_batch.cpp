@@ -0,0 +1,432 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Batch Decoder
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on decoding many capture files in parallel
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "gbp_decode.h"
+#include "gbp_hex.h"
+#include "gbp_cap.h"
+#include "gbp_batch.h"
+
+#define GBP_BATCH_PATH_MAX 1024
+
+typedef struct
+{
+  char **paths;
+  size_t count;
+  size_t max;
+} gbp_batch_list_t;
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  size_t head; ///< Next file taken by the owner
+  size_t tail; ///< One past the last file (Thieves take from here)
+} gbp_batch_range_t;
+
+typedef struct gbp_batch_pool_s gbp_batch_pool_t;
+
+typedef struct
+{
+  gbp_batch_pool_t *pool;
+  int index;
+  pthread_t thread;
+  gbp_decode_t *session;
+
+  // Worker totals (Summed once all workers are joined)
+  size_t files;
+  size_t filesFailed;
+  uint64_t bytes;
+  uint64_t images;
+} gbp_batch_worker_t;
+
+struct gbp_batch_pool_s
+{
+  const gbp_batch_config_t *config;
+  const gbp_batch_list_t *list;
+  gbp_batch_range_t *ranges;
+  gbp_batch_worker_t *workers;
+  int workerCount;
+  pthread_mutex_t printLock;
+};
+
+/*******************************************************************************
+ * Input Discovery
+*******************************************************************************/
+
+static bool gbp_batch_list_add(gbp_batch_list_t *list, const char *path)
+{
+  if (list->count >= list->max)
+  {
+    const size_t max = list->max ? list->max * 2 : 64;
+    char **paths = (char **) realloc(list->paths, max * sizeof(char *));
+    if (!paths)
+      return false;
+    list->paths = paths;
+    list->max = max;
+  }
+  list->paths[list->count] = strdup(path);
+  if (!list->paths[list->count])
+    return false;
+  list->count++;
+  return true;
+}
+
+static void gbp_batch_list_free(gbp_batch_list_t *list)
+{
+  for (size_t i = 0; i < list->count; i++)
+    free(list->paths[i]);
+  free(list->paths);
+  list->paths = NULL;
+  list->count = 0;
+  list->max = 0;
+}
+
+static bool gbp_batch_isCapture(const char *name)
+{
+  // Hex captures and binary .gbpcap captures
+  const size_t len = strlen(name);
+  return ((len > 4) && (strcmp(&name[len - 4], ".txt") == 0))
+      || ((len > 7) && (strcmp(&name[len - 7], ".gbpcap") == 0));
+}
+
+static bool gbp_batch_scan(gbp_batch_list_t *list, const char *path, const bool explicitInput)
+{
+  struct stat st;
+  if (stat(path, &st) != 0)
+  {
+    printf("batch input `%s' not found\n", path);
+    return false;
+  }
+
+  if (!S_ISDIR(st.st_mode))
+  {
+    // Named files are always decoded, directory entries only if they look like captures
+    if (explicitInput || gbp_batch_isCapture(path))
+      return gbp_batch_list_add(list, path);
+    return true;
+  }
+
+  DIR *dir = opendir(path);
+  if (!dir)
+    return false;
+  bool ok = true;
+  struct dirent *entry = NULL;
+  while (ok && ((entry = readdir(dir)) != NULL))
+  {
+    if (entry->d_name[0] == '.')
+      continue; // Skip `.`, `..` and hidden files
+    char childPath[GBP_BATCH_PATH_MAX];
+    if (snprintf(childPath, sizeof(childPath), "%s/%s", path, entry->d_name) >= (int) sizeof(childPath))
+      continue;
+    ok = gbp_batch_scan(list, childPath, false);
+  }
+  closedir(dir);
+  return ok;
+}
+
+static int gbp_batch_pathCompare(const void *a, const void *b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*******************************************************************************
+ * Worker
+*******************************************************************************/
+
+static void gbp_batch_outputFilename(const gbp_batch_config_t *config, const char *path, char *buff, const size_t buffSize)
+{
+  // `dir/capture.txt` --> `dir/capture` or `outputDir/capture`
+  const char *base = path;
+  for (const char *p = path; *p != '\0'; p++)
+  {
+    if ((*p == '/') || (*p == '\\'))
+      base = p + 1;
+  }
+  const char *ext = strrchr(base, '.');
+  const size_t stemSize = ext ? (size_t)(ext - path) : strlen(path);
+  const size_t baseSize = ext ? (size_t)(ext - base) : strlen(base);
+
+  if (config->outputDir)
+    snprintf(buff, buffSize, "%s/%.*s", config->outputDir, (int) baseSize, base);
+  else
+    snprintf(buff, buffSize, "%.*s", (int) stemSize, path);
+}
+
+static bool gbp_batch_outputsUnique(const gbp_batch_config_t *config, const gbp_batch_list_t *list)
+{
+  // Two captures with one output name (e.g. `a/capture.txt` and `b/capture.txt` with an outputDir)
+  // would overwrite each other's images in whichever order the workers get to them
+  gbp_batch_list_t outputs = {};
+  bool ok = true;
+  for (size_t i = 0; ok && (i < list->count); i++)
+  {
+    char outputFilename[GBP_BATCH_PATH_MAX];
+    gbp_batch_outputFilename(config, list->paths[i], outputFilename, sizeof(outputFilename));
+    ok = gbp_batch_list_add(&outputs, outputFilename);
+  }
+  if (ok)
+    qsort(outputs.paths, outputs.count, sizeof(char *), gbp_batch_pathCompare);
+  for (size_t i = 1; ok && (i < outputs.count); i++)
+  {
+    if (strcmp(outputs.paths[i - 1], outputs.paths[i]) != 0)
+      continue;
+    printf("batch output `%s' would be written by more than one input:\n", outputs.paths[i]);
+    for (size_t j = 0; j < list->count; j++)
+    {
+      char outputFilename[GBP_BATCH_PATH_MAX];
+      gbp_batch_outputFilename(config, list->paths[j], outputFilename, sizeof(outputFilename));
+      if (strcmp(outputFilename, outputs.paths[i]) == 0)
+        printf("  `%s'\n", list->paths[j]);
+    }
+    ok = false;
+  }
+  gbp_batch_list_free(&outputs);
+  return ok;
+}
+
+static void gbp_batch_gotBytes(void *user, const uint8_t *bytes, const size_t bytesSize)
+{
+  gbp_decode_feed((gbp_decode_t *) user, bytes, bytesSize);
+}
+
+static void gbp_batch_decodeFile(gbp_batch_worker_t *worker, const char *path)
+{
+  const gbp_batch_config_t *config = worker->pool->config;
+  char outputFilename[GBP_BATCH_PATH_MAX];
+  struct stat st;
+
+  gbp_batch_outputFilename(config, path, outputFilename, sizeof(outputFilename));
+  gbp_decode_reset(worker->session, outputFilename);
+
+  const int fd = open(path, O_RDONLY);
+  if ((fd < 0) || (fstat(fd, &st) != 0))
+  {
+    if (fd >= 0)
+      close(fd);
+    worker->filesFailed++;
+    return;
+  }
+  if (gbp_cap_isCap(fd))
+  {
+    // Binary capture, the packet stream is fed as is
+    gbp_cap_t cap;
+    if (!gbp_cap_open(&cap, fd))
+    {
+      close(fd);
+      worker->filesFailed++;
+      return;
+    }
+    gbp_decode_feed(worker->session, cap.stream, (size_t) cap.streamSize);
+    gbp_cap_close(&cap);
+  }
+  else
+  {
+    gbp_stats_t *stats = gbp_decode_stats(worker->session);
+    gbp_hex_ingestTimed(fd, gbp_batch_gotBytes, worker->session, stats ? &stats->stageNs[GBP_STATS_STAGE_HEX_PARSE] : NULL);
+  }
+  close(fd);
+  gbp_decode_flush(worker->session);
+
+  const uint32_t images = gbp_decode_imageCount(worker->session);
+  worker->files++;
+  worker->bytes += (uint64_t) st.st_size;
+  worker->images += images;
+
+  if (config->verbose)
+  {
+    pthread_mutex_lock(&worker->pool->printLock);
+    printf("[%2d] %s --> %s (%u images)\n", worker->index, path, outputFilename, (unsigned) images);
+    pthread_mutex_unlock(&worker->pool->printLock);
+  }
+}
+
+static bool gbp_batch_take(gbp_batch_pool_t *pool, const int index, size_t *fileIndex)
+{
+  // Own range first
+  gbp_batch_range_t *own = &pool->ranges[index];
+  pthread_mutex_lock(&own->lock);
+  if (own->head < own->tail)
+  {
+    *fileIndex = own->head++;
+    pthread_mutex_unlock(&own->lock);
+    return true;
+  }
+  pthread_mutex_unlock(&own->lock);
+
+  // Steal the back half of the first victim that still has work
+  for (int i = 1; i < pool->workerCount; i++)
+  {
+    gbp_batch_range_t *victim = &pool->ranges[(index + i) % pool->workerCount];
+    pthread_mutex_lock(&victim->lock);
+    const size_t remain = victim->tail - victim->head;
+    if (remain == 0)
+    {
+      pthread_mutex_unlock(&victim->lock);
+      continue;
+    }
+    const size_t stolen = (remain + 1) / 2;
+    victim->tail -= stolen;
+    const size_t start = victim->tail;
+    pthread_mutex_unlock(&victim->lock);
+
+    // Keep the first stolen file, the rest becomes our own range (and can be stolen back)
+    pthread_mutex_lock(&own->lock);
+    own->head = start + 1;
+    own->tail = start + stolen;
+    pthread_mutex_unlock(&own->lock);
+    *fileIndex = start;
+    return true;
+  }
+  return false; // Files are never added, so all ranges being empty means we are done
+}
+
+static void *gbp_batch_worker(void *arg)
+{
+  gbp_batch_worker_t *worker = (gbp_batch_worker_t *) arg;
+  size_t fileIndex = 0;
+  while (gbp_batch_take(worker->pool, worker->index, &fileIndex))
+  {
+    gbp_batch_decodeFile(worker, worker->pool->list->paths[fileIndex]);
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+ * Batch
+*******************************************************************************/
+
+static double gbp_batch_time_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool gbp_batch_run(const gbp_batch_config_t *config, const char * const inputs[], const int inputCount, gbp_batch_result_t *result)
+{
+  gbp_batch_list_t list = {};
+  gbp_batch_pool_t pool = {};
+  bool ok = true;
+
+  memset(result, 0, sizeof(*result));
+
+  // Discover inputs (Sorted so each worker's starting range is deterministic)
+  for (int i = 0; ok && (i < inputCount); i++)
+  {
+    ok = gbp_batch_scan(&list, inputs[i], true);
+  }
+  if (!ok)
+  {
+    gbp_batch_list_free(&list);
+    return false;
+  }
+  qsort(list.paths, list.count, sizeof(char *), gbp_batch_pathCompare);
+  if (!gbp_batch_outputsUnique(config, &list))
+  {
+    gbp_batch_list_free(&list);
+    return false;
+  }
+
+  // Size the pool
+  int threads = config->threads;
+  if (threads <= 0)
+  {
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (cores > 0) ? (int) cores : 1;
+  }
+  if ((size_t) threads > list.count)
+    threads = (list.count > 0) ? (int) list.count : 1;
+
+  pool.config = config;
+  pool.list = &list;
+  pool.workerCount = threads;
+  pool.ranges = (gbp_batch_range_t *) calloc(threads, sizeof(gbp_batch_range_t));
+  pool.workers = (gbp_batch_worker_t *) calloc(threads, sizeof(gbp_batch_worker_t));
+  pthread_mutex_init(&pool.printLock, NULL);
+  if (!pool.ranges || !pool.workers)
+    ok = false;
+
+  // One session per worker
+  for (int i = 0; ok && (i < threads); i++)
+  {
+    pool.ranges[i].head = (list.count * i) / threads;
+    pool.ranges[i].tail = (list.count * (i + 1)) / threads;
+    pthread_mutex_init(&pool.ranges[i].lock, NULL);
+    pool.workers[i].pool = &pool;
+    pool.workers[i].index = i;
+    pool.workers[i].session = gbp_decode_create(&config->decodeConfig);
+    if (!pool.workers[i].session)
+      ok = false;
+  }
+
+  // Run
+  const double start = gbp_batch_time_sec();
+  int started = 0;
+  for (; ok && (started < threads); started++)
+  {
+    if (pthread_create(&pool.workers[started].thread, NULL, gbp_batch_worker, &pool.workers[started]) != 0)
+      break;
+  }
+  if (ok && (started == 0))
+  {
+    // Could not spawn any thread, decode everything on this one
+    gbp_batch_worker(&pool.workers[0]);
+  }
+  for (int i = 0; i < started; i++)
+  {
+    pthread_join(pool.workers[i].thread, NULL);
+  }
+  result->seconds = gbp_batch_time_sec() - start;
+  result->threads = started ? started : 1;
+
+  // Totals and cleanup
+  for (int i = 0; pool.workers && (i < threads); i++)
+  {
+    result->files += pool.workers[i].files;
+    result->filesFailed += pool.workers[i].filesFailed;
+    result->bytes += pool.workers[i].bytes;
+    result->images += pool.workers[i].images;
+    if (pool.workers[i].session && gbp_decode_stats(pool.workers[i].session))
+      gbp_stats_merge(&result->stats, gbp_decode_stats(pool.workers[i].session));
+    gbp_decode_destroy(pool.workers[i].session);
+    if (pool.ranges)
+      pthread_mutex_destroy(&pool.ranges[i].lock);
+  }
+  pthread_mutex_destroy(&pool.printLock);
+  free(pool.workers);
+  free(pool.ranges);
+  gbp_batch_list_free(&list);
+  return ok && (result->filesFailed == 0);
+}
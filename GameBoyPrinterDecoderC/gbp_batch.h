@@ -0,0 +1,67 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Batch Decoder
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on decoding many capture files in parallel
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_BATCH_H
+#define GBP_BATCH_H
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include "gbp_decode.h"
+
+/*
+    Dev Note: Work Stealing
+    Inputs (files, or directories searched recursively for `.txt` captures) are sorted by
+    name and split into one contiguous range per worker. A worker takes files from the
+    front of its own range and, once empty, steals the back half of another worker's range.
+    Files are the unit of work, so a mutex per range is cheap enough.
+
+    Each worker owns one decode session (see gbp_decode.h) that is reset between files.
+    Each capture is written as `<name><N>.bmp` next to the capture, or in outputDir if set.
+    Inputs whose images would share a name (e.g. the same capture name in two directories with
+    an outputDir) fail the batch before anything is decoded.
+*/
+
+typedef struct
+{
+  gbp_decode_config_t decodeConfig; ///< Session template (outputFilename is set per file)
+  const char *outputDir;            ///< NULL to write images next to each capture
+  int threads;                      ///< 0 for one worker per online core
+  bool verbose;                     ///< Print a line per decoded file
+} gbp_batch_config_t;
+
+typedef struct
+{
+  size_t files;
+  size_t filesFailed;
+  uint64_t bytes;   ///< Capture text bytes read
+  uint64_t images;
+  double seconds;
+  int threads;
+  gbp_stats_t stats; ///< All workers combined (If decodeConfig.stats)
+} gbp_batch_result_t;
+
+bool gbp_batch_run(const gbp_batch_config_t *config, const char * const inputs[], const int inputCount, gbp_batch_result_t *result);
+
+#endif // GBP_BATCH_H
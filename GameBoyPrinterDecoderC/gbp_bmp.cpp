@@ -3,32 +3,30 @@
 #include <stdbool.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "gbp_tiles.h"
 #include "gbp_bmp.h"
+#include "gbp_trace.h"
 #include "./image/bmp_FixedWidthStream.h"
 
+static void gbp_bmp_publish(gbp_bmp_t * gbp_bmp);
+
 bool gbp_bmp_isopen(gbp_bmp_t * gbp_bmp)
 {
-    return (gbp_bmp->f != 0) ? true : false;
+    return gbp_out_isopen(&gbp_bmp->out);
 }
 
-void gbp_bmp_open(gbp_bmp_t * gbp_bmp, const char *outputFilename, const uint16_t fixed_width_size)
+void gbp_bmp_open(gbp_bmp_t * gbp_bmp, const char *outputFilename, const uint16_t fixed_width_size, const uint8_t bitsPerPixel)
 {
-    if (gbp_bmp->f != 0)
-    {
-        fclose(gbp_bmp->f);
-        gbp_bmp->f = 0;
-    }
-
     // Open file
     char filenameBuff[400] = {0};
     snprintf(filenameBuff, sizeof(filenameBuff), "%s%X.bmp", outputFilename, gbp_bmp->fileCounter);
-    gbp_bmp->f = fopen(filenameBuff, "wb");
 
     // Skip over bmp header...
-    fseek(gbp_bmp->f, BMP_PIXEL_START_OFFSET, SEEK_SET);
+    gbp_bmp->bitsPerPixel = ((bitsPerPixel == 2) || (bitsPerPixel == 4)) ? bitsPerPixel : 24;
+    gbp_out_open(&gbp_bmp->out, filenameBuff, (gbp_bmp->bitsPerPixel == 24) ? BMP_PIXEL_START_OFFSET : GBP_BMP_INDEXED_PIXEL_START_OFFSET);
 
     // Update
     gbp_bmp->bmpSizeWidth  = fixed_width_size;
@@ -36,35 +34,163 @@ void gbp_bmp_open(gbp_bmp_t * gbp_bmp, const char *outputFilename, const uint16_
     gbp_bmp->fileCounter++;
 }
 
-void gbp_bmp_add(gbp_bmp_t * gbp_bmp, const uint8_t * bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint32_t palletColor[4])
+static void gbp_bmp_bgrLUT(gbp_bmp_t * gbp_bmp, const uint8_t pallet, const uint32_t palletColor[4])
+{
+    // Combine print palette and output colors into one packed byte to BGR table
+    if (gbp_bmp->bgrLUTValid && (gbp_bmp->bgrLUTPallet == pallet) && (memcmp(gbp_bmp->bgrLUTColor, palletColor, sizeof(gbp_bmp->bgrLUTColor)) == 0))
+        return;
+
+    for (int b = 0; b < 256; b++)
+    {
+        for (int i = 0; i < GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT; i++)
+        {
+            const uint32_t encodedColor = palletColor[GBP_TILES_PALLET_TONE(pallet, b >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(i))];
+            gbp_bmp->bgrLUT[b][i * 3 + 0] = (uint8_t)(encodedColor >>  0);
+            gbp_bmp->bgrLUT[b][i * 3 + 1] = (uint8_t)(encodedColor >>  8);
+            gbp_bmp->bgrLUT[b][i * 3 + 2] = (uint8_t)(encodedColor >> 16);
+        }
+    }
+    gbp_bmp->bgrLUTValid  = true;
+    gbp_bmp->bgrLUTPallet = pallet;
+    memcpy(gbp_bmp->bgrLUTColor, palletColor, sizeof(gbp_bmp->bgrLUTColor));
+}
+
+static void gbp_bmp_add_indexed(gbp_bmp_t * gbp_bmp, const uint8_t * bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint8_t pallet, const uint32_t palletColor[4])
+{
+    // Packed pixels are least significant bits first, palettized bmp is most significant bits first
+    if (!gbp_bmp->indexLUTValid || (gbp_bmp->indexLUTPallet != pallet))
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            uint16_t index2 = 0;
+            uint16_t index4 = 0;
+            for (int i = 0; i < GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT; i++)
+            {
+                const uint8_t tone = GBP_TILES_PALLET_TONE(pallet, b >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(i));
+                index2 |= tone << (6 - 2 * i);
+                index4 |= tone << (12 - 4 * i);
+            }
+            gbp_bmp->indexLUT[b][0] = (gbp_bmp->bitsPerPixel == 2) ? (uint8_t)index2 : (uint8_t)(index4 >> 8);
+            gbp_bmp->indexLUT[b][1] = (uint8_t)index4;
+        }
+        gbp_bmp->indexLUTValid  = true;
+        gbp_bmp->indexLUTPallet = pallet;
+    }
+    memcpy(gbp_bmp->indexColor, palletColor, sizeof(gbp_bmp->indexColor));
+
+    const int bytesPerPacked = gbp_bmp->bitsPerPixel / 2; // Output bytes per packed 2bit byte
+    const int rowSize = GBP_BMP_INDEXED_ROW_SIZE(sizex, gbp_bmp->bitsPerPixel);
+    const int packedWidth = (sizex + GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT - 1) / GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT;
+    const int packedStride = GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(sizex);
+    memset(gbp_bmp->bmpBuffer, 0, rowSize * sizey);
+    for (uint16_t y = 0; y < sizey; y++)
+    {
+        const uint8_t *src = &bmpLineBuffer[y * packedStride];
+        unsigned char *dst = &gbp_bmp->bmpBuffer[y * rowSize];
+        for (int x = 0; x < packedWidth; x++)
+        {
+            memcpy(dst, gbp_bmp->indexLUT[src[x]], bytesPerPacked);
+            dst += bytesPerPacked;
+        }
+    }
+
+    gbp_out_append(&gbp_bmp->out, gbp_bmp->bmpBuffer, rowSize * sizey);
+    gbp_bmp->bmpSizeHeight += sizey;
+}
+
+void gbp_bmp_add(gbp_bmp_t * gbp_bmp, const uint8_t * bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint8_t pallet, const uint32_t palletColor[4])
 {
     // Fixed width
     if (sizex != gbp_bmp->bmpSizeWidth)
         return;
 
+    if (gbp_bmp->bitsPerPixel != 24)
+    {
+        gbp_bmp_add_indexed(gbp_bmp, bmpLineBuffer, sizex, sizey, pallet, palletColor);
+        gbp_bmp_publish(gbp_bmp);
+        return;
+    }
+
+    gbp_bmp_bgrLUT(gbp_bmp, pallet, palletColor);
+
+    // Dev Note: Every packed byte (4 pixels) is expanded to 12 bytes of BGR in one lookup
+    //           (Widths are a multiple of 4, checked in gbp_decode_create(), so no partial byte)
+    const long stride = BMP_PIXEL_BUFF_SIZE(sizex, 1);
+    const int packedWidth = GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(sizex);
     for (uint16_t y = 0; y < sizey; y++)
     {
-        for (uint16_t x = 0; x < sizex; x++)
+        const uint8_t *src = &bmpLineBuffer[y * packedWidth];
+        unsigned char *dst = &gbp_bmp->bmpBuffer[y * stride];
+        for (int x = 0; x < packedWidth; x++)
         {
-            const int pixel = 0b11 & (bmpLineBuffer[(y * GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(sizex)) + GBP_TILE_2BIT_LINEPACK_INDEX(x)] >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(x));
-            const unsigned long encodedColor = palletColor[pixel & 0b11];
-            //printf("bmp_set %d, %d\r\n", x, y);
-            bmp_set(gbp_bmp->bmpBuffer, sizex, x, y, encodedColor);
+            memcpy(dst, gbp_bmp->bgrLUT[src[x]], sizeof(gbp_bmp->bgrLUT[0]));
+            dst += sizeof(gbp_bmp->bgrLUT[0]);
         }
     }
 
-    fwrite(gbp_bmp->bmpBuffer, BMP_PIXEL_BUFF_SIZE(sizex, sizey), 1, gbp_bmp->f);
+    gbp_out_append(&gbp_bmp->out, gbp_bmp->bmpBuffer, BMP_PIXEL_BUFF_SIZE(sizex, sizey));
     gbp_bmp->bmpSizeHeight += sizey;
+    gbp_bmp_publish(gbp_bmp);
 }
 
-void gbp_bmp_render(gbp_bmp_t * gbp_bmp)
+static void gbp_bmp_put32(unsigned char buf[], const uint32_t value)
+{
+    buf[0] = (unsigned char)(value >>  0);
+    buf[1] = (unsigned char)(value >>  8);
+    buf[2] = (unsigned char)(value >> 16);
+    buf[3] = (unsigned char)(value >> 24);
+}
+
+static void gbp_bmp_header_indexed(gbp_bmp_t * gbp_bmp)
+{
+    // Patch a 24bit bmp_header() into a palettized one
+    unsigned char *buf = gbp_bmp->bmpBuffer;
+    const uint32_t size = GBP_BMP_INDEXED_PIXEL_START_OFFSET + GBP_BMP_INDEXED_ROW_SIZE(gbp_bmp->bmpSizeWidth, gbp_bmp->bitsPerPixel) * gbp_bmp->bmpSizeHeight;
+    gbp_bmp_put32(&buf[2], size);                               // bfSize
+    gbp_bmp_put32(&buf[10], GBP_BMP_INDEXED_PIXEL_START_OFFSET); // bfOffBits
+    buf[28] = gbp_bmp->bitsPerPixel;                            // biBitCount
+    gbp_bmp_put32(&buf[46], GBP_BMP_INDEXED_COLORS);            // biClrUsed
+
+    // Color Table (BGR0)
+    for (int i = 0; i < GBP_BMP_INDEXED_COLORS; i++)
+    {
+        gbp_bmp_put32(&buf[BMP_PIXEL_START_OFFSET + 4 * i], gbp_bmp->indexColor[i] & 0xFFFFFF);
+    }
+}
+
+static size_t gbp_bmp_header(gbp_bmp_t * gbp_bmp)
 {
-    // Rewind and write header with the now known image size
-    fseek(gbp_bmp->f, 0, SEEK_SET);
+    // Header for the rows so far into bmpBuffer (Top down, so the rows are already in place)
     bmp_header(gbp_bmp->bmpBuffer, gbp_bmp->bmpSizeWidth, gbp_bmp->bmpSizeHeight);
-    fwrite(gbp_bmp->bmpBuffer, BMP_PIXEL_START_OFFSET, 1, gbp_bmp->f);
+    if (gbp_bmp->bitsPerPixel != 24)
+    {
+        gbp_bmp_header_indexed(gbp_bmp);
+        return GBP_BMP_INDEXED_PIXEL_START_OFFSET;
+    }
+    return BMP_PIXEL_START_OFFSET;
+}
+
+static void gbp_bmp_publish(gbp_bmp_t * gbp_bmp)
+{
+    // Progressive output, every strip leaves a valid bmp of the rows so far
+    if (!gbp_bmp->out.progressive || !gbp_bmp_isopen(gbp_bmp))
+        return;
+    const size_t headerSize = gbp_bmp_header(gbp_bmp);
+    gbp_out_publish(&gbp_bmp->out, gbp_bmp->bmpBuffer, headerSize, NULL, 0);
+}
+
+void gbp_bmp_render(gbp_bmp_t * gbp_bmp)
+{
+    // Write header with the now known image size
+    const size_t headerSize = gbp_bmp_header(gbp_bmp);
+    gbp_out_pwrite(&gbp_bmp->out, gbp_bmp->bmpBuffer, headerSize, 0);
 
     // Close File
-    fclose(gbp_bmp->f);
-    gbp_bmp->f = 0;
+    gbp_out_close(&gbp_bmp->out);
+    GBP_TRACE(image_close, gbp_bmp->bmpSizeWidth, gbp_bmp->bmpSizeHeight);
+}
+
+void gbp_bmp_free(gbp_bmp_t * gbp_bmp)
+{
+    gbp_out_free(&gbp_bmp->out);
 }
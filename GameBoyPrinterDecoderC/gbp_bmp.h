@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include "./image/bmp_FixedWidthStream.h"
+#include "gbp_out.h"
 
 
 // Image Rendering
@@ -10,17 +11,36 @@
 #define GBP_BMP_WIDTH  (GBP_TILE_PIXEL_WIDTH  * GBP_TILES_PER_LINE)
 #define GBP_BMP_HEIGHT (GBP_TILE_PIXEL_HEIGHT * GBP_BMP_MAX_TILE_HEIGHT)
 
+// Palettized (2bit and 4bit per pixel) bmp. Only the 4 tones are in the color table
+#define GBP_BMP_INDEXED_COLORS 4
+#define GBP_BMP_INDEXED_PIXEL_START_OFFSET (BMP_PIXEL_START_OFFSET + 4 * GBP_BMP_INDEXED_COLORS)
+#define GBP_BMP_INDEXED_ROW_SIZE(width, bitsPerPixel) ((((width) * (bitsPerPixel) + 31) / 32) * 4)
+
 typedef struct
 {
-    FILE *f;
+    gbp_out_t out;
     int fileCounter;
     uint16_t bmpSizeWidth;  // x
-    uint16_t bmpSizeHeight; // y
+    uint32_t bmpSizeHeight; // y (Tile row pool allows up to 0xFFFF tile rows, more than 16bit of lines)
+    uint8_t bitsPerPixel;   // 24 (BGR), 4 or 2 (Palettized)
     unsigned char bmpBuffer[BMP_PIXEL_BUFF_SIZE(GBP_BMP_WIDTH, GBP_BMP_HEIGHT)];
+
+    // Packed 2bit byte (4 pixels) to BGR lookup for the current print palette and colors
+    bool bgrLUTValid;
+    uint8_t bgrLUTPallet;
+    uint32_t bgrLUTColor[4];
+    uint8_t bgrLUT[256][4 * 3];
+
+    // Packed 2bit byte (4 pixels) to palettized pixels for the current print palette (Most significant pixel first)
+    bool indexLUTValid;
+    uint8_t indexLUTPallet;
+    uint8_t indexLUT[256][2];
+    uint32_t indexColor[GBP_BMP_INDEXED_COLORS]; ///< Color table written on render
 } gbp_bmp_t;
 
 
 bool gbp_bmp_isopen(gbp_bmp_t * gbp_bmp);
-void gbp_bmp_open(gbp_bmp_t * gbp_bmp, const char *outputFilename, const uint16_t fixed_width_size);
-void gbp_bmp_add(gbp_bmp_t * gbp_bmp, const uint8_t * bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint32_t palletColor[4]);
+void gbp_bmp_open(gbp_bmp_t * gbp_bmp, const char *outputFilename, const uint16_t fixed_width_size, const uint8_t bitsPerPixel);
+void gbp_bmp_add(gbp_bmp_t * gbp_bmp, const uint8_t * bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint8_t pallet, const uint32_t palletColor[4]);
 void gbp_bmp_render(gbp_bmp_t * gbp_bmp);
+void gbp_bmp_free(gbp_bmp_t * gbp_bmp);
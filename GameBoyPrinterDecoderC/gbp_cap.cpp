@@ -0,0 +1,321 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Binary Capture (.gbpcap)
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on storing packet captures as framed binary with a print job index
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gbp_jobs.h"
+#include "gbp_cap.h"
+
+/*******************************************************************************
+ * Little Endian Fields
+*******************************************************************************/
+
+static void gbp_cap_put16(uint8_t *p, const uint16_t v)
+{
+  p[0] = (uint8_t)(v >> 0);
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void gbp_cap_put32(uint8_t *p, const uint32_t v)
+{
+  gbp_cap_put16(&p[0], (uint16_t)(v >> 0));
+  gbp_cap_put16(&p[2], (uint16_t)(v >> 16));
+}
+
+static void gbp_cap_put64(uint8_t *p, const uint64_t v)
+{
+  gbp_cap_put32(&p[0], (uint32_t)(v >> 0));
+  gbp_cap_put32(&p[4], (uint32_t)(v >> 32));
+}
+
+static uint16_t gbp_cap_get16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t gbp_cap_get32(const uint8_t *p)
+{
+  return (uint32_t) gbp_cap_get16(&p[0]) | ((uint32_t) gbp_cap_get16(&p[2]) << 16);
+}
+
+static uint64_t gbp_cap_get64(const uint8_t *p)
+{
+  return (uint64_t) gbp_cap_get32(&p[0]) | ((uint64_t) gbp_cap_get32(&p[4]) << 32);
+}
+
+/*******************************************************************************
+ * Reader
+*******************************************************************************/
+
+bool gbp_cap_isCap(int fd)
+{
+  uint8_t magic[sizeof(GBP_CAP_MAGIC) - 1];
+  return (pread(fd, magic, sizeof(magic), 0) == (ssize_t) sizeof(magic))
+      && (memcmp(magic, GBP_CAP_MAGIC, sizeof(magic)) == 0);
+}
+
+bool gbp_cap_open(gbp_cap_t *cap, int fd)
+{
+  struct stat st;
+  memset(cap, 0, sizeof(*cap));
+  cap->fd = fd;
+
+  if ((fstat(fd, &st) != 0) || (st.st_size < (GBP_CAP_HEADER_SIZE + GBP_CAP_FOOTER_SIZE)))
+    return false;
+  void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+  cap->map = (const uint8_t *) map;
+  cap->mapSize = (size_t) st.st_size;
+
+  // Header
+  const uint8_t *header = cap->map;
+  if ((memcmp(header, GBP_CAP_MAGIC, sizeof(GBP_CAP_MAGIC) - 1) != 0) || (gbp_cap_get16(&header[6]) != GBP_CAP_VERSION))
+  {
+    gbp_cap_close(cap);
+    return false;
+  }
+  cap->flags = gbp_cap_get32(&header[8]);
+
+  // Footer
+  const uint8_t *footer = &cap->map[cap->mapSize - GBP_CAP_FOOTER_SIZE];
+  const uint64_t packetTableOffset = gbp_cap_get64(&footer[0]);
+  const uint64_t jobTableOffset    = gbp_cap_get64(&footer[8]);
+  cap->packetCount = gbp_cap_get32(&footer[16]);
+  cap->jobCount    = gbp_cap_get32(&footer[20]);
+  const uint64_t tableEnd = cap->mapSize - GBP_CAP_FOOTER_SIZE;
+  // Dev Note: Offsets are bounded by the file before they are added, so a crafted footer cannot wrap around
+  if ((memcmp(&footer[24], GBP_CAP_FOOTER_MAGIC, sizeof(GBP_CAP_FOOTER_MAGIC) - 1) != 0)
+      || (packetTableOffset < GBP_CAP_HEADER_SIZE)
+      || (packetTableOffset > tableEnd)
+      || (cap->packetCount > (tableEnd - packetTableOffset) / GBP_CAP_PACKET_ENTRY_SIZE)
+      || ((packetTableOffset + (uint64_t) cap->packetCount * GBP_CAP_PACKET_ENTRY_SIZE) != jobTableOffset)
+      || (cap->jobCount > (tableEnd - jobTableOffset) / GBP_CAP_JOB_ENTRY_SIZE)
+      || ((jobTableOffset + (uint64_t) cap->jobCount * GBP_CAP_JOB_ENTRY_SIZE) != tableEnd))
+  {
+    gbp_cap_close(cap);
+    return false;
+  }
+  cap->stream      = &cap->map[GBP_CAP_HEADER_SIZE];
+  cap->streamSize  = packetTableOffset - GBP_CAP_HEADER_SIZE;
+  cap->packetTable = &cap->map[packetTableOffset];
+  cap->jobTable    = &cap->map[jobTableOffset];
+  return true;
+}
+
+void gbp_cap_close(gbp_cap_t *cap)
+{
+  if (cap->map)
+    munmap((void *) cap->map, cap->mapSize);
+  cap->map = NULL;
+  cap->mapSize = 0;
+  cap->stream = NULL;
+  cap->packetCount = 0;
+  cap->jobCount = 0;
+}
+
+bool gbp_cap_packet(const gbp_cap_t *cap, const uint32_t packetIndex, gbp_cap_packet_t *packet)
+{
+  if (packetIndex >= cap->packetCount)
+    return false;
+  const uint8_t *entry = &cap->packetTable[(size_t) packetIndex * GBP_CAP_PACKET_ENTRY_SIZE];
+  packet->streamOffset = gbp_cap_get64(&entry[0]);
+  packet->timestampUs  = gbp_cap_get64(&entry[8]);
+  if ((packet->streamOffset + GBP_JOBS_PKT_HEADER_SIZE + GBP_JOBS_PKT_TRAILER_SIZE) > cap->streamSize)
+    return false;
+
+  const uint8_t *pkt = &cap->stream[packet->streamOffset];
+  packet->command     = pkt[2];
+  packet->compression = pkt[3];
+  packet->dataLength  = gbp_cap_get16(&pkt[4]);
+  packet->size        = GBP_JOBS_PKT_HEADER_SIZE + packet->dataLength + GBP_JOBS_PKT_TRAILER_SIZE;
+  if ((packet->streamOffset + packet->size) > cap->streamSize)
+    return false;
+  packet->printerID   = pkt[packet->size - 2];
+  packet->status      = pkt[packet->size - 1];
+  return true;
+}
+
+bool gbp_cap_job(const gbp_cap_t *cap, const uint32_t jobIndex, gbp_jobs_job_t *job, uint32_t *firstPacket)
+{
+  // O(1): one job table entry
+  if (jobIndex >= cap->jobCount)
+    return false;
+  const uint8_t *entry = &cap->jobTable[(size_t) jobIndex * GBP_CAP_JOB_ENTRY_SIZE];
+  job->start   = (size_t) gbp_cap_get64(&entry[0]);
+  job->end     = (size_t) gbp_cap_get64(&entry[8]);
+  job->packets = gbp_cap_get32(&entry[20]);
+  job->cut     = (gbp_cap_get32(&entry[24]) & GBP_CAP_JOB_FLAG_CUT) != 0;
+  if (firstPacket)
+    *firstPacket = gbp_cap_get32(&entry[16]);
+  return (job->start <= job->end) && (job->end <= cap->streamSize);
+}
+
+bool gbp_cap_jobIndex(const gbp_cap_t *cap, gbp_jobs_index_t *index)
+{
+  // Stored index as a gbp_jobs index (e.g. For gbp_jobs_decode() without a pre-scan)
+  memset(index, 0, sizeof(*index));
+  index->packets = cap->packetCount;
+  for (uint32_t i = 0; i < cap->jobCount; i++)
+  {
+    gbp_jobs_job_t job;
+    if (!gbp_cap_job(cap, i, &job, NULL) || !gbp_jobs_add(index, job.start, job.end, job.packets, job.cut))
+    {
+      gbp_jobs_free(index);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*******************************************************************************
+ * Writer
+*******************************************************************************/
+
+bool gbp_cap_writer_open(gbp_cap_writer_t *writer, const char *filename, const bool timestamps)
+{
+  memset(writer, 0, sizeof(*writer));
+  writer->f = fopen(filename, "wb");
+  if (!writer->f)
+    return false;
+  writer->flags = timestamps ? GBP_CAP_FLAG_TIMESTAMPS : 0;
+  writer->ok = true;
+
+  uint8_t header[GBP_CAP_HEADER_SIZE] = {0};
+  memcpy(header, GBP_CAP_MAGIC, sizeof(GBP_CAP_MAGIC) - 1);
+  gbp_cap_put16(&header[6], GBP_CAP_VERSION);
+  gbp_cap_put32(&header[8], writer->flags);
+  writer->ok = (fwrite(header, 1, sizeof(header), writer->f) == sizeof(header));
+  return writer->ok;
+}
+
+bool gbp_cap_writer_addPacket(gbp_cap_writer_t *writer, const uint8_t *pkt, const size_t pktSize, const uint64_t timestampUs)
+{
+  // `pkt` is one whole packet from the sync bytes to the printer status byte
+  if (!writer->ok)
+    return false;
+
+  // Packet table entry
+  if (writer->packetCount >= writer->packetTableMax)
+  {
+    const uint32_t max = writer->packetTableMax ? writer->packetTableMax * 2 : 1024;
+    uint8_t *table = (uint8_t *) realloc(writer->packetTable, (size_t) max * GBP_CAP_PACKET_ENTRY_SIZE);
+    if (!table)
+      return writer->ok = false;
+    writer->packetTable = table;
+    writer->packetTableMax = max;
+  }
+  uint8_t *entry = &writer->packetTable[(size_t) writer->packetCount * GBP_CAP_PACKET_ENTRY_SIZE];
+  gbp_cap_put64(&entry[0], writer->streamSize);
+  gbp_cap_put64(&entry[8], (writer->flags & GBP_CAP_FLAG_TIMESTAMPS) ? timestampUs : 0);
+  writer->packetCount++;
+
+  // Packet stream
+  if (fwrite(pkt, 1, pktSize, writer->f) != pktSize)
+    return writer->ok = false;
+  writer->streamSize += pktSize;
+
+  // Cutting print ends the job
+  if (gbp_jobs_packetIsCut(pkt, pktSize))
+  {
+    if (!gbp_jobs_add(&writer->jobs, writer->jobStart, writer->streamSize, writer->packetCount - writer->jobFirstPacket, true))
+      return writer->ok = false;
+    writer->jobStart = writer->streamSize;
+    writer->jobFirstPacket = writer->packetCount;
+  }
+  return true;
+}
+
+size_t gbp_cap_writer_addBytes(gbp_cap_writer_t *writer, const uint8_t *bytes, const size_t bytesSize)
+{
+  // Frame a raw byte stream (e.g. Decoded hex capture) into packets, returns packets added
+  size_t i = 0;
+  size_t pktSize = 0;
+  size_t packets = 0;
+  while (gbp_jobs_packetNext(bytes, bytesSize, &i, &pktSize))
+  {
+    if (!gbp_cap_writer_addPacket(writer, &bytes[i], pktSize, 0))
+      break;
+    i += pktSize;
+    packets++;
+  }
+  return packets;
+}
+
+bool gbp_cap_writer_close(gbp_cap_writer_t *writer)
+{
+  if (!writer->f)
+    return false;
+
+  // Tail job (Packets after the last cut)
+  if (writer->ok && (writer->jobFirstPacket < writer->packetCount))
+  {
+    writer->ok = gbp_jobs_add(&writer->jobs, writer->jobStart, writer->streamSize, writer->packetCount - writer->jobFirstPacket, false);
+  }
+
+  // Packet table
+  const uint64_t packetTableOffset = GBP_CAP_HEADER_SIZE + writer->streamSize;
+  const size_t packetTableSize = (size_t) writer->packetCount * GBP_CAP_PACKET_ENTRY_SIZE;
+  if (writer->ok && (packetTableSize > 0))
+    writer->ok = (fwrite(writer->packetTable, 1, packetTableSize, writer->f) == packetTableSize);
+
+  // Job table
+  uint32_t firstPacket = 0;
+  for (size_t i = 0; writer->ok && (i < writer->jobs.count); i++)
+  {
+    const gbp_jobs_job_t *job = &writer->jobs.jobs[i];
+    uint8_t entry[GBP_CAP_JOB_ENTRY_SIZE] = {0};
+    gbp_cap_put64(&entry[0], job->start);
+    gbp_cap_put64(&entry[8], job->end);
+    gbp_cap_put32(&entry[16], firstPacket);
+    gbp_cap_put32(&entry[20], job->packets);
+    gbp_cap_put32(&entry[24], job->cut ? GBP_CAP_JOB_FLAG_CUT : 0);
+    writer->ok = (fwrite(entry, 1, sizeof(entry), writer->f) == sizeof(entry));
+    firstPacket += job->packets;
+  }
+
+  // Footer
+  uint8_t footer[GBP_CAP_FOOTER_SIZE] = {0};
+  gbp_cap_put64(&footer[0], packetTableOffset);
+  gbp_cap_put64(&footer[8], packetTableOffset + packetTableSize);
+  gbp_cap_put32(&footer[16], writer->packetCount);
+  gbp_cap_put32(&footer[20], (uint32_t) writer->jobs.count);
+  memcpy(&footer[24], GBP_CAP_FOOTER_MAGIC, sizeof(GBP_CAP_FOOTER_MAGIC) - 1);
+  if (writer->ok)
+    writer->ok = (fwrite(footer, 1, sizeof(footer), writer->f) == sizeof(footer));
+
+  writer->ok = (fclose(writer->f) == 0) && writer->ok;
+  writer->f = NULL;
+  free(writer->packetTable);
+  writer->packetTable = NULL;
+  gbp_jobs_free(&writer->jobs);
+  return writer->ok;
+}
@@ -0,0 +1,118 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Binary Capture (.gbpcap)
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on storing packet captures as framed binary with a print job index
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_CAP_H
+#define GBP_CAP_H
+
+#include <stdio.h>
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include "gbp_jobs.h"
+
+/*
+    Dev Note: .gbpcap layout (All fields little endian)
+
+    ```
+    [Header 16]        "GBPCAP" | version u16 | flags u32 | reserved u32
+    [Packet Stream]    Whole packets back to back, exactly as sent on the link
+                       (88 33 .. payload .. checksum, then the printer's two response bytes)
+    [Packet Table]     packetCount x { streamOffset u64 | timestampUs u64 }
+    [Job Table]        jobCount x { streamStart u64 | streamEnd u64 | firstPacket u32 | packetCount u32 | flags u32 | reserved u32 }
+    [Footer 32]        packetTableOffset u64 | jobTableOffset u64 | packetCount u32 | jobCount u32 | "GBPCIDX1"
+    ```
+
+    * Stream offsets are relative to the start of the packet stream (file offset 16).
+    * Bytes that were not part of a whole packet (noise, truncated tail) are not stored.
+    * The packet stream can be fed as is into gbp_decode_feed(), and a job range fed to a
+      fresh session renders the same image as a full decode (See gbp_jobs.h).
+    * Job N is found by reading the footer and then one job table entry, no rescan needed.
+*/
+
+#define GBP_CAP_MAGIC              "GBPCAP"
+#define GBP_CAP_FOOTER_MAGIC       "GBPCIDX1"
+#define GBP_CAP_VERSION            1
+#define GBP_CAP_HEADER_SIZE        16
+#define GBP_CAP_FOOTER_SIZE        32
+#define GBP_CAP_PACKET_ENTRY_SIZE  16
+#define GBP_CAP_JOB_ENTRY_SIZE     32
+
+#define GBP_CAP_FLAG_TIMESTAMPS    (1 << 0) ///< Packet table timestamps are valid
+#define GBP_CAP_JOB_FLAG_CUT       (1 << 0) ///< Job ends with a cutting PRINT
+
+typedef struct
+{
+  uint64_t streamOffset;
+  uint32_t size;
+  uint64_t timestampUs; ///< Zero if the capture has no timestamps
+  uint8_t command;
+  uint8_t compression;
+  uint16_t dataLength;
+  uint8_t printerID;    ///< Printer response (First byte)
+  uint8_t status;       ///< Printer response (Status byte)
+} gbp_cap_packet_t;
+
+// Reader (Memory mapped)
+typedef struct
+{
+  int fd;
+  const uint8_t *map;
+  size_t mapSize;
+  uint32_t flags;
+  const uint8_t *stream;
+  uint64_t streamSize;
+  const uint8_t *packetTable;
+  uint32_t packetCount;
+  const uint8_t *jobTable;
+  uint32_t jobCount;
+} gbp_cap_t;
+
+// Writer (Streaming, tables are kept in memory until close)
+typedef struct
+{
+  FILE *f;
+  uint32_t flags;
+  uint64_t streamSize;
+  uint8_t *packetTable;
+  uint32_t packetCount;
+  uint32_t packetTableMax;
+  gbp_jobs_index_t jobs;
+  uint64_t jobStart;
+  uint32_t jobFirstPacket;
+  bool ok;
+} gbp_cap_writer_t;
+
+bool gbp_cap_isCap(int fd);
+bool gbp_cap_open(gbp_cap_t *cap, int fd);
+void gbp_cap_close(gbp_cap_t *cap);
+bool gbp_cap_packet(const gbp_cap_t *cap, const uint32_t packetIndex, gbp_cap_packet_t *packet);
+bool gbp_cap_job(const gbp_cap_t *cap, const uint32_t jobIndex, gbp_jobs_job_t *job, uint32_t *firstPacket);
+bool gbp_cap_jobIndex(const gbp_cap_t *cap, gbp_jobs_index_t *index);
+
+bool gbp_cap_writer_open(gbp_cap_writer_t *writer, const char *filename, const bool timestamps);
+bool gbp_cap_writer_addPacket(gbp_cap_writer_t *writer, const uint8_t *pkt, const size_t pktSize, const uint64_t timestampUs);
+size_t gbp_cap_writer_addBytes(gbp_cap_writer_t *writer, const uint8_t *bytes, const size_t bytesSize);
+bool gbp_cap_writer_close(gbp_cap_writer_t *writer);
+
+#endif // GBP_CAP_H
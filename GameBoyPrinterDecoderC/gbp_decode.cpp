@@ -0,0 +1,660 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decode Session (libgbpdecode)
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on turning a raw printer byte stream into images
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include <stdlib.h> // calloc
+#include <string.h> // strncpy
+
+#include "gameboy_printer_protocol.h"
+#include "gbp_pkt.h"
+#include "gbp_tiles.h"
+#include "gbp_bmp.h"
+#include "gbp_png.h"
+#include "gbp_raw.h"
+#include "gbp_decode.h"
+
+typedef struct
+{
+  gbp_decode_sink_t sink;
+  char outputFilename[255]; ///< Copy for sinks (The primary output uses the session's, see gbp_decode_reset())
+  const char *filename;
+  uint8_t scale;            ///< Integer upscale factor, 0 if sampled (See Dev Note in gbp_decode.h)
+  uint32_t srcRows;         ///< Printed rows of the open image
+  uint32_t dstRows;         ///< Rows written to the open image
+  uint8_t expand[256][GBP_DECODE_SCALE_MAX]; ///< Packed byte to `scale` packed bytes (Integer upscale)
+  union
+  {
+    gbp_bmp_t bmp;
+    gbp_png_t png;
+    gbp_raw_t raw;
+  };
+} gbp_decode_writer_t;
+
+struct gbp_decode_s
+{
+  gbp_decode_config_t config;
+  char outputFilename[255];
+
+  // Packet Parser
+  uint32_t pktCounter;
+  uint32_t imageCounter;
+  gbp_pkt_t pkt;
+  uint8_t pktbuffStream[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE];
+  uint8_t *pktbuff; ///< Either pktbuffStream or a whole packet buffer
+  size_t pktbuffMax;
+  uint16_t pktbuffSize;
+
+  // Tile Decoder
+  gbp_pkt_tileAcc_t tileBuff;
+  gbp_tile_t tiles;
+
+  // Image Writer (Primary output then sinks)
+  gbp_decode_writer_t *writers;
+  uint8_t writerCount;
+  uint8_t *scaled; ///< Scaled lines of one strip (Only if a writer scales)
+
+  // Metadata of the open image (config.meta)
+  uint32_t metaImage;
+  uint32_t metaHeight;
+  uint32_t metaPrintCount;
+  uint8_t metaPrints[GBP_DECODE_META_PRINTS_MAX][GBP_PRINT_INSTRUCT_PAYLOAD_SIZE];
+
+  // Statistics
+  gbp_stats_t statsStore;
+  gbp_stats_t *stats; ///< statsStore if enabled, else NULL
+};
+
+/*******************************************************************************
+ * Utilites
+*******************************************************************************/
+
+const char *gbpCommand_toStr(int val)
+{
+  switch (val)
+  {
+    case GBP_COMMAND_INIT    : return "INIT";
+    case GBP_COMMAND_PRINT   : return "PRNT";
+    case GBP_COMMAND_DATA    : return "DATA";
+    case GBP_COMMAND_BREAK   : return "BREK";
+    case GBP_COMMAND_INQUIRY : return "INQY";
+    default: return "?";
+  }
+}
+
+/*******************************************************************************
+ * Image Writer
+*******************************************************************************/
+
+static bool gbp_decode_writer_israw(const gbp_decode_writer_t *w)
+{
+  return w->sink.output >= GBP_DECODE_OUTPUT_PPM;
+}
+
+static int *gbp_decode_writer_counter(gbp_decode_writer_t *w)
+{
+  // Number of the next image
+  if (gbp_decode_writer_israw(w))
+    return &w->raw.fileCounter;
+  if (w->sink.output == GBP_DECODE_OUTPUT_PNG)
+    return &w->png.fileCounter;
+  return &w->bmp.fileCounter;
+}
+
+static bool gbp_decode_writer_isopen(gbp_decode_writer_t *w)
+{
+  if (gbp_decode_writer_israw(w))
+    return gbp_raw_isopen(&w->raw);
+  if (w->sink.output == GBP_DECODE_OUTPUT_PNG)
+    return gbp_png_isopen(&w->png);
+  return gbp_bmp_isopen(&w->bmp);
+}
+
+static void gbp_decode_writer_init(gbp_decode_writer_t *w, const gbp_decode_sink_t *sink, const gbp_decode_config_t *config)
+{
+  w->sink = *sink;
+  if (w->sink.width == 0)
+    w->sink.width = GBP_DECODE_WIDTH;
+  if (sink->outputFilename)
+    strncpy(w->outputFilename, sink->outputFilename, sizeof(w->outputFilename) - 1);
+  w->filename = w->outputFilename;
+
+  // Integer upscale, every pixel repeats `scale` times
+  w->scale = ((w->sink.width % GBP_DECODE_WIDTH) == 0) ? (uint8_t) (w->sink.width / GBP_DECODE_WIDTH) : 0;
+  for (int b = 0; (w->scale > 1) && (b < 256); b++)
+  {
+    for (int k = 0; k < (GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT * w->scale); k++)
+    {
+      const uint8_t pixel = (b >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(k / w->scale)) & 0b11;
+      w->expand[b][GBP_TILE_2BIT_LINEPACK_INDEX(k)] |= pixel << GBP_TILE_2BIT_LINEPACK_BITOFFSET(k);
+    }
+  }
+
+  switch (w->sink.output)
+  {
+    case GBP_DECODE_OUTPUT_PNG   : gbp_out_init(&w->png.out, config->writer, config->progressive); break;
+    case GBP_DECODE_OUTPUT_PPM   : gbp_raw_init(&w->raw, GBP_RAW_FORMAT_PPM, sink->stream); break;
+    case GBP_DECODE_OUTPUT_PAM   : gbp_raw_init(&w->raw, GBP_RAW_FORMAT_PAM, sink->stream); break;
+    case GBP_DECODE_OUTPUT_GRAY8 : gbp_raw_init(&w->raw, GBP_RAW_FORMAT_GRAY8, sink->stream); break;
+    case GBP_DECODE_OUTPUT_2BPP  : gbp_raw_init(&w->raw, GBP_RAW_FORMAT_2BPP, sink->stream); break;
+    default: gbp_out_init(&w->bmp.out, config->writer, config->progressive); break;
+  }
+}
+
+static void gbp_decode_writer_open(gbp_decode_writer_t *w)
+{
+  const uint16_t width = w->sink.width;
+  w->srcRows = 0;
+  w->dstRows = 0;
+  switch (w->sink.output)
+  {
+    case GBP_DECODE_OUTPUT_BMP  : gbp_bmp_open(&w->bmp, w->filename, width, 24); break;
+    case GBP_DECODE_OUTPUT_BMP4 : gbp_bmp_open(&w->bmp, w->filename, width, 4); break;
+    case GBP_DECODE_OUTPUT_BMP2 : gbp_bmp_open(&w->bmp, w->filename, width, 2); break;
+    case GBP_DECODE_OUTPUT_PNG  : gbp_png_open(&w->png, w->filename, width); break;
+    default: gbp_raw_open(&w->raw, width); break;
+  }
+}
+
+static void gbp_decode_writer_addLines(gbp_decode_writer_t *w, const uint8_t *lines, const uint16_t lineCount, const uint8_t pallet)
+{
+  // Lines at the writer width, in batches that fit the bmp strip buffer
+  const uint16_t width = w->sink.width;
+  const uint16_t batch = (GBP_BMP_WIDTH * GBP_BMP_HEIGHT) / width;
+  const int stride = GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(width);
+  for (uint16_t y = 0; y < lineCount; y += batch)
+  {
+    const uint16_t sizey = ((lineCount - y) < batch) ? (lineCount - y) : batch;
+    const uint8_t *rowLines = &lines[y * stride];
+    if (gbp_decode_writer_israw(w))
+      gbp_raw_add(&w->raw, rowLines, width, sizey, pallet, w->sink.palletColor);
+    else if (w->sink.output == GBP_DECODE_OUTPUT_PNG)
+      gbp_png_add(&w->png, rowLines, width, sizey, pallet, w->sink.palletColor);
+    else
+      gbp_bmp_add(&w->bmp, rowLines, width, sizey, pallet, w->sink.palletColor);
+  }
+}
+
+static void gbp_decode_writer_add(gbp_decode_writer_t *w, uint8_t *scaled, const uint8_t *rowLines, const uint16_t sizey, const uint8_t pallet)
+{
+  const uint16_t width = w->sink.width;
+  if (w->scale == 1)
+  {
+    // As printed
+    gbp_decode_writer_addLines(w, rowLines, sizey, pallet);
+    return;
+  }
+
+  const int dstStride = GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(width);
+  uint16_t lines = 0;
+  if (w->scale > 1)
+  {
+    // Every packed byte expands to `scale` bytes, every line repeats `scale` times
+    for (uint16_t y = 0; y < sizey; y++)
+    {
+      const uint8_t *src = &rowLines[y * GBP_TILES_LINE_SIZE_B];
+      uint8_t *line = &scaled[lines * dstStride];
+      for (int x = 0; x < GBP_TILES_LINE_SIZE_B; x++)
+        memcpy(&line[x * w->scale], w->expand[src[x]], w->scale);
+      lines++;
+      for (int r = 1; r < w->scale; r++, lines++)
+        memcpy(&scaled[lines * dstStride], line, dstStride);
+    }
+  }
+  else
+  {
+    // Sampled, output line y and pixel x are printed line y * GBP_DECODE_WIDTH / width and pixel x * GBP_DECODE_WIDTH / width
+    const uint32_t srcEnd = w->srcRows + sizey;
+    uint32_t srcLine;
+    while ((srcLine = (w->dstRows * GBP_DECODE_WIDTH) / width) < srcEnd)
+    {
+      const uint8_t *src = &rowLines[(srcLine - w->srcRows) * GBP_TILES_LINE_SIZE_B];
+      uint8_t *line = &scaled[lines * dstStride];
+      memset(line, 0, dstStride);
+      for (uint16_t x = 0; x < width; x++)
+      {
+        const uint16_t sx = (uint16_t) ((x * GBP_DECODE_WIDTH) / width);
+        const uint8_t pixel = (src[GBP_TILE_2BIT_LINEPACK_INDEX(sx)] >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(sx)) & 0b11;
+        line[GBP_TILE_2BIT_LINEPACK_INDEX(x)] |= pixel << GBP_TILE_2BIT_LINEPACK_BITOFFSET(x);
+      }
+      lines++;
+      w->dstRows++;
+    }
+  }
+  w->srcRows += sizey;
+  gbp_decode_writer_addLines(w, scaled, lines, pallet);
+}
+
+static void gbp_decode_writer_render(gbp_decode_writer_t *w)
+{
+  if (gbp_decode_writer_israw(w))
+    gbp_raw_render(&w->raw);
+  else if (w->sink.output == GBP_DECODE_OUTPUT_PNG)
+    gbp_png_render(&w->png);
+  else
+    gbp_bmp_render(&w->bmp);
+}
+
+static void gbp_decode_writer_free(gbp_decode_writer_t *w)
+{
+  if (gbp_decode_writer_israw(w))
+    gbp_raw_free(&w->raw);
+  else if (w->sink.output == GBP_DECODE_OUTPUT_PNG)
+    gbp_png_free(&w->png);
+  else
+    gbp_bmp_free(&w->bmp);
+}
+
+static bool gbp_decode_image_isopen(gbp_decode_t *session)
+{
+  for (int i = 0; i < session->writerCount; i++)
+  {
+    if (gbp_decode_writer_isopen(&session->writers[i]))
+      return true;
+  }
+  return false;
+}
+
+static bool gbp_decode_image_isstreamed(const gbp_decode_t *session)
+{
+  for (int i = 0; i < session->writerCount; i++)
+  {
+    if (gbp_decode_writer_israw(&session->writers[i]))
+      return true;
+  }
+  return false;
+}
+
+static void gbp_decode_image_open(gbp_decode_t *session)
+{
+  session->metaImage = (uint32_t) *gbp_decode_writer_counter(&session->writers[0]);
+  session->metaHeight = 0;
+  session->metaPrintCount = 0;
+  for (int i = 0; i < session->writerCount; i++)
+  {
+    if (!gbp_decode_writer_isopen(&session->writers[i]))
+      gbp_decode_writer_open(&session->writers[i]);
+  }
+}
+
+static void gbp_decode_image_add(gbp_decode_t *session, const uint8_t *rowLines, const uint16_t sizey, const uint8_t pallet)
+{
+  // Dev Note: Every writer gets the same decoded rows, so parsing and decompression happen once for all of them
+  const uint64_t start = gbp_stats_start(session->stats);
+  for (int i = 0; i < session->writerCount; i++)
+    gbp_decode_writer_add(&session->writers[i], session->scaled, rowLines, sizey, pallet);
+  session->metaHeight += sizey;
+  if (session->stats)
+  {
+    gbp_stats_stop(session->stats, GBP_STATS_STAGE_IMAGE_ADD, start);
+    session->stats->rows++;
+  }
+}
+
+static void gbp_decode_meta(gbp_decode_t *session)
+{
+  // One line of JSON per image (See Dev Note in gbp_decode.h)
+  FILE *f = session->config.meta;
+  const uint32_t *color = session->config.palletColor;
+  fprintf(f, "{\"image\":%u,\"width\":%u,\"height\":%u,\"palletColor\":[\"#%06x\",\"#%06x\",\"#%06x\",\"#%06x\"],\"prints\":[",
+      (unsigned) session->metaImage, (unsigned) GBP_DECODE_WIDTH, (unsigned) session->metaHeight,
+      (unsigned) (color[0] & 0xFFFFFF), (unsigned) (color[1] & 0xFFFFFF), (unsigned) (color[2] & 0xFFFFFF), (unsigned) (color[3] & 0xFFFFFF));
+  const uint32_t count = (session->metaPrintCount < GBP_DECODE_META_PRINTS_MAX) ? session->metaPrintCount : GBP_DECODE_META_PRINTS_MAX;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const uint8_t *print = session->metaPrints[i];
+    fprintf(f, "%s{\"sheets\":%d,\"marginBefore\":%d,\"marginAfter\":%d,\"pallet\":%d,\"density\":%d}", (i == 0) ? "" : ",",
+        gbp_pkt_printInstruction_num_of_sheets(print),
+        gbp_pkt_printInstruction_num_of_linefeed_before_print(print),
+        gbp_pkt_printInstruction_num_of_linefeed_after_print(print),
+        gbp_pkt_printInstruction_palette_value(print),
+        gbp_pkt_printInstruction_print_density(print));
+  }
+  fprintf(f, "]}\n");
+  fflush(f);
+}
+
+static void gbp_decode_image_render(gbp_decode_t *session)
+{
+  session->imageCounter++;
+  const uint64_t start = gbp_stats_start(session->stats);
+  for (int i = 0; i < session->writerCount; i++)
+  {
+    if (gbp_decode_writer_isopen(&session->writers[i]))
+      gbp_decode_writer_render(&session->writers[i]);
+  }
+  // A frame stream drops an image without rows, so its metadata line is dropped too
+  if (session->config.meta && !((session->metaHeight == 0) && gbp_decode_image_isstreamed(session)))
+    gbp_decode_meta(session);
+  if (session->stats)
+  {
+    gbp_stats_stop(session->stats, GBP_STATS_STAGE_IMAGE_RENDER, start);
+    session->stats->images++;
+  }
+}
+
+/*******************************************************************************
+ * Decoder
+*******************************************************************************/
+
+static void gbp_decode_gotPayload(gbp_decode_t *session, const uint8_t *payload)
+{
+  gbp_stats_t *stats = session->stats;
+  uint64_t start = gbp_stats_start(stats);
+  uint64_t tilesNs = 0; ///< Tile decoding done within the decompressor stage
+
+  // Whole uncompressed tiles are decoded straight from the payload (e.g. Gameboy Camera)
+  const uint8_t *tiles = NULL;
+  const size_t tileCount = gbp_pkt_tileDirect(&session->pkt, payload, session->pktbuffSize, &session->tileBuff, &tiles);
+  if (tileCount > 0)
+  {
+    const uint64_t tilesStart = gbp_stats_start(stats);
+    gbp_tiles_line_decoder_bulk(&session->tiles, tiles, tileCount);
+    tilesNs += gbp_stats_stop(stats, GBP_STATS_STAGE_TILES_LINE_DECODER, tilesStart);
+  }
+
+  // Support compression payload
+  size_t tileReady = 0;
+  while (gbp_pkt_decompressor(&session->pkt, payload, session->pktbuffSize, &session->tileBuff))
+  {
+    if (gbp_pkt_tileAccu_tileReadyCheck(&session->tileBuff))
+    {
+      const uint64_t tilesStart = gbp_stats_start(stats);
+      gbp_tiles_line_decoder(&session->tiles, session->tileBuff.tile);
+      tilesNs += gbp_stats_stop(stats, GBP_STATS_STAGE_TILES_LINE_DECODER, tilesStart);
+      tileReady++;
+    }
+  }
+
+  if (stats)
+  {
+    stats->stageNs[GBP_STATS_STAGE_PKT_DECOMPRESS] += (gbp_stats_nowNs() - start) - tilesNs;
+    stats->tiles += tileCount + tileReady;
+  }
+}
+
+static void gbp_decode_gotPrint(gbp_decode_t *session, const uint8_t *payload)
+{
+  const bool cutPaper = ((payload[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED]&0xF) != 0) ? true : false;  ///< if lower margin is zero, then new pic
+  const uint64_t start = gbp_stats_start(session->stats);
+  gbp_tiles_print(&session->tiles,
+      payload[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_SHEETS],
+      payload[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED],
+      payload[GBP_PRINT_INSTRUCT_INDEX_PALETTE_VALUE],
+      payload[GBP_PRINT_INSTRUCT_INDEX_PRINT_DENSITY]);
+  gbp_stats_stop(session->stats, GBP_STATS_STAGE_TILES_PRINT, start);
+
+  if (session->config.onPrint)
+  {
+    session->config.onPrint(session->config.user, &session->tiles, cutPaper);
+  }
+
+  if (session->writerCount > 0)
+  {
+    // Streaming BMP/PNG Writer
+    // Dev Note: Done this way to allow for streaming writes to file without a large buffer
+
+    // Open New File
+    if (!gbp_decode_image_isopen(session))
+    {
+      gbp_decode_image_open(session);
+    }
+    if (session->metaPrintCount < GBP_DECODE_META_PRINTS_MAX)
+    {
+      memcpy(session->metaPrints[session->metaPrintCount], payload, GBP_PRINT_INSTRUCT_PAYLOAD_SIZE);
+    }
+    session->metaPrintCount++;
+
+    // Write Decode Data Buffer Into BMP/PNG
+    for (int j = 0; j < session->tiles.tileRowOffset; j++)
+    {
+      const long int tileHeightIncrement = GBP_TILE_PIXEL_HEIGHT*GBP_BMP_MAX_TILE_HEIGHT;
+      const uint8_t *rowLines = gbp_tiles_rowLines(&session->tiles, j);
+      if (!rowLines)
+        break; // Rows beyond here were dropped
+      gbp_decode_image_add(session, rowLines, tileHeightIncrement, gbp_tiles_rowPallet(&session->tiles, j));
+    }
+  }
+  gbp_tiles_reset(&session->tiles); ///< Written to file, clear decoded tile line buffer
+
+  // Print finished and cut requested
+  if (cutPaper && gbp_decode_image_isopen(session))
+  {
+    gbp_decode_image_render(session);
+  }
+}
+
+static void gbp_decode_gotPacket(gbp_decode_t *session, const uint8_t *payload)
+{
+  if (session->stats)
+  {
+    // Packet start (Header) and end (Checksum) events, a short packet is both
+    if (session->pkt.received == GBP_REC_GOT_PACKET)
+      gbp_stats_packet(session->stats, session->pkt.command, session->pkt.compression, session->pkt.dataLength);
+    if ((session->pkt.pktByteIndex == 0) && !session->pkt.checksumOk)
+      session->stats->checksumFailures++;
+  }
+
+  if (session->pkt.received == GBP_REC_GOT_PACKET)
+  {
+    session->pktCounter++;
+    if (session->config.onPacket)
+    {
+      session->config.onPacket(session->config.user, &session->pkt, payload, session->pktbuffSize, session->pktCounter);
+    }
+    if (session->pkt.command == GBP_COMMAND_PRINT)
+    {
+      gbp_decode_gotPrint(session, payload);
+    }
+    else if (session->config.wholePacket && (session->pkt.command == GBP_COMMAND_DATA))
+    {
+      // Whole packet mode receives the data payload with the packet
+      gbp_decode_gotPayload(session, payload);
+    }
+  }
+  else
+  {
+    gbp_decode_gotPayload(session, payload);
+  }
+}
+
+/*******************************************************************************
+ * Session
+*******************************************************************************/
+
+gbp_decode_t *gbp_decode_create(const gbp_decode_config_t *config)
+{
+  gbp_decode_t *session = (gbp_decode_t *) calloc(1, sizeof(gbp_decode_t));
+  if (!session)
+    return NULL;
+
+  session->config = *config;
+  if (config->outputFilename)
+  {
+    strncpy(session->outputFilename, config->outputFilename, sizeof(session->outputFilename) - 1);
+  }
+  session->config.outputFilename = session->outputFilename;
+  session->stats = config->stats ? &session->statsStore : NULL;
+
+  // Payload Buffer
+  session->pktbuff = session->pktbuffStream;
+  session->pktbuffMax = sizeof(session->pktbuffStream);
+  if (config->wholePacket)
+  {
+    // Dev Note: Larger than any packet, so payloads arrive whole and (mostly) point into the ingest buffer
+    session->pktbuff = (uint8_t *) malloc(GBP_PKT_PAYLOAD_BUFF_SIZE_WHOLE_PACKET);
+    session->pktbuffMax = GBP_PKT_PAYLOAD_BUFF_SIZE_WHOLE_PACKET;
+    if (!session->pktbuff)
+    {
+      free(session);
+      return NULL;
+    }
+  }
+
+  // Image Writers, the primary output first then the sinks
+  const bool primary = (config->output != GBP_DECODE_OUTPUT_NONE);
+  const int writerCount = (primary ? 1 : 0) + config->sinkCount;
+  session->config.sinks = NULL;
+  session->config.sinkCount = 0;
+  if ((config->sinkCount > GBP_DECODE_SINKS_MAX) || (writerCount > 0 && !(session->writers = (gbp_decode_writer_t *) calloc(writerCount, sizeof(gbp_decode_writer_t)))))
+  {
+    gbp_decode_destroy(session);
+    return NULL;
+  }
+  if (primary)
+  {
+    gbp_decode_sink_t sink = {};
+    sink.output = config->output;
+    sink.stream = config->stream;
+    memcpy(sink.palletColor, config->palletColor, sizeof(sink.palletColor));
+    gbp_decode_writer_init(&session->writers[session->writerCount], &sink, config);
+    session->writers[session->writerCount++].filename = session->outputFilename;
+  }
+  bool scaled = false;
+  for (int i = 0; i < config->sinkCount; i++)
+  {
+    const uint16_t width = config->sinks[i].width;
+    if ((width % GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT) || (width > GBP_DECODE_WIDTH_MAX) || (config->sinks[i].output == GBP_DECODE_OUTPUT_NONE))
+    {
+      gbp_decode_destroy(session);
+      return NULL;
+    }
+    gbp_decode_writer_init(&session->writers[session->writerCount++], &config->sinks[i], config);
+    scaled = scaled || ((width != 0) && (width != GBP_DECODE_WIDTH));
+  }
+  if (scaled && !(session->scaled = (uint8_t *) malloc(GBP_DECODE_SCALED_SIZE)))
+  {
+    gbp_decode_destroy(session);
+    return NULL;
+  }
+
+  gbp_pkt_init(&session->pkt);
+  return session;
+}
+
+void gbp_decode_feed(gbp_decode_t *session, const uint8_t *bytes, const size_t bytesSize)
+{
+  size_t i = 0;
+  if (session->stats)
+    session->stats->bytesIngested += bytesSize;
+  while (i < bytesSize)
+  {
+    const uint8_t *payload = NULL;
+    const uint64_t start = gbp_stats_start(session->stats);
+    i += gbp_pkt_processBytes(&session->pkt, &bytes[i], bytesSize - i, session->pktbuff, &session->pktbuffSize, session->pktbuffMax, &payload);
+    gbp_stats_stop(session->stats, GBP_STATS_STAGE_PKT_PROCESS, start);
+    if (session->pkt.received != GBP_REC_NONE)
+    {
+      gbp_decode_gotPacket(session, payload);
+    }
+  }
+}
+
+void gbp_decode_flush(gbp_decode_t *session)
+{
+  // End of stream. Finish an image that was printed but never cut
+  // (Decoded rows that were never printed are dropped, as a real printer would)
+  if (gbp_decode_image_isopen(session))
+  {
+    gbp_decode_image_render(session);
+  }
+}
+
+void gbp_decode_writeRows(gbp_decode_t *session, const uint8_t *rowLines, const uint8_t *rowPallets, const uint16_t rowCount, const bool cutPaper)
+{
+  // Same as the streaming writer in gbp_decode_gotPrint(), but for rows decoded elsewhere
+  // (rowLines holds rowCount tile rows of GBP_TILE_PIXEL_HEIGHT lines back to back)
+  if (session->writerCount > 0)
+  {
+    if (!gbp_decode_image_isopen(session))
+    {
+      gbp_decode_image_open(session);
+    }
+    for (int j = 0; j < rowCount; j++)
+    {
+      const long int tileHeightIncrement = GBP_TILE_PIXEL_HEIGHT*GBP_BMP_MAX_TILE_HEIGHT;
+      gbp_decode_image_add(session, &rowLines[j * GBP_TILE_PIXEL_HEIGHT * GBP_TILES_LINE_SIZE_B], tileHeightIncrement, rowPallets[j]);
+    }
+  }
+  if (cutPaper && gbp_decode_image_isopen(session))
+  {
+    gbp_decode_image_render(session);
+  }
+}
+
+void gbp_decode_reset(gbp_decode_t *session, const char *outputFilename)
+{
+  // Start a new stream, keeping buffers and tile row blocks for reuse
+  gbp_decode_flush(session);
+  if (outputFilename)
+  {
+    strncpy(session->outputFilename, outputFilename, sizeof(session->outputFilename) - 1);
+  }
+  session->pktCounter = 0;
+  session->imageCounter = 0;
+  gbp_pkt_init(&session->pkt);
+  session->pktbuffSize = 0;
+  memset(&session->tileBuff, 0, sizeof(session->tileBuff));
+  gbp_tiles_reset(&session->tiles);
+  for (int i = 0; i < session->writerCount; i++)
+    *gbp_decode_writer_counter(&session->writers[i]) = 0;
+}
+
+void gbp_decode_setImageNumber(gbp_decode_t *session, const uint32_t imageNumber)
+{
+  // Number used in the filename of the next image (e.g. When decoding part of a capture)
+  for (int i = 0; i < session->writerCount; i++)
+    *gbp_decode_writer_counter(&session->writers[i]) = (int) imageNumber;
+}
+
+uint32_t gbp_decode_imageCount(const gbp_decode_t *session)
+{
+  return session->imageCounter;
+}
+
+gbp_stats_t *gbp_decode_stats(gbp_decode_t *session)
+{
+  // NULL unless enabled. Counts carry on across gbp_decode_reset(), callers may add to it (e.g. hex parse time)
+  if (session->stats)
+    gbp_tiles_cacheCounts(&session->tiles, &session->stats->tileCacheHits, &session->stats->tileCacheMisses);
+  return session->stats;
+}
+
+void gbp_decode_destroy(gbp_decode_t *session)
+{
+  if (!session)
+    return;
+  gbp_decode_flush(session);
+  if (session->pktbuff != session->pktbuffStream)
+  {
+    free(session->pktbuff);
+  }
+  gbp_tiles_free(&session->tiles);
+  for (int i = 0; i < session->writerCount; i++)
+    gbp_decode_writer_free(&session->writers[i]);
+  free(session->writers);
+  free(session->scaled);
+  free(session);
+}
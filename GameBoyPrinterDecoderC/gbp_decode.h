@@ -0,0 +1,136 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decode Session (libgbpdecode)
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on turning a raw printer byte stream into images
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_DECODE_H
+#define GBP_DECODE_H
+
+#include <stdio.h> // FILE
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include "gbp_pkt.h"
+#include "gbp_tiles.h"
+#include "gbp_out.h"
+#include "gbp_stats.h"
+
+/*
+    Dev Note: Decode Session
+    All decoder state (packet parser, payload buffer, tile accumulator, tile rows and the
+    open image) lives in one session object. Sessions share nothing, so each thread can run
+    its own session on its own capture.
+
+    ```
+    gbp_decode_t *session = gbp_decode_create(&config);
+    gbp_decode_feed(session, bytes, bytesSize); // As many times as needed
+    gbp_decode_flush(session);                  // End of stream
+    gbp_decode_reset(session, "next");          // Optional, reuse the session for another stream
+    gbp_decode_destroy(session);
+    ```
+
+    Images are written at each PRINT with a cut (non zero lower margin), or on flush.
+
+    Metadata (config.meta) is one line of JSON per image, written when the image is, e.g.
+    ```
+    {"image":0,"width":160,"height":144,"palletColor":["#ffffff","#aaaaaa","#555555","#000000"],
+     "prints":[{"sheets":1,"marginBefore":1,"marginAfter":3,"pallet":228,"density":64}]}
+    ```
+    "image" is the number in the output filename (or the frame number), "prints" lists the PRINT
+    instructions of the image (From gbp_pkt_printInstruction_*, up to GBP_DECODE_META_PRINTS_MAX).
+    A frame stream writes no frame for an image without rows (e.g. a PRINT with no data before it),
+    so when any writer is a frame stream that image gets no metadata line either. Metadata lines and
+    frames then pair up one to one, in order.
+
+    Dev Note: Multiple Outputs
+    config.output is the primary image writer, config.sinks adds more (e.g. a 2x png and a thumbnail
+    next to the bmp). Every writer is fed the same decoded rows, so packets are parsed and tiles
+    decompressed once however many files are written.
+    A sink width of a multiple of GBP_DECODE_WIDTH repeats each pixel (integer upscale), any other
+    width picks the nearest printed pixel. The height scales by the same ratio. Nearest neighbour
+    keeps every output 2bit, so each sink can still use its own pallet.
+*/
+
+#define GBP_DECODE_META_PRINTS_MAX 64
+#define GBP_DECODE_WIDTH (GBP_TILE_PIXEL_WIDTH*GBP_TILES_PER_LINE) ///< Printed image width
+#define GBP_DECODE_SINKS_MAX 8
+#define GBP_DECODE_SCALE_MAX 8
+#define GBP_DECODE_WIDTH_MAX (GBP_DECODE_WIDTH*GBP_DECODE_SCALE_MAX)
+#define GBP_DECODE_SCALED_SIZE ((GBP_TILE_PIXEL_HEIGHT*GBP_DECODE_SCALE_MAX+1)*GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(GBP_DECODE_WIDTH_MAX))
+
+typedef enum
+{
+  GBP_DECODE_OUTPUT_NONE, ///< Decode only (e.g. rows are consumed via onPrint())
+  GBP_DECODE_OUTPUT_BMP,  ///< 24bit bmp
+  GBP_DECODE_OUTPUT_BMP4, ///< 4bit palettized bmp
+  GBP_DECODE_OUTPUT_BMP2, ///< 2bit palettized bmp
+  GBP_DECODE_OUTPUT_PNG,  ///< 2bit indexed png
+  GBP_DECODE_OUTPUT_PPM,  ///< PPM frames into stream (See gbp_raw.h)
+  GBP_DECODE_OUTPUT_PAM,  ///< PAM frames into stream
+  GBP_DECODE_OUTPUT_GRAY8,///< Raw 8bit gray frames into stream
+  GBP_DECODE_OUTPUT_2BPP  ///< Raw 2bit indexed frames into stream
+} gbp_decode_output_t;
+
+typedef struct
+{
+  gbp_decode_output_t output;
+  const char *outputFilename; ///< Path without extention (Image number and extention is appended)
+  FILE *stream;               ///< Frame output of the stream formats
+  uint32_t palletColor[4];
+  uint16_t width;             ///< 0 for as printed, else a multiple of 4 up to GBP_DECODE_WIDTH_MAX
+} gbp_decode_sink_t;
+
+typedef struct
+{
+  gbp_decode_output_t output;
+  const char *outputFilename; ///< Path without extention (Image number and extention is appended)
+  uint32_t palletColor[4];
+  bool wholePacket;           ///< Decode each packet payload whole instead of in tile sized chunks
+  gbp_out_writer_t writer;    ///< How image files are written (See gbp_out.h)
+  bool progressive;           ///< Keep a viewable .part image updated every strip, renamed when done (See gbp_out.h)
+  bool stats;                 ///< Collect statistics (See gbp_decode_stats())
+  FILE *stream;               ///< Frame output of the stream formats (e.g. stdout)
+  FILE *meta;                 ///< One line of JSON per image (NDJSON) if set, see gbp_decode_meta()
+  const gbp_decode_sink_t *sinks; ///< Extra image writers (Copied by gbp_decode_create())
+  uint8_t sinkCount;
+
+  /* Optional Callbacks */
+  void *user;
+  void (*onPacket)(void *user, const gbp_pkt_t *pkt, const uint8_t *payload, const uint16_t payloadSize, const uint32_t pktCount); ///< Every complete packet
+  void (*onPrint)(void *user, gbp_tile_t *tiles, const bool cutPaper); ///< Rows printed, before they are written and reset
+} gbp_decode_config_t;
+
+typedef struct gbp_decode_s gbp_decode_t;
+
+const char *gbpCommand_toStr(int val);
+
+gbp_decode_t *gbp_decode_create(const gbp_decode_config_t *config);
+void gbp_decode_feed(gbp_decode_t *session, const uint8_t *bytes, const size_t bytesSize);
+void gbp_decode_flush(gbp_decode_t *session);
+void gbp_decode_writeRows(gbp_decode_t *session, const uint8_t *rowLines, const uint8_t *rowPallets, const uint16_t rowCount, const bool cutPaper);
+void gbp_decode_reset(gbp_decode_t *session, const char *outputFilename);
+void gbp_decode_setImageNumber(gbp_decode_t *session, const uint32_t imageNumber);
+uint32_t gbp_decode_imageCount(const gbp_decode_t *session);
+gbp_stats_t *gbp_decode_stats(gbp_decode_t *session);
+void gbp_decode_destroy(gbp_decode_t *session);
+
+#endif // GBP_DECODE_H
@@ -0,0 +1,263 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Synthetic Capture Generator
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on generating valid packet streams of any size from a seed
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "gameboy_printer_protocol.h"
+#include "gbp_gen.h"
+
+#define GBP_GEN_DENSITY      0x40 ///< Default print density
+#define GBP_GEN_REPEAT_MAX   0.995
+#define GBP_GEN_REPEAT_GAIN  0.5  ///< How hard the repeat chance is steered toward the compression target
+
+/*******************************************************************************
+ * Random
+*******************************************************************************/
+
+static uint64_t gbp_gen_rand(gbp_gen_t *gen)
+{
+  // xorshift64*
+  uint64_t x = gen->rng;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  gen->rng = x;
+  return x * 0x2545F4914F6CDD1Dull;
+}
+
+static uint32_t gbp_gen_below(gbp_gen_t *gen, const uint32_t n)
+{
+  return (n == 0) ? 0 : (uint32_t) ((gbp_gen_rand(gen) >> 32) % n);
+}
+
+static double gbp_gen_unit(gbp_gen_t *gen)
+{
+  return (double) (gbp_gen_rand(gen) >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+}
+
+/*******************************************************************************
+ * Packets
+*******************************************************************************/
+
+static void gbp_gen_noise(gbp_gen_t *gen)
+{
+  const uint32_t size = gbp_gen_below(gen, (uint32_t) gen->config.noiseMax + 1);
+  if (size == 0)
+    return;
+  for (uint32_t i = 0; i < size; i++)
+  {
+    const uint8_t b = (uint8_t) gbp_gen_rand(gen);
+    gen->noise[i] = (b == GBP_SYNC_WORD_0) ? 0x00 : b; // Never starts a sync
+  }
+  gen->stats.noiseBytes += size;
+  gen->stats.bytes += size;
+  gen->gotPacket(gen->user, gen->noise, size, GBP_GEN_COMMAND_NOISE);
+}
+
+static void gbp_gen_send(gbp_gen_t *gen, const uint8_t command, const uint8_t compression, const uint16_t dataLength)
+{
+  // Payload is already at gen->packet[6]
+  uint8_t *p = gen->packet;
+  p[0] = GBP_SYNC_WORD_0;
+  p[1] = GBP_SYNC_WORD_1;
+  p[2] = command;
+  p[3] = compression;
+  p[4] = (uint8_t) (dataLength >> 0);
+  p[5] = (uint8_t) (dataLength >> 8);
+  uint16_t checksum = 0;
+  for (int i = 2; i < (6 + dataLength); i++)
+    checksum += p[i];
+  p[6 + dataLength] = (uint8_t) (checksum >> 0);
+  p[7 + dataLength] = (uint8_t) (checksum >> 8);
+  p[8 + dataLength] = GBP_DEVICE_ID;
+  p[9 + dataLength] = 0x00; // Status
+
+  gbp_gen_noise(gen);
+  const size_t size = 10 + dataLength;
+  gen->stats.packets++;
+  gen->stats.bytes += size;
+  gen->gotPacket(gen->user, p, size, command);
+}
+
+static void gbp_gen_data(gbp_gen_t *gen)
+{
+  // Two tile rows of bytes, each repeating the previous one by chance
+  uint8_t prev = (uint8_t) gbp_gen_rand(gen);
+  for (int i = 0; i < GBP_GEN_DATA_SIZE; i++)
+  {
+    if (gbp_gen_unit(gen) >= gen->repeat)
+      prev = (uint8_t) gbp_gen_rand(gen);
+    gen->raw[i] = prev;
+  }
+
+  uint8_t *payload = &gen->packet[6];
+  const bool compress = gen->config.compression > 0;
+  size_t size = GBP_GEN_DATA_SIZE;
+  if (compress)
+  {
+    size = gbp_gen_rle(gen->raw, GBP_GEN_DATA_SIZE, payload);
+
+    // Steer toward the target ratio
+    const double ratio = (double) size / GBP_GEN_DATA_SIZE;
+    gen->repeat += GBP_GEN_REPEAT_GAIN * (ratio - gen->config.compression);
+    gen->repeat = (gen->repeat < 0.0) ? 0.0 : (gen->repeat > GBP_GEN_REPEAT_MAX) ? GBP_GEN_REPEAT_MAX : gen->repeat;
+  }
+  if (!compress || gen->config.raw)
+  {
+    memcpy(payload, gen->raw, GBP_GEN_DATA_SIZE);
+    size = GBP_GEN_DATA_SIZE;
+  }
+
+  gen->stats.payloadRaw += GBP_GEN_DATA_SIZE;
+  gen->stats.payloadSent += size;
+  gbp_gen_send(gen, GBP_COMMAND_DATA, (compress && !gen->config.raw) ? GBP_COMPRESSION_ENABLED : GBP_COMPRESSION_DISABLED, (uint16_t) size);
+}
+
+static void gbp_gen_print(gbp_gen_t *gen, const uint8_t margins)
+{
+  uint8_t *payload = &gen->packet[6];
+  payload[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_SHEETS]   = gen->config.sheets;
+  payload[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED] = margins;
+  payload[GBP_PRINT_INSTRUCT_INDEX_PALETTE_VALUE]   = gen->config.pallets[gbp_gen_below(gen, gen->config.palletCount)];
+  payload[GBP_PRINT_INSTRUCT_INDEX_PRINT_DENSITY]   = GBP_GEN_DENSITY;
+  gbp_gen_send(gen, GBP_COMMAND_PRINT, GBP_COMPRESSION_DISABLED, GBP_PRINT_INSTRUCT_PAYLOAD_SIZE);
+}
+
+/*******************************************************************************
+ * RLE (Inverse of gbp_pkt_decompressor())
+*******************************************************************************/
+
+size_t gbp_gen_rle(const uint8_t *in, const size_t inSize, uint8_t *out)
+{
+  // [0x00 + n-1][n bytes] raw run of 1..128 bytes, [0x80 + n-2][byte] repeated run of 2..129 bytes
+  // Dev Note: Repeats shorter than 3 stay in raw runs, they would not save a byte
+  size_t o = 0;
+  size_t i = 0;
+  while (i < inSize)
+  {
+    size_t run = 1;
+    while (((i + run) < inSize) && (in[i + run] == in[i]) && (run < 129))
+      run++;
+    if (run >= 3)
+    {
+      out[o++] = (uint8_t) (0x80 + run - 2);
+      out[o++] = in[i];
+      i += run;
+      continue;
+    }
+
+    const size_t start = i;
+    size_t n = 0;
+    while ((i < inSize) && (n < 128))
+    {
+      if (((i + 2) < inSize) && (in[i] == in[i + 1]) && (in[i] == in[i + 2]))
+        break;
+      i++;
+      n++;
+    }
+    out[o++] = (uint8_t) (n - 1);
+    memcpy(&out[o], &in[start], n);
+    o += n;
+  }
+  return o;
+}
+
+/*******************************************************************************
+ * Generator
+*******************************************************************************/
+
+void gbp_gen_defaults(gbp_gen_config_t *config)
+{
+  memset(config, 0, sizeof(*config));
+  config->seed = 1;
+  config->heightMin = 18; // Gameboy Camera (160x144)
+  config->heightMax = 18;
+  config->dataPerPrint = 9;
+  config->pallets[0] = 0xE4;
+  config->palletCount = 1;
+  config->sheets = 1;
+  config->marginBefore = 1;
+  config->marginAfter = 3;
+}
+
+void gbp_gen_init(gbp_gen_t *gen, const gbp_gen_config_t *config, void (*gotPacket)(void *user, const uint8_t *bytes, const size_t size, const int command), void *user)
+{
+  memset(&gen->stats, 0, sizeof(gen->stats));
+  gen->config = *config;
+  if (gen->config.heightMax < gen->config.heightMin)
+    gen->config.heightMax = gen->config.heightMin;
+  if (gen->config.dataPerPrint == 0)
+    gen->config.dataPerPrint = 1;
+  if (gen->config.palletCount == 0)
+  {
+    gen->config.pallets[0] = 0xE4;
+    gen->config.palletCount = 1;
+  }
+  gen->config.marginBefore &= 0x0F;
+  gen->config.marginAfter &= 0x0F;
+  gen->rng = config->seed ? config->seed : 0x9E3779B97F4A7C15ull; // xorshift state must not be zero
+  gen->repeat = (config->compression > 0) ? (1.0 - config->compression) : 0.5;
+  gen->gotPacket = gotPacket;
+  gen->user = user;
+}
+
+void gbp_gen_image(gbp_gen_t *gen)
+{
+  const gbp_gen_config_t *config = &gen->config;
+  uint32_t rows = config->heightMin + gbp_gen_below(gen, (uint32_t) (config->heightMax - config->heightMin) + 1);
+  rows = (rows + GBP_GEN_ROWS_PER_DATA - 1) / GBP_GEN_ROWS_PER_DATA * GBP_GEN_ROWS_PER_DATA;
+  rows = (rows == 0) ? GBP_GEN_ROWS_PER_DATA : rows;
+
+  gbp_gen_send(gen, GBP_COMMAND_INIT, GBP_COMPRESSION_DISABLED, 0);
+
+  uint32_t dataLeft = rows / GBP_GEN_ROWS_PER_DATA;
+  bool first = true;
+  while (dataLeft > 0)
+  {
+    const uint32_t band = (dataLeft < config->dataPerPrint) ? dataLeft : config->dataPerPrint;
+    for (uint32_t i = 0; i < band; i++)
+    {
+      gbp_gen_data(gen);
+      gbp_gen_send(gen, GBP_COMMAND_INQUIRY, GBP_COMPRESSION_DISABLED, 0);
+    }
+    dataLeft -= band;
+
+    // Empty DATA packet ends the band, then print and wait for the printer
+    gbp_gen_send(gen, GBP_COMMAND_DATA, GBP_COMPRESSION_DISABLED, 0);
+    const uint8_t margins = (uint8_t) (((first ? config->marginBefore : 0) << 4) | ((dataLeft == 0) ? config->marginAfter : 0));
+    gbp_gen_print(gen, margins);
+    const uint32_t inquiries = 1 + gbp_gen_below(gen, 3);
+    for (uint32_t i = 0; i < inquiries; i++)
+      gbp_gen_send(gen, GBP_COMMAND_INQUIRY, GBP_COMPRESSION_DISABLED, 0);
+    first = false;
+  }
+
+  if (gbp_gen_below(gen, 100) < config->breakPercent)
+    gbp_gen_send(gen, GBP_COMMAND_BREAK, GBP_COMPRESSION_DISABLED, 0);
+
+  gen->stats.images++;
+  gen->stats.rows += rows;
+}
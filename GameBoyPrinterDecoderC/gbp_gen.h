@@ -0,0 +1,104 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Synthetic Capture Generator
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on generating valid packet streams of any size from a seed
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_GEN_H
+#define GBP_GEN_H
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include "gameboy_printer_protocol.h"
+#include "gbp_tiles.h"
+
+/*
+    Dev Note: Generated images
+    Each image is sent the way a game would send it, one PRINT per band of DATA packets:
+
+    ```
+    [INIT] { [DATA][INQY] x dataPerPrint [DATA len 0][PRNT][INQY].. } x bands [BRK]?
+    ```
+
+    * A DATA packet holds 2 tile rows (640 bytes), so image heights are rounded up to even tile rows.
+    * Only the last PRINT of an image has a non zero lower margin (cut), the first one carries the upper margin.
+    * Payload bytes repeat the previous byte by chance. With a compression target the chance is steered
+      after every packet so the RLE payloads (as accepted by gbp_pkt_decompressor()) approach the
+      target size ratio. `raw` sends the same bytes uncompressed, so both decode to the same image.
+    * Noise bytes between packets never contain the first sync byte (0x88), so every packet stays parsable.
+    * Everything comes from one xorshift64* stream, the same config and seed give the same bytes.
+*/
+
+#define GBP_GEN_ROWS_PER_DATA      2   ///< Tile rows per full DATA packet
+#define GBP_GEN_DATA_SIZE          (GBP_GEN_ROWS_PER_DATA * GBP_TILES_PER_LINE * GBP_TILE_SIZE_IN_BYTE)
+#define GBP_GEN_RLE_MAX(size)      ((size) + ((size) + 127) / 128) ///< Worst case RLE payload size
+#define GBP_GEN_PACKET_MAX         (6 + GBP_GEN_RLE_MAX(GBP_GEN_DATA_SIZE) + 4)
+#define GBP_GEN_PALLETS_MAX        16
+#define GBP_GEN_COMMAND_NOISE      (-1) ///< gotPacket() command of noise bytes
+
+typedef struct
+{
+  uint64_t seed;
+  uint16_t heightMin;       ///< Tile rows per image
+  uint16_t heightMax;
+  uint8_t dataPerPrint;     ///< DATA packets per PRINT (A real printer buffer holds up to 13)
+  double compression;       ///< Target RLE payload / raw payload size (0: uncompressed)
+  bool raw;                 ///< Send payloads uncompressed, but with the content of the compression target
+  uint8_t pallets[GBP_GEN_PALLETS_MAX]; ///< One is picked per PRINT
+  uint8_t palletCount;
+  uint8_t sheets;
+  uint8_t marginBefore;     ///< Feeds before the image (0..15)
+  uint8_t marginAfter;      ///< Feeds after the image (0..15, 0 never cuts)
+  uint16_t noiseMax;        ///< Up to this many noise bytes before each packet
+  uint8_t breakPercent;     ///< Chance of a BREAK after an image
+} gbp_gen_config_t;
+
+typedef struct
+{
+  uint64_t packets;
+  uint64_t images;
+  uint64_t rows;            ///< Tile rows
+  uint64_t bytes;           ///< Packet and noise bytes
+  uint64_t noiseBytes;
+  uint64_t payloadRaw;      ///< DATA payload before compression
+  uint64_t payloadSent;     ///< DATA payload as sent
+} gbp_gen_stats_t;
+
+typedef struct
+{
+  gbp_gen_config_t config;
+  uint64_t rng;
+  double repeat;            ///< Chance a payload byte repeats the previous byte
+  gbp_gen_stats_t stats;
+  void (*gotPacket)(void *user, const uint8_t *bytes, const size_t size, const int command);
+  void *user;
+  uint8_t raw[GBP_GEN_DATA_SIZE];
+  uint8_t packet[GBP_GEN_PACKET_MAX];
+  uint8_t noise[0xFFFF];
+} gbp_gen_t;
+
+void gbp_gen_defaults(gbp_gen_config_t *config);
+void gbp_gen_init(gbp_gen_t *gen, const gbp_gen_config_t *config, void (*gotPacket)(void *user, const uint8_t *bytes, const size_t size, const int command), void *user);
+void gbp_gen_image(gbp_gen_t *gen);
+size_t gbp_gen_rle(const uint8_t *in, const size_t inSize, uint8_t *out);
+
+#endif // GBP_GEN_H
@@ -0,0 +1,590 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Hex Ingest
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on bulk decoding ascii hex captures into bytes
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "gbp_hex.h"
+#include "gbp_stats.h"
+
+/*
+    Dev Note: Block Decoder
+    Input is processed 64 characters at a time. For each block we build
+    * A 64bit mask of which characters are hex digits
+    * The nibble value of every character
+    From the digit mask, the position of each high nibble can be found with a
+    few integer operations (No per character branching). Each run of digits
+    pairs up from its first digit, so we only need to know if a run started
+    on an even or odd position. Adding the run start bits to the digit mask
+    carries through a run and clears it, which gives us the runs membership.
+
+    The pending nibble from the last block acts as an odd run start at -1.
+*/
+
+#define GBP_HEX_BLOCK 64
+#define GBP_HEX_EVEN_BITS 0x5555555555555555ULL
+
+typedef struct
+{
+  uint64_t digit;
+  uint64_t slash;
+  uint8_t nib[GBP_HEX_BLOCK + 1];
+} gbp_hex_block_t;
+
+/*******************************************************************************
+  Character Classification
+*******************************************************************************/
+
+static inline int gbp_hex_nibble(const char ch)
+{
+  if (('0' <= ch) && (ch <= '9'))
+    return ch - '0';
+  else if (('a' <= ch) && (ch <= 'f'))
+    return ch - 'a' + 10;
+  else if (('A' <= ch) && (ch <= 'F'))
+    return ch - 'A' + 10;
+  return -1;
+}
+
+#if defined(__AVX2__)
+static void gbp_hex_classify(const uint8_t *in, gbp_hex_block_t *blk)
+{
+  const __m256i zero   = _mm256_set1_epi8('0');
+  const __m256i nine   = _mm256_set1_epi8(9);
+  const __m256i lower  = _mm256_set1_epi8(0x20);
+  const __m256i alphaA = _mm256_set1_epi8('a');
+  const __m256i five   = _mm256_set1_epi8(5);
+  const __m256i ten    = _mm256_set1_epi8(10);
+  const __m256i slash  = _mm256_set1_epi8('/');
+  blk->digit = 0;
+  blk->slash = 0;
+  for (int i = 0; i < GBP_HEX_BLOCK; i += 32)
+  {
+    const __m256i c       = _mm256_loadu_si256((const __m256i *)(in + i));
+    const __m256i d       = _mm256_sub_epi8(c, zero);
+    const __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, nine), d);
+    const __m256i a       = _mm256_sub_epi8(_mm256_or_si256(c, lower), alphaA);
+    const __m256i isAlpha = _mm256_cmpeq_epi8(_mm256_min_epu8(a, five), a);
+    const __m256i nib     = _mm256_or_si256(_mm256_and_si256(isDigit, d), _mm256_and_si256(isAlpha, _mm256_add_epi8(a, ten)));
+    _mm256_storeu_si256((__m256i *)(blk->nib + i), nib);
+    blk->digit |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isDigit, isAlpha)) << i;
+    blk->slash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, slash)) << i;
+  }
+}
+#elif defined(__SSE2__)
+static void gbp_hex_classify(const uint8_t *in, gbp_hex_block_t *blk)
+{
+  const __m128i zero   = _mm_set1_epi8('0');
+  const __m128i nine   = _mm_set1_epi8(9);
+  const __m128i lower  = _mm_set1_epi8(0x20);
+  const __m128i alphaA = _mm_set1_epi8('a');
+  const __m128i five   = _mm_set1_epi8(5);
+  const __m128i ten    = _mm_set1_epi8(10);
+  const __m128i slash  = _mm_set1_epi8('/');
+  blk->digit = 0;
+  blk->slash = 0;
+  for (int i = 0; i < GBP_HEX_BLOCK; i += 16)
+  {
+    const __m128i c       = _mm_loadu_si128((const __m128i *)(in + i));
+    const __m128i d       = _mm_sub_epi8(c, zero);
+    const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+    const __m128i a       = _mm_sub_epi8(_mm_or_si128(c, lower), alphaA);
+    const __m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(a, five), a);
+    const __m128i nib     = _mm_or_si128(_mm_and_si128(isDigit, d), _mm_and_si128(isAlpha, _mm_add_epi8(a, ten)));
+    _mm_storeu_si128((__m128i *)(blk->nib + i), nib);
+    blk->digit |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) << i;
+    blk->slash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, slash)) << i;
+  }
+}
+#else
+static void gbp_hex_classify(const uint8_t *in, gbp_hex_block_t *blk)
+{
+  blk->digit = 0;
+  blk->slash = 0;
+  for (int i = 0; i < GBP_HEX_BLOCK; i++)
+  {
+    const int nib = gbp_hex_nibble((char)in[i]);
+    blk->nib[i] = (nib < 0) ? 0 : (uint8_t)nib;
+    blk->digit |= (uint64_t)(nib >= 0) << i;
+    blk->slash |= (uint64_t)(in[i] == '/') << i;
+  }
+}
+#endif
+
+const char *gbp_hex_simd_name(void)
+{
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSE2__)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+/*******************************************************************************
+  Block Decoder
+*******************************************************************************/
+
+// Decode the first `count` characters of a classified block. Returns bytes written.
+static size_t gbp_hex_block_decode(gbp_hex_t *hex, const gbp_hex_block_t *blk, const int count, uint8_t *out)
+{
+  const uint64_t valid = (count >= GBP_HEX_BLOCK) ? ~0ULL : ((1ULL << count) - 1);
+  const uint64_t digit = blk->digit & valid;
+  const uint64_t carry = (hex->lowNibFound && (digit & 1)) ? 1 : 0;
+  size_t outCount = 0;
+
+  if (count <= 0)
+    return 0;
+
+  // Pending high nibble from the previous block
+  if (hex->lowNibFound)
+  {
+    if (carry)
+      out[outCount++] = hex->byte | blk->nib[0];
+    hex->lowNibFound = false;
+  }
+
+  // Find every high nibble position
+  const uint64_t runs     = digit & ~carry; ///< Digit run starting at 0 already consumed its low nibble
+  const uint64_t starts   = runs & ~(runs << 1);
+  const uint64_t evenRuns = runs & ~(runs + (starts & GBP_HEX_EVEN_BITS));
+  const uint64_t oddRuns  = runs & ~evenRuns;
+  const uint64_t high     = (evenRuns & GBP_HEX_EVEN_BITS) | (oddRuns & ~GBP_HEX_EVEN_BITS);
+
+  // Emit pairs where the next character is the low nibble
+  uint64_t pairs = high & (runs >> 1);
+  while (pairs)
+  {
+    const int i = __builtin_ctzll(pairs);
+    out[outCount++] = (uint8_t)((blk->nib[i] << 4) | blk->nib[i + 1]);
+    pairs &= pairs - 1;
+  }
+
+  // High nibble on the last character is carried into the next block
+  if ((high >> (count - 1)) & 1)
+  {
+    hex->lowNibFound = true;
+    hex->byte = (uint8_t)(blk->nib[count - 1] << 4);
+  }
+
+  return outCount;
+}
+
+void gbp_hex_init(gbp_hex_t *hex)
+{
+  hex->comment = GBP_HEX_COMMENT_NONE;
+  hex->blockStar = false;
+  hex->lowNibFound = false;
+  hex->byte = 0;
+}
+
+// Skip comment text from `p`. Returns where decoding resumes (`end` if the comment is still open)
+static const uint8_t *gbp_hex_comment_skip(gbp_hex_t *hex, const uint8_t *p, const uint8_t *end)
+{
+  if (hex->comment == GBP_HEX_COMMENT_SLASH)
+  {
+    if (*p != '*')
+    {
+      hex->comment = GBP_HEX_COMMENT_LINE; // This character is already part of the line
+    }
+    else
+    {
+      hex->comment = GBP_HEX_COMMENT_BLOCK;
+      hex->blockStar = false; // `/ * /` does not close
+      p++;
+    }
+  }
+
+  if (hex->comment == GBP_HEX_COMMENT_LINE)
+  {
+    const uint8_t *nl = (const uint8_t *)memchr(p, '\n', end - p);
+    if (!nl)
+      return end;
+    hex->comment = GBP_HEX_COMMENT_NONE;
+    return nl + 1;
+  }
+
+  // Block comment (Bulk search for `/` then look back for `*`)
+  while (p < end)
+  {
+    const uint8_t *slash = (const uint8_t *)memchr(p, '/', end - p);
+    if (!slash)
+    {
+      hex->blockStar = (end[-1] == '*');
+      return end;
+    }
+    if ((slash > p) ? (slash[-1] == '*') : hex->blockStar)
+    {
+      hex->comment = GBP_HEX_COMMENT_NONE;
+      return slash + 1;
+    }
+    hex->blockStar = false;
+    p = slash + 1;
+  }
+  return end;
+}
+
+size_t gbp_hex_decode(gbp_hex_t *hex, const char *in, const size_t inSize, uint8_t *out)
+{
+  const uint8_t *p   = (const uint8_t *)in;
+  const uint8_t *end = p + inSize;
+  size_t outCount = 0;
+  gbp_hex_block_t blk;
+
+  while (p < end)
+  {
+    // Skip Comments
+    if (hex->comment != GBP_HEX_COMMENT_NONE)
+    {
+      p = gbp_hex_comment_skip(hex, p, end);
+      continue;
+    }
+
+    // Classify next block (Zero padded at end of input as zero is not hex)
+    const size_t remain = end - p;
+    int count = GBP_HEX_BLOCK;
+    if (remain < GBP_HEX_BLOCK)
+    {
+      uint8_t tail[GBP_HEX_BLOCK] = {0};
+      memcpy(tail, p, remain);
+      gbp_hex_classify(tail, &blk);
+      count = (int)remain;
+    }
+    else
+    {
+      gbp_hex_classify(p, &blk);
+    }
+
+    // Stop block at comment start
+    const uint64_t valid = (count >= GBP_HEX_BLOCK) ? ~0ULL : ((1ULL << count) - 1);
+    const uint64_t slash = blk.slash & valid;
+    if (slash)
+    {
+      count = __builtin_ctzll(slash);
+      hex->comment = GBP_HEX_COMMENT_SLASH;
+    }
+
+    outCount += gbp_hex_block_decode(hex, &blk, count, out + outCount);
+    p += count + (slash ? 1 : 0);
+  }
+
+  return outCount;
+}
+
+// Reference decoder (Same logic as the original fgetc() loop, plus `/ * * /` block comments)
+size_t gbp_hex_decode_scalar(gbp_hex_t *hex, const char *in, const size_t inSize, uint8_t *out)
+{
+  size_t outCount = 0;
+  for (size_t i = 0; i < inSize; i++)
+  {
+    const char ch = in[i];
+
+    // Skip Comments
+    if (hex->comment == GBP_HEX_COMMENT_SLASH)
+    {
+      // Might be `//` or `/*`
+      hex->comment = (ch == '*') ? GBP_HEX_COMMENT_BLOCK : GBP_HEX_COMMENT_LINE;
+      hex->blockStar = false;
+      if (ch == '*')
+        continue;
+    }
+    if (hex->comment == GBP_HEX_COMMENT_LINE)
+    {
+      // Discarding line
+      if (ch == '\n')
+        hex->comment = GBP_HEX_COMMENT_NONE;
+      continue;
+    }
+    else if (hex->comment == GBP_HEX_COMMENT_BLOCK)
+    {
+      // Discarding up to `*/`
+      if ((ch == '/') && hex->blockStar)
+        hex->comment = GBP_HEX_COMMENT_NONE;
+      hex->blockStar = (ch == '*');
+      continue;
+    }
+    else if (ch == '/')
+    {
+      hex->comment = GBP_HEX_COMMENT_SLASH;
+      continue;
+    }
+
+    // Parse Nibble
+    const int nib = gbp_hex_nibble(ch);
+    if (nib == -1)
+    {
+      // Not a hex digit pair. Ignore (Also covers `0x`)
+      hex->lowNibFound = false;
+    }
+    else if (!hex->lowNibFound)
+    {
+      hex->lowNibFound = true;
+      hex->byte = (uint8_t)(nib << 4);
+    }
+    else
+    {
+      hex->lowNibFound = false;
+      out[outCount++] = hex->byte | (uint8_t)nib;
+    }
+  }
+  return outCount;
+}
+
+/*******************************************************************************
+  Input Source
+*******************************************************************************/
+
+bool gbp_hex_src_open(gbp_hex_src_t *src, int fd)
+{
+  struct stat st;
+  src->fd = fd;
+  src->data = NULL;
+  src->size = 0;
+  src->mapped = false;
+  src->offset = 0;
+  src->block = NULL;
+
+  // Regular files are mapped in one go
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0))
+  {
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED)
+    {
+      madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+      src->data = (const uint8_t *)map;
+      src->size = (size_t)st.st_size;
+      src->mapped = true;
+      return true;
+    }
+  }
+
+  // Otherwise fall back to large block reads
+  src->block = (uint8_t *)malloc(GBP_HEX_READ_BLOCK_SIZE);
+  return src->block != NULL;
+}
+
+bool gbp_hex_src_next(gbp_hex_src_t *src, const char **chunk, size_t *chunkSize)
+{
+  if (src->mapped)
+  {
+    // Mapped file is handed out in block sized windows to bound the output buffer
+    if (src->offset >= src->size)
+      return false;
+    const size_t remain = src->size - src->offset;
+    *chunk = (const char *)src->data + src->offset;
+    *chunkSize = (remain < GBP_HEX_READ_BLOCK_SIZE) ? remain : GBP_HEX_READ_BLOCK_SIZE;
+    src->offset += *chunkSize;
+    return true;
+  }
+
+  if (!src->block)
+    return false;
+
+  ssize_t got = 0;
+  do
+  {
+    got = read(src->fd, src->block, GBP_HEX_READ_BLOCK_SIZE);
+  } while (got < 0 && errno == EINTR);
+
+  if (got <= 0)
+    return false;
+
+  *chunk = (const char *)src->block;
+  *chunkSize = (size_t)got;
+  return true;
+}
+
+void gbp_hex_src_close(gbp_hex_src_t *src)
+{
+  if (src->mapped)
+    munmap((void *)src->data, src->size);
+  free(src->block);
+  src->data = NULL;
+  src->size = 0;
+  src->mapped = false;
+  src->offset = 0;
+  src->block = NULL;
+}
+
+/*******************************************************************************
+  Ingest
+*******************************************************************************/
+
+size_t gbp_hex_ingest(int fd, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void *user)
+{
+  return gbp_hex_ingestTimed(fd, gotBytes, user, NULL);
+}
+
+size_t gbp_hex_ingestTimed(int fd, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void *user, uint64_t *hexNs)
+{
+  // Bulk ingest (mmap or large block read, then block hex decode)
+  // Time spent reading and decoding hex (not in gotBytes()) is added to hexNs if given
+  gbp_hex_t hex;
+  gbp_hex_src_t src;
+  const char *chunk = NULL;
+  size_t chunkSize = 0;
+  size_t bytec = 0;
+
+  uint8_t *out = (uint8_t *)malloc(GBP_HEX_OUTPUT_MAX(GBP_HEX_READ_BLOCK_SIZE));
+  if (!out)
+    return 0;
+
+  gbp_hex_init(&hex);
+  if (!gbp_hex_src_open(&src, fd))
+  {
+    free(out);
+    return 0;
+  }
+
+  uint64_t start = hexNs ? gbp_stats_nowNs() : 0;
+  while (gbp_hex_src_next(&src, &chunk, &chunkSize))
+  {
+    const size_t n = gbp_hex_decode(&hex, chunk, chunkSize, out);
+    if (hexNs)
+      *hexNs += gbp_stats_nowNs() - start;
+    gotBytes(user, out, n);
+    bytec += n;
+    start = hexNs ? gbp_stats_nowNs() : 0;
+  }
+
+  gbp_hex_src_close(&src);
+  free(out);
+  return bytec;
+}
+
+/*******************************************************************************
+  Follow
+*******************************************************************************/
+
+static bool gbp_hex_follow_wait(const int inotifyFd)
+{
+  // Wait for the file to change. False once the file was deleted or moved away
+  if (inotifyFd < 0)
+  {
+    poll(NULL, 0, GBP_HEX_FOLLOW_RETRY_MS);
+    return true;
+  }
+  struct pollfd pfd = {inotifyFd, POLLIN, 0};
+  if (poll(&pfd, 1, GBP_HEX_FOLLOW_WAIT_MS) <= 0)
+    return true;
+  bool present = true;
+  uint8_t events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t got;
+  while ((got = read(inotifyFd, events, sizeof(events))) > 0)
+  {
+    for (ssize_t i = 0; i < got; )
+    {
+      const struct inotify_event *event = (const struct inotify_event *) &events[i];
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+        present = false;
+      i += (ssize_t) (sizeof(struct inotify_event) + event->len);
+    }
+  }
+  return present;
+}
+
+size_t gbp_hex_follow(int fd, const char *path, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void (*restart)(void *user), void *user, volatile sig_atomic_t *stop)
+{
+  // Live tail of a capture (See Dev Note in gbp_hex.h)
+  gbp_hex_t hex;
+  size_t bytec = 0;
+  uint8_t *block = (uint8_t *)malloc(GBP_HEX_READ_BLOCK_SIZE);
+  uint8_t *out = (uint8_t *)malloc(GBP_HEX_OUTPUT_MAX(GBP_HEX_READ_BLOCK_SIZE));
+  if (!block || !out)
+  {
+    free(block);
+    free(out);
+    return 0;
+  }
+  gbp_hex_init(&hex);
+
+  struct stat st;
+  const bool regular = (fstat(fd, &st) == 0) && S_ISREG(st.st_mode);
+  int inotifyFd = -1;
+  if (regular && path)
+  {
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ((inotifyFd >= 0) && (inotify_add_watch(inotifyFd, path, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) < 0))
+    {
+      close(inotifyFd);
+      inotifyFd = -1;
+    }
+  }
+
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  bool present = true;
+  while (!*stop)
+  {
+    const ssize_t got = read(fd, block, GBP_HEX_READ_BLOCK_SIZE);
+    if (got > 0)
+    {
+      const size_t n = gbp_hex_decode(&hex, (const char *)block, (size_t)got, out);
+      gotBytes(user, out, n);
+      bytec += n;
+      offset += got;
+      continue;
+    }
+    if ((got < 0) && (errno == EINTR))
+      continue;
+    if ((got < 0) || !regular || !present)
+      break; // Read error, pipe closed, or the file is gone and drained
+
+    // End of file for now
+    if (fstat(fd, &st) == 0)
+    {
+      if (st.st_size < offset)
+      {
+        // Truncated, the capture starts over
+        offset = lseek(fd, 0, SEEK_SET);
+        gbp_hex_init(&hex);
+        if (restart)
+          restart(user);
+        continue;
+      }
+      if (st.st_nlink == 0)
+        break; // Deleted (Our open fd keeps the inode, so IN_DELETE_SELF only comes after close)
+    }
+    present = gbp_hex_follow_wait(inotifyFd);
+  }
+
+  if (inotifyFd >= 0)
+    close(inotifyFd);
+  free(block);
+  free(out);
+  return bytec;
+}
@@ -0,0 +1,100 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Hex Ingest
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on bulk decoding ascii hex captures into bytes
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include <signal.h> // sig_atomic_t
+
+/*
+    Dev Note: Capture grammar (Both decoders must match byte for byte)
+    * Hex digits are paired up into a byte starting from the first digit of a run
+    * Any other character drops a pending high nibble (e.g. `0x`, `,`, ` `, `(`)
+    * `/ *` discards everything up to and including the next `* /`, even across lines.
+      C array captures mark printer replies as `0x81, 0x00,` between `/ *(* /` and `/ *)* /`, so the
+      replies are kept in the byte stream like in the plain hex captures.
+    * Any other `/` discards everything up to and including the next newline (e.g. `//` comment lines).
+    * A pending high nibble is kept across a discarded comment.
+    The original fgetc() parser treated `/ *` like `//`, which dropped the replies of C array captures
+    and so left their packets out of step.
+*/
+
+// Worst case output size for a given input size (e.g. "FFFF...")
+#define GBP_HEX_OUTPUT_MAX(inputSize) ((inputSize) / 2 + 1)
+
+// Large block size used when input cannot be memory mapped (e.g. stdin or pipes)
+#define GBP_HEX_READ_BLOCK_SIZE (1024 * 1024)
+
+/*
+    Dev Note: Follow (Live tail of a capture that is still being written)
+    gbp_hex_follow() reads with read() from the current offset and hands over whatever arrived, keeping the
+    hex state (and the caller keeps its decode session), so nothing is ever read twice.
+    * Regular file : At end of file, wait on inotify (IN_MODIFY) for the file to grow. Without a path or
+                     inotify it checks again every GBP_HEX_FOLLOW_RETRY_MS. A file that shrinks (truncated
+                     log) is read again from the start, after `restart` (if set) so the caller can drop
+                     its half decoded state. Ends once the file is deleted or moved and drained.
+    * Pipe or tty  : Blocking reads, ends when the writer closes.
+    Either way it also ends once `*stop` is set (e.g. from a SIGINT handler, which also interrupts the wait).
+*/
+#define GBP_HEX_FOLLOW_WAIT_MS   1000 ///< Longest inotify wait between checks of `*stop`
+#define GBP_HEX_FOLLOW_RETRY_MS  20   ///< Poll interval when inotify is not available
+
+typedef enum
+{
+  GBP_HEX_COMMENT_NONE,
+  GBP_HEX_COMMENT_SLASH, ///< `/` seen, the next character picks the comment kind
+  GBP_HEX_COMMENT_LINE,  ///< Discarding up to the next newline
+  GBP_HEX_COMMENT_BLOCK  ///< Discarding up to the next `* /`
+} gbp_hex_comment_t;
+
+typedef struct
+{
+  gbp_hex_comment_t comment;
+  bool blockStar;   ///< Block comment text so far ends in `*`
+  bool lowNibFound; ///< High nibble parsed, waiting on low nibble
+  uint8_t byte;     ///< Pending high nibble
+} gbp_hex_t;
+
+typedef struct
+{
+  const uint8_t *data;
+  size_t size;
+  bool mapped;
+  size_t offset;  ///< Mapped file read position
+  uint8_t *block; ///< Read buffer used when not mapped
+  int fd;
+} gbp_hex_src_t;
+
+void gbp_hex_init(gbp_hex_t *hex);
+size_t gbp_hex_decode(gbp_hex_t *hex, const char *in, const size_t inSize, uint8_t *out);
+size_t gbp_hex_decode_scalar(gbp_hex_t *hex, const char *in, const size_t inSize, uint8_t *out);
+const char *gbp_hex_simd_name(void);
+
+bool gbp_hex_src_open(gbp_hex_src_t *src, int fd);
+bool gbp_hex_src_next(gbp_hex_src_t *src, const char **chunk, size_t *chunkSize);
+void gbp_hex_src_close(gbp_hex_src_t *src);
+
+size_t gbp_hex_follow(int fd, const char *path, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void (*restart)(void *user), void *user, volatile sig_atomic_t *stop);
+size_t gbp_hex_ingest(int fd, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void *user);
+size_t gbp_hex_ingestTimed(int fd, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void *user, uint64_t *hexNs);
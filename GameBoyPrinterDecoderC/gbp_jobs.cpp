@@ -0,0 +1,241 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Print Job Index
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on splitting one capture into print jobs and decoding them in parallel
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "gameboy_printer_protocol.h"
+#include "gbp_decode.h"
+#include "gbp_jobs.h"
+
+typedef struct
+{
+  const gbp_jobs_index_t *index;
+  const uint8_t *bytes;
+  const gbp_decode_config_t *decodeConfig;
+  pthread_mutex_t lock;
+  size_t next; ///< Next job to hand out
+  bool ok;
+  uint64_t images;
+  gbp_stats_t stats; ///< Worker sessions combined (If decodeConfig->stats)
+} gbp_jobs_pool_t;
+
+/*******************************************************************************
+ * Pre-scan
+*******************************************************************************/
+
+bool gbp_jobs_add(gbp_jobs_index_t *index, const size_t start, const size_t end, const uint32_t packets, const bool cut)
+{
+  if (index->count >= index->max)
+  {
+    const size_t max = index->max ? index->max * 2 : 64;
+    gbp_jobs_job_t *jobs = (gbp_jobs_job_t *) realloc(index->jobs, max * sizeof(gbp_jobs_job_t));
+    if (!jobs)
+      return false;
+    index->jobs = jobs;
+    index->max = max;
+  }
+  gbp_jobs_job_t *job = &index->jobs[index->count++];
+  job->start = start;
+  job->end = end;
+  job->packets = packets;
+  job->cut = cut;
+  return true;
+}
+
+bool gbp_jobs_packetNext(const uint8_t *bytes, const size_t bytesSize, size_t *offset, size_t *pktSize)
+{
+  size_t i = *offset;
+  while (i < bytesSize)
+  {
+    // Sync (Same as gbp_pkt_processByte(), a byte after 0x88 that is not 0x33 is dropped with it)
+    const uint8_t *p = (const uint8_t *) memchr(&bytes[i], 0x88, bytesSize - i);
+    if (!p)
+      break;
+    i = (size_t)(p - bytes);
+    if ((i + 1) >= bytesSize)
+      break;
+    if (bytes[i + 1] != 0x33)
+    {
+      i += 2;
+      continue;
+    }
+
+    // Header
+    if ((i + GBP_JOBS_PKT_HEADER_SIZE) > bytesSize)
+      break; // Truncated
+    const uint16_t dataLength = (uint16_t)(bytes[i + 4] | (bytes[i + 5] << 8));
+    const size_t size = GBP_JOBS_PKT_HEADER_SIZE + dataLength + GBP_JOBS_PKT_TRAILER_SIZE;
+    if ((i + size) > bytesSize)
+      break;
+    *offset = i;
+    *pktSize = size;
+    return true;
+  }
+  *offset = bytesSize;
+  return false;
+}
+
+bool gbp_jobs_packetIsCut(const uint8_t *pkt, const size_t pktSize)
+{
+  // PRINT with a non zero lower margin
+  const uint8_t command = pkt[2];
+  const size_t dataLength = pktSize - GBP_JOBS_PKT_HEADER_SIZE - GBP_JOBS_PKT_TRAILER_SIZE;
+  const uint8_t *payload = &pkt[GBP_JOBS_PKT_HEADER_SIZE];
+  return (command == GBP_COMMAND_PRINT) && (dataLength > GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED)
+      && ((payload[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED]&0xF) != 0);
+}
+
+bool gbp_jobs_scan(gbp_jobs_index_t *index, const uint8_t *bytes, const size_t bytesSize)
+{
+  size_t i = 0;
+  size_t pktSize = 0;
+  size_t jobStart = 0;
+  uint32_t jobPackets = 0;
+
+  memset(index, 0, sizeof(*index));
+
+  while (gbp_jobs_packetNext(bytes, bytesSize, &i, &pktSize))
+  {
+    jobPackets++;
+    index->packets++;
+    const size_t pktEnd = i + pktSize;
+
+    // Cutting print ends the job
+    if (gbp_jobs_packetIsCut(&bytes[i], pktSize))
+    {
+      if (!gbp_jobs_add(index, jobStart, pktEnd, jobPackets, true))
+        return false;
+      jobStart = pktEnd;
+      jobPackets = 0;
+    }
+    i = pktEnd;
+  }
+
+  // Tail (Uncut print, truncated packet, or trailing bytes with no image)
+  if (jobStart < bytesSize)
+  {
+    if (!gbp_jobs_add(index, jobStart, bytesSize, jobPackets, false))
+      return false;
+  }
+  return true;
+}
+
+void gbp_jobs_free(gbp_jobs_index_t *index)
+{
+  free(index->jobs);
+  memset(index, 0, sizeof(*index));
+}
+
+/*******************************************************************************
+ * Parallel Decode
+*******************************************************************************/
+
+static void *gbp_jobs_worker(void *arg)
+{
+  gbp_jobs_pool_t *pool = (gbp_jobs_pool_t *) arg;
+  uint64_t images = 0;
+
+  gbp_decode_t *session = gbp_decode_create(pool->decodeConfig);
+  if (!session)
+  {
+    pthread_mutex_lock(&pool->lock);
+    pool->ok = false;
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+  }
+
+  while (true)
+  {
+    // Jobs are handed out in order, so early images are finished first
+    pthread_mutex_lock(&pool->lock);
+    const size_t jobIndex = pool->next;
+    if (jobIndex < pool->index->count)
+      pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (jobIndex >= pool->index->count)
+      break;
+
+    const gbp_jobs_job_t *job = &pool->index->jobs[jobIndex];
+    gbp_decode_reset(session, NULL);
+    gbp_decode_setImageNumber(session, (uint32_t) jobIndex);
+    gbp_decode_feed(session, &pool->bytes[job->start], job->end - job->start);
+    gbp_decode_flush(session);
+    images += gbp_decode_imageCount(session);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->images += images;
+  if (gbp_decode_stats(session))
+    gbp_stats_merge(&pool->stats, gbp_decode_stats(session));
+  pthread_mutex_unlock(&pool->lock);
+  gbp_decode_destroy(session);
+  return NULL;
+}
+
+bool gbp_jobs_decode(const gbp_jobs_index_t *index, const uint8_t *bytes, const gbp_decode_config_t *decodeConfig, int threads, uint64_t *images, gbp_stats_t *stats)
+{
+  gbp_jobs_pool_t pool = {};
+  pool.index = index;
+  pool.bytes = bytes;
+  pool.decodeConfig = decodeConfig;
+  pool.ok = true;
+  pthread_mutex_init(&pool.lock, NULL);
+
+  if (threads <= 0)
+  {
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (cores > 0) ? (int) cores : 1;
+  }
+  if ((size_t) threads > index->count)
+    threads = (index->count > 0) ? (int) index->count : 1;
+
+  pthread_t *thread = (pthread_t *) calloc(threads, sizeof(pthread_t));
+  int started = 0;
+  for (; thread && (started < threads); started++)
+  {
+    if (pthread_create(&thread[started], NULL, gbp_jobs_worker, &pool) != 0)
+      break;
+  }
+  if (started == 0)
+  {
+    // Could not spawn any thread, decode everything on this one
+    gbp_jobs_worker(&pool);
+  }
+  for (int i = 0; i < started; i++)
+  {
+    pthread_join(thread[i], NULL);
+  }
+  free(thread);
+  pthread_mutex_destroy(&pool.lock);
+
+  *images = pool.images;
+  if (stats)
+    gbp_stats_merge(stats, &pool.stats);
+  return pool.ok;
+}
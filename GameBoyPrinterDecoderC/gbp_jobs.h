@@ -0,0 +1,78 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Print Job Index
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on splitting one capture into print jobs and decoding them in parallel
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_JOBS_H
+#define GBP_JOBS_H
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include "gbp_decode.h"
+
+/*
+    Dev Note: Print Jobs
+    An image ends at the PRINT packet with a non zero lower margin (cut). Everything after
+    it (usually starting with INIT) belongs to the next image, so each job below can be
+    decoded by a fresh session and produce the same image a serial decode would:
+
+    ```
+    [INIT][DATA]..[DATA][PRNT margin 0x00] .. [DATA]..[PRNT margin 0x03] | [INIT][DATA].. | ...
+    <------------------------------ job 0 ------------------------------> <--- job 1 ---
+    ```
+
+    The pre-scan only follows the packet framing of gbp_pkt_processByte() (sync, command and
+    length), it never touches the payload beyond the PRINT margin byte.
+    Job N renders image N, so numbering matches a serial decode.
+
+    Assumes a cut leaves no partially received tile behind (The printer clears its buffer
+    on print, a serial decode would carry the stray bytes into the next image).
+*/
+
+#define GBP_JOBS_PKT_HEADER_SIZE  6 ///< [SYNC][SYNC][COMM][COMP][LEN0][LEN1]
+#define GBP_JOBS_PKT_TRAILER_SIZE 4 ///< [CSUM0][CSUM1][DUMMY][DUMMY]
+
+typedef struct
+{
+  size_t start;     ///< First byte of the job
+  size_t end;       ///< One past the last byte of the job
+  uint32_t packets;
+  bool cut;         ///< Ends with a cutting PRINT (Otherwise it is the capture tail)
+} gbp_jobs_job_t;
+
+typedef struct
+{
+  gbp_jobs_job_t *jobs;
+  size_t count;
+  size_t max;
+  uint32_t packets;
+} gbp_jobs_index_t;
+
+bool gbp_jobs_packetNext(const uint8_t *bytes, const size_t bytesSize, size_t *offset, size_t *pktSize);
+bool gbp_jobs_packetIsCut(const uint8_t *pkt, const size_t pktSize);
+bool gbp_jobs_add(gbp_jobs_index_t *index, const size_t start, const size_t end, const uint32_t packets, const bool cut);
+bool gbp_jobs_scan(gbp_jobs_index_t *index, const uint8_t *bytes, const size_t bytesSize);
+void gbp_jobs_free(gbp_jobs_index_t *index);
+bool gbp_jobs_decode(const gbp_jobs_index_t *index, const uint8_t *bytes, const gbp_decode_config_t *decodeConfig, int threads, uint64_t *images, gbp_stats_t *stats);
+
+#endif // GBP_JOBS_H
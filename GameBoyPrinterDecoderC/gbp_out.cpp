@@ -0,0 +1,636 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Image Output File
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on writing image files without stalling the decoder on disk latency
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gbp_out.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#define GBP_OUT_HAS_URING 1
+#else
+#define GBP_OUT_HAS_URING 0
+#endif
+
+const char *gbp_out_writerName(const gbp_out_writer_t writer)
+{
+  switch (writer)
+  {
+    case GBP_OUT_WRITER_STDIO  : return "stdio";
+    case GBP_OUT_WRITER_PWRITE : return "pwrite";
+    case GBP_OUT_WRITER_URING  : return "uring";
+    default: return "?";
+  }
+}
+
+bool gbp_out_writerParse(const char *name, gbp_out_writer_t *writer)
+{
+  if (strcmp(name, "stdio") == 0)
+    *writer = GBP_OUT_WRITER_STDIO;
+  else if (strcmp(name, "pwrite") == 0)
+    *writer = GBP_OUT_WRITER_PWRITE;
+  else if (strcmp(name, "uring") == 0)
+    *writer = GBP_OUT_WRITER_URING;
+  else
+    return false;
+  return true;
+}
+
+static bool gbp_out_pwriteAll(int fd, const uint8_t *bytes, size_t size, uint64_t offset)
+{
+  while (size > 0)
+  {
+    const ssize_t n = pwrite(fd, bytes, size, (off_t) offset);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    bytes += n;
+    size -= (size_t) n;
+    offset += (uint64_t) n;
+  }
+  return true;
+}
+
+/*******************************************************************************
+ * io_uring (Raw syscalls, see io_uring_setup(2))
+*******************************************************************************/
+
+#if GBP_OUT_HAS_URING
+
+#define GBP_OUT_RING_ENTRIES (2 * GBP_OUT_BUFFERS)
+
+struct gbp_out_ring_s
+{
+  int ringFd;
+  bool fixed; ///< Buffers are registered (IORING_OP_WRITE_FIXED), else IORING_OP_WRITE
+
+  // Submission queue
+  uint8_t *sqMap;
+  size_t sqMapSize;
+  struct io_uring_sqe *sqes;
+  size_t sqesSize;
+  unsigned *sqTail;
+  unsigned *sqMask;
+  unsigned *sqArray;
+
+  // Completion queue
+  uint8_t *cqMap;
+  size_t cqMapSize;
+  unsigned *cqHead;
+  unsigned *cqTail;
+  unsigned *cqMask;
+  struct io_uring_cqe *cqes;
+
+  // Buffers
+  uint8_t *buffers;
+  bool busy[GBP_OUT_BUFFERS];
+  bool pending[GBP_OUT_BUFFERS]; ///< Submitted, completion not reaped yet
+  int bufferFd[GBP_OUT_BUFFERS];
+  uint32_t bufferSize[GBP_OUT_BUFFERS];
+  uint64_t bufferOffset[GBP_OUT_BUFFERS];
+  unsigned inflight;
+  bool failed;     ///< A write failed since the last open
+  bool pwriteOnly; ///< Writes go through pwrite from here on (Ring broken or writes not supported)
+  bool dead;       ///< io_uring_enter failed, the ring is not entered again
+};
+
+static int gbp_out_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+  return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int gbp_out_uring_enter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+  return (int) syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int gbp_out_uring_register(int ringFd, unsigned opcode, const void *arg, unsigned nrArgs)
+{
+  return (int) syscall(__NR_io_uring_register, ringFd, opcode, arg, nrArgs);
+}
+
+static void gbp_out_ring_free(gbp_out_ring_t *ring)
+{
+  if (!ring)
+    return;
+  if (ring->sqes)
+    munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqMap && (ring->cqMap != ring->sqMap))
+    munmap(ring->cqMap, ring->cqMapSize);
+  if (ring->sqMap)
+    munmap(ring->sqMap, ring->sqMapSize);
+  if (ring->ringFd >= 0)
+    close(ring->ringFd);
+  free(ring->buffers);
+  free(ring);
+}
+
+static gbp_out_ring_t *gbp_out_ring_create(void)
+{
+  gbp_out_ring_t *ring = (gbp_out_ring_t *) calloc(1, sizeof(gbp_out_ring_t));
+  if (!ring)
+    return NULL;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring->ringFd = gbp_out_uring_setup(GBP_OUT_RING_ENTRIES, &params);
+  if (ring->ringFd < 0)
+  {
+    free(ring);
+    return NULL;
+  }
+
+  // Map the rings (One mapping for both on kernels with IORING_FEAT_SINGLE_MMAP)
+  ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    ring->sqMapSize = (ring->cqMapSize > ring->sqMapSize) ? ring->cqMapSize : ring->sqMapSize;
+    ring->cqMapSize = ring->sqMapSize;
+  }
+  void *map = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQ_RING);
+  ring->sqMap = (map == MAP_FAILED) ? NULL : (uint8_t *) map;
+  if (ring->sqMap && (params.features & IORING_FEAT_SINGLE_MMAP))
+  {
+    ring->cqMap = ring->sqMap;
+  }
+  else if (ring->sqMap)
+  {
+    map = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_CQ_RING);
+    ring->cqMap = (map == MAP_FAILED) ? NULL : (uint8_t *) map;
+  }
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  map = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQES);
+  ring->sqes = (map == MAP_FAILED) ? NULL : (struct io_uring_sqe *) map;
+  if (!ring->sqMap || !ring->cqMap || !ring->sqes)
+  {
+    gbp_out_ring_free(ring);
+    return NULL;
+  }
+  ring->sqTail  = (unsigned *) &ring->sqMap[params.sq_off.tail];
+  ring->sqMask  = (unsigned *) &ring->sqMap[params.sq_off.ring_mask];
+  ring->sqArray = (unsigned *) &ring->sqMap[params.sq_off.array];
+  ring->cqHead  = (unsigned *) &ring->cqMap[params.cq_off.head];
+  ring->cqTail  = (unsigned *) &ring->cqMap[params.cq_off.tail];
+  ring->cqMask  = (unsigned *) &ring->cqMap[params.cq_off.ring_mask];
+  ring->cqes    = (struct io_uring_cqe *) &ring->cqMap[params.cq_off.cqes];
+
+  // Register the buffers once, so the kernel does not map pages on every write
+  ring->buffers = (uint8_t *) aligned_alloc(4096, GBP_OUT_BUFFERS * GBP_OUT_BUFFER_SIZE);
+  if (!ring->buffers)
+  {
+    gbp_out_ring_free(ring);
+    return NULL;
+  }
+  struct iovec iov[GBP_OUT_BUFFERS];
+  for (int i = 0; i < GBP_OUT_BUFFERS; i++)
+  {
+    iov[i].iov_base = &ring->buffers[i * GBP_OUT_BUFFER_SIZE];
+    iov[i].iov_len = GBP_OUT_BUFFER_SIZE;
+  }
+  // Dev Note: Can fail on a low RLIMIT_MEMLOCK, plain writes from the same buffers still work
+  ring->fixed = (gbp_out_uring_register(ring->ringFd, IORING_REGISTER_BUFFERS, iov, GBP_OUT_BUFFERS) == 0);
+  return ring;
+}
+
+static void gbp_out_ring_abandon(gbp_out_ring_t *ring)
+{
+  // io_uring_enter failed hard, so completions may never come: write everything still pending here
+  // (Rewriting a write the kernel already did puts the same bytes at the same offset)
+  ring->dead = true;
+  ring->pwriteOnly = true;
+  for (int i = 0; i < GBP_OUT_BUFFERS; i++)
+  {
+    if (!ring->pending[i])
+      continue;
+    if (!gbp_out_pwriteAll(ring->bufferFd[i], &ring->buffers[i * GBP_OUT_BUFFER_SIZE], ring->bufferSize[i], ring->bufferOffset[i]))
+      ring->failed = true;
+    ring->pending[i] = false;
+    ring->busy[i] = false;
+  }
+  ring->inflight = 0;
+}
+
+static void gbp_out_ring_complete(gbp_out_ring_t *ring, const struct io_uring_cqe *cqe)
+{
+  const int i = (int) cqe->user_data;
+  if (cqe->res == -EINVAL)
+  {
+    // Dev Note: Plain IORING_OP_WRITE is -EINVAL before Linux 5.6, so write it here and stop using the ring
+    ring->pwriteOnly = true;
+    if (!gbp_out_pwriteAll(ring->bufferFd[i], &ring->buffers[i * GBP_OUT_BUFFER_SIZE], ring->bufferSize[i], ring->bufferOffset[i]))
+      ring->failed = true;
+  }
+  else if (cqe->res < 0)
+  {
+    ring->failed = true;
+  }
+  else if ((uint32_t) cqe->res < ring->bufferSize[i])
+  {
+    // Short write, finish it here
+    const uint32_t done = (uint32_t) cqe->res;
+    if (!gbp_out_pwriteAll(ring->bufferFd[i], &ring->buffers[i * GBP_OUT_BUFFER_SIZE + done], ring->bufferSize[i] - done, ring->bufferOffset[i] + done))
+      ring->failed = true;
+  }
+  ring->pending[i] = false;
+  ring->busy[i] = false;
+  ring->inflight--;
+}
+
+static void gbp_out_ring_reap(gbp_out_ring_t *ring, const bool wait)
+{
+  if (ring->dead)
+    return; // Everything pending was written by gbp_out_ring_abandon()
+  if (wait && (ring->inflight > 0))
+  {
+    while (gbp_out_uring_enter(ring->ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+    {
+      if (errno != EINTR)
+      {
+        gbp_out_ring_abandon(ring);
+        return;
+      }
+    }
+  }
+  unsigned head = *ring->cqHead;
+  const unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+  while (head != tail)
+  {
+    gbp_out_ring_complete(ring, &ring->cqes[head & *ring->cqMask]);
+    head++;
+  }
+  __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+static int gbp_out_ring_acquire(gbp_out_ring_t *ring)
+{
+  while (true)
+  {
+    for (int i = 0; i < GBP_OUT_BUFFERS; i++)
+    {
+      if (!ring->busy[i])
+      {
+        ring->busy[i] = true;
+        return i;
+      }
+    }
+    gbp_out_ring_reap(ring, true);
+  }
+}
+
+static void gbp_out_ring_submit(gbp_out_ring_t *ring, const int fd, const int i, const uint32_t size, const uint64_t offset)
+{
+  ring->bufferFd[i] = fd;
+  ring->bufferSize[i] = size;
+  ring->bufferOffset[i] = offset;
+  if (ring->pwriteOnly)
+  {
+    ring->failed = !gbp_out_pwriteAll(fd, &ring->buffers[i * GBP_OUT_BUFFER_SIZE], size, offset) || ring->failed;
+    ring->busy[i] = false;
+    return;
+  }
+
+  const unsigned tail = *ring->sqTail;
+  const unsigned index = tail & *ring->sqMask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = ring->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t) (uintptr_t) &ring->buffers[i * GBP_OUT_BUFFER_SIZE];
+  sqe->len = size;
+  sqe->off = offset;
+  sqe->buf_index = ring->fixed ? (uint16_t) i : 0;
+  sqe->user_data = (uint64_t) i;
+  ring->sqArray[index] = index;
+  __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+  ring->pending[i] = true;
+  ring->inflight++;
+
+  while (true)
+  {
+    const int ret = gbp_out_uring_enter(ring->ringFd, 1, 0, 0);
+    if (ret >= 0)
+      break;
+    if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY))
+    {
+      gbp_out_ring_reap(ring, false);
+      continue;
+    }
+    // Ring is unusable, take the entry back and write everything with pwrite instead
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+    gbp_out_ring_abandon(ring);
+    break;
+  }
+}
+
+#else
+
+struct gbp_out_ring_s
+{
+  int unused;
+};
+
+static gbp_out_ring_t *gbp_out_ring_create(void)
+{
+  return NULL;
+}
+
+static void gbp_out_ring_free(gbp_out_ring_t *ring)
+{
+  (void) ring;
+}
+
+#endif
+
+bool gbp_out_uringAvailable(void)
+{
+  gbp_out_ring_t *ring = gbp_out_ring_create();
+  gbp_out_ring_free(ring);
+  return ring != NULL;
+}
+
+/*******************************************************************************
+ * Output File
+*******************************************************************************/
+
+void gbp_out_init(gbp_out_t *out, const gbp_out_writer_t writer, const bool progressive)
+{
+  memset(out, 0, sizeof(*out));
+  out->writer = writer;
+  out->progressive = progressive;
+}
+
+bool gbp_out_isopen(const gbp_out_t *out)
+{
+  return (out->f != NULL) || out->fdOpen;
+}
+
+bool gbp_out_open(gbp_out_t *out, const char *filename, const uint64_t dataOffset)
+{
+  if (gbp_out_isopen(out))
+  {
+    gbp_out_close(out);
+  }
+
+  out->ok = true;
+  out->active = out->writer;
+  char partname[GBP_OUT_FILENAME_MAX + sizeof(GBP_OUT_PART_SUFFIX)];
+  if (out->progressive)
+  {
+    // Renamed to the final name on close
+    snprintf(out->filename, sizeof(out->filename), "%s", filename);
+    snprintf(partname, sizeof(partname), "%s" GBP_OUT_PART_SUFFIX, filename);
+    filename = partname;
+  }
+  if (out->active == GBP_OUT_WRITER_STDIO)
+  {
+    out->f = fopen(filename, "wb");
+    if (!out->f)
+      return false;
+    fseek(out->f, (long) dataOffset, SEEK_SET);
+    return true;
+  }
+
+#if GBP_OUT_HAS_URING
+  if (out->ring && out->ring->pwriteOnly)
+  {
+    // The ring failed on an earlier file, later files use pwrite
+    gbp_out_ring_free(out->ring);
+    out->ring = NULL;
+    out->ringUnavailable = true;
+  }
+#endif
+  if ((out->active == GBP_OUT_WRITER_URING) && !out->ring && !out->ringUnavailable)
+  {
+    out->ring = gbp_out_ring_create();
+    out->ringUnavailable = (out->ring == NULL);
+  }
+  if ((out->active == GBP_OUT_WRITER_URING) && !out->ring)
+  {
+    out->active = GBP_OUT_WRITER_PWRITE;
+  }
+  if ((out->active == GBP_OUT_WRITER_PWRITE) && !out->pwriteBuffer)
+  {
+    out->pwriteBuffer = (uint8_t *) malloc(GBP_OUT_BUFFER_SIZE);
+    if (!out->pwriteBuffer)
+      return false;
+  }
+
+  out->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out->fd < 0)
+    return false;
+  out->fdOpen = true;
+  out->offset = dataOffset;
+  out->stage = NULL;
+  out->stageSize = 0;
+#if GBP_OUT_HAS_URING
+  if (out->ring)
+    out->ring->failed = false;
+#endif
+  return true;
+}
+
+static void gbp_out_stageFlush(gbp_out_t *out)
+{
+  if (!out->stage)
+    return;
+#if GBP_OUT_HAS_URING
+  if (out->active == GBP_OUT_WRITER_URING)
+  {
+    gbp_out_ring_submit(out->ring, out->fd, out->stageIndex, (uint32_t) out->stageSize, out->stageOffset);
+  }
+  else
+#endif
+  {
+    out->ok = gbp_out_pwriteAll(out->fd, out->stage, out->stageSize, out->stageOffset) && out->ok;
+  }
+  out->stage = NULL;
+  out->stageSize = 0;
+}
+
+static void gbp_out_stageStart(gbp_out_t *out)
+{
+#if GBP_OUT_HAS_URING
+  if (out->active == GBP_OUT_WRITER_URING)
+  {
+    out->stageIndex = gbp_out_ring_acquire(out->ring);
+    out->stage = &out->ring->buffers[out->stageIndex * GBP_OUT_BUFFER_SIZE];
+  }
+  else
+#endif
+  {
+    out->stage = out->pwriteBuffer;
+  }
+  out->stageSize = 0;
+  out->stageOffset = out->offset;
+}
+
+void gbp_out_append(gbp_out_t *out, const void *bytes, const size_t size)
+{
+  if (out->f)
+  {
+    out->ok = (fwrite(bytes, 1, size, out->f) == size) && out->ok;
+    return;
+  }
+  if (!out->fdOpen)
+    return;
+
+  // Gather strips into whole buffers, each full buffer is one write
+  const uint8_t *src = (const uint8_t *) bytes;
+  size_t remaining = size;
+  while (remaining > 0)
+  {
+    if (!out->stage)
+      gbp_out_stageStart(out);
+    const size_t space = GBP_OUT_BUFFER_SIZE - out->stageSize;
+    const size_t n = (remaining < space) ? remaining : space;
+    memcpy(&out->stage[out->stageSize], src, n);
+    out->stageSize += n;
+    out->offset += n;
+    src += n;
+    remaining -= n;
+    if (out->stageSize == GBP_OUT_BUFFER_SIZE)
+      gbp_out_stageFlush(out);
+  }
+}
+
+void gbp_out_pwrite(gbp_out_t *out, const void *bytes, const size_t size, const uint64_t offset)
+{
+  // Positional write (e.g. the header), appends carry on where they were
+  if (out->f)
+  {
+    const long position = ftell(out->f);
+    fseek(out->f, (long) offset, SEEK_SET);
+    out->ok = (fwrite(bytes, 1, size, out->f) == size) && out->ok;
+    fseek(out->f, position, SEEK_SET);
+    return;
+  }
+  if (!out->fdOpen)
+    return;
+#if GBP_OUT_HAS_URING
+  if (out->active == GBP_OUT_WRITER_URING)
+  {
+    const uint8_t *src = (const uint8_t *) bytes;
+    for (size_t done = 0; done < size; done += GBP_OUT_BUFFER_SIZE)
+    {
+      const size_t n = ((size - done) < GBP_OUT_BUFFER_SIZE) ? (size - done) : GBP_OUT_BUFFER_SIZE;
+      const int i = gbp_out_ring_acquire(out->ring);
+      memcpy(&out->ring->buffers[i * GBP_OUT_BUFFER_SIZE], &src[done], n);
+      gbp_out_ring_submit(out->ring, out->fd, i, (uint32_t) n, offset + done);
+    }
+    return;
+  }
+#endif
+  out->ok = gbp_out_pwriteAll(out->fd, (const uint8_t *) bytes, size, offset) && out->ok;
+}
+
+void gbp_out_publish(gbp_out_t *out, const void *header, const size_t headerSize, const void *tail, const size_t tailSize)
+{
+  // Progressive output, make the rows so far a whole image (See Dev Note in gbp_out.h)
+  if (out->f)
+  {
+    // Each positional write seeks, which flushes what was buffered before it
+    if (tailSize > 0)
+      gbp_out_pwrite(out, tail, tailSize, (uint64_t) ftell(out->f));
+    gbp_out_pwrite(out, header, headerSize, 0);
+    out->ok = (fflush(out->f) == 0) && out->ok;
+    return;
+  }
+  if (!out->fdOpen)
+    return;
+
+  gbp_out_stageFlush(out);
+#if GBP_OUT_HAS_URING
+  if (out->active == GBP_OUT_WRITER_URING)
+  {
+    // The header must not land before the strips it describes
+    while (out->ring->inflight > 0)
+      gbp_out_ring_reap(out->ring, true);
+    out->ok = !out->ring->failed && out->ok;
+  }
+#endif
+  if (tailSize > 0)
+    out->ok = gbp_out_pwriteAll(out->fd, (const uint8_t *) tail, tailSize, out->offset) && out->ok;
+  out->ok = gbp_out_pwriteAll(out->fd, (const uint8_t *) header, headerSize, 0) && out->ok;
+}
+
+static bool gbp_out_rename(gbp_out_t *out)
+{
+  // Progressive output is only given its final name once whole
+  if (!out->progressive)
+    return out->ok;
+  char partname[GBP_OUT_FILENAME_MAX + sizeof(GBP_OUT_PART_SUFFIX)];
+  snprintf(partname, sizeof(partname), "%s" GBP_OUT_PART_SUFFIX, out->filename);
+  out->ok = out->ok && (rename(partname, out->filename) == 0);
+  return out->ok;
+}
+
+bool gbp_out_close(gbp_out_t *out)
+{
+  if (out->f)
+  {
+    out->ok = (fclose(out->f) == 0) && out->ok;
+    out->f = NULL;
+    return gbp_out_rename(out);
+  }
+  if (!out->fdOpen)
+    return false;
+
+  gbp_out_stageFlush(out);
+#if GBP_OUT_HAS_URING
+  if (out->active == GBP_OUT_WRITER_URING)
+  {
+    // Every write of this file must land before its fd is closed
+    while (out->ring->inflight > 0)
+      gbp_out_ring_reap(out->ring, true);
+    out->ok = !out->ring->failed && out->ok;
+  }
+#endif
+  out->ok = (close(out->fd) == 0) && out->ok;
+  out->fdOpen = false;
+  return gbp_out_rename(out);
+}
+
+void gbp_out_free(gbp_out_t *out)
+{
+  if (gbp_out_isopen(out))
+    gbp_out_close(out);
+  gbp_out_ring_free(out->ring);
+  out->ring = NULL;
+  free(out->pwriteBuffer);
+  out->pwriteBuffer = NULL;
+}
@@ -0,0 +1,118 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Image Output File
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on writing image files without stalling the decoder on disk latency
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_OUT_H
+#define GBP_OUT_H
+
+#include <stdio.h>
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+
+/*
+    Dev Note: Image output file
+    Image writers only ever append pixel data after a reserved header, then write the header
+    once the image size is known. So an output file is:
+
+    ```
+    gbp_out_open(&out, "name.bmp", headerSize);  // Appends start after the header
+    gbp_out_append(&out, strip, stripSize);      // Every strip
+    gbp_out_pwrite(&out, header, headerSize, 0); // On render
+    gbp_out_close(&out);
+    ```
+
+    Writers (backends):
+    * stdio  : fwrite() and fseek() (Default)
+    * pwrite : Strips are gathered into a staging buffer, written with pwrite() when full
+    * uring  : Strips are gathered into registered (fixed) buffers and submitted to an io_uring
+               as IORING_OP_WRITE_FIXED at their file offset. The decoder only waits when all
+               buffers are in flight. The header is submitted the same way on close, then all
+               writes are reaped. Falls back to pwrite if io_uring is not available (old kernel,
+               seccomp, no liburing needed as the syscalls are used directly). If io_uring_enter()
+               fails later, or writes complete with -EINVAL (IORING_OP_WRITE before Linux 5.6),
+               pending writes are redone with pwrite and the rest of the file uses pwrite too.
+
+    The ring and its buffers are set up on first use and kept until gbp_out_free(), so each
+    image only costs an open() and a close().
+
+    Progressive output:
+    The file is written as `name.bmp.part` and renamed to `name.bmp` on close, so a finished name
+    only ever holds a whole image. After each strip the writer calls gbp_out_publish() with a
+    header for the rows so far, and a tail if the format needs one after the pixels (png). The strip
+    lands first, then the tail at the append offset (the next strip overwrites it), then the header,
+    so a viewer polling the .part file always finds a complete image of the rows so far.
+*/
+
+#define GBP_OUT_BUFFER_SIZE  (64 * 1024)
+#define GBP_OUT_BUFFERS      8 ///< Writes in flight (uring)
+#define GBP_OUT_FILENAME_MAX 400
+#define GBP_OUT_PART_SUFFIX  ".part" ///< Progressive output file name until closed
+
+typedef enum
+{
+  GBP_OUT_WRITER_STDIO,
+  GBP_OUT_WRITER_PWRITE,
+  GBP_OUT_WRITER_URING
+} gbp_out_writer_t;
+
+typedef struct gbp_out_ring_s gbp_out_ring_t;
+
+typedef struct
+{
+  gbp_out_writer_t writer; ///< Requested writer
+  gbp_out_writer_t active; ///< Writer of the open file (uring falls back to pwrite)
+  bool ok;                 ///< No write failed since open
+  bool progressive;        ///< Write to a .part file, publish every strip, rename on close
+  char filename[GBP_OUT_FILENAME_MAX]; ///< Final name (progressive)
+
+  // stdio
+  FILE *f;
+
+  // pwrite and uring
+  bool fdOpen;
+  int fd;
+  uint64_t offset;         ///< File offset of the next append
+  uint8_t *stage;          ///< Buffer being filled (pwrite: pwriteBuffer, uring: a ring buffer)
+  int stageIndex;          ///< Ring buffer index of stage
+  size_t stageSize;
+  uint64_t stageOffset;    ///< File offset of stage[0]
+  uint8_t *pwriteBuffer;
+  gbp_out_ring_t *ring;    ///< Set up on first uring open
+  bool ringUnavailable;    ///< io_uring setup failed once, do not retry
+} gbp_out_t;
+
+const char *gbp_out_writerName(const gbp_out_writer_t writer);
+bool gbp_out_writerParse(const char *name, gbp_out_writer_t *writer);
+bool gbp_out_uringAvailable(void);
+
+void gbp_out_init(gbp_out_t *out, const gbp_out_writer_t writer, const bool progressive);
+bool gbp_out_isopen(const gbp_out_t *out);
+bool gbp_out_open(gbp_out_t *out, const char *filename, const uint64_t dataOffset);
+void gbp_out_append(gbp_out_t *out, const void *bytes, const size_t size);
+void gbp_out_pwrite(gbp_out_t *out, const void *bytes, const size_t size, const uint64_t offset);
+void gbp_out_publish(gbp_out_t *out, const void *header, const size_t headerSize, const void *tail, const size_t tailSize);
+bool gbp_out_close(gbp_out_t *out);
+void gbp_out_free(gbp_out_t *out);
+
+#endif // GBP_OUT_H
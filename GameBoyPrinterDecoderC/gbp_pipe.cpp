@@ -0,0 +1,441 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Pipelined Decoder
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on overlapping ingest, decode and image writes on separate threads
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+
+#include "gameboy_printer_protocol.h"
+#include "gbp_tiles.h"
+#include "gbp_hex.h"
+#include "gbp_decode.h"
+#include "gbp_pipe.h"
+
+#define GBP_PIPE_CACHE_LINE 64
+#define GBP_PIPE_SPIN_LIMIT 64 ///< Busy polls before blocking
+
+#define GBP_PIPE_ROW_SIZE_B (GBP_TILE_PIXEL_HEIGHT * GBP_TILES_LINE_SIZE_B)
+
+typedef struct
+{
+  bool end;    ///< No more input
+  size_t size;
+  uint8_t bytes[GBP_HEX_OUTPUT_MAX(GBP_PIPE_BYTES_BLOCK_TEXT)];
+} gbp_pipe_bytes_t;
+
+typedef struct
+{
+  bool end;       ///< No more rows
+  bool printEnd;  ///< Last batch of a PRINT
+  bool cutPaper;  ///< PRINT requested a cut (Only on printEnd)
+  uint16_t rowCount;
+  uint8_t rowPallets[GBP_PIPE_ROWS_PER_BATCH];
+  uint8_t rowLines[GBP_PIPE_ROWS_PER_BATCH * GBP_PIPE_ROW_SIZE_B];
+} gbp_pipe_rows_t;
+
+/*******************************************************************************
+ * Lock Free SPSC Queue
+*******************************************************************************/
+
+typedef struct
+{
+  void *slots[32]; ///< Power of two, larger than any buffer pool
+  alignas(GBP_PIPE_CACHE_LINE) size_t head; ///< Consumer position
+  alignas(GBP_PIPE_CACHE_LINE) size_t tail; ///< Producer position
+
+  // Producer side counters
+  alignas(GBP_PIPE_CACHE_LINE) uint64_t pushes;
+  uint64_t depthSum;
+  uint64_t depthMax;
+  // Consumer side counters
+  alignas(GBP_PIPE_CACHE_LINE) uint64_t popStalls;
+
+  // Blocking once spinning gave up (Only touched when the queue stays empty)
+  alignas(GBP_PIPE_CACHE_LINE) int waiting; ///< Consumer is asleep (or about to be) on `wake`
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} gbp_pipe_queue_t;
+
+#define GBP_PIPE_QUEUE_MASK ((sizeof(((gbp_pipe_queue_t *)0)->slots) / sizeof(void *)) - 1)
+
+static void gbp_pipe_queue_init(gbp_pipe_queue_t *q)
+{
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->wake, NULL);
+}
+
+static void gbp_pipe_queue_free(gbp_pipe_queue_t *q)
+{
+  pthread_cond_destroy(&q->wake);
+  pthread_mutex_destroy(&q->lock);
+}
+
+static void gbp_pipe_queue_push(gbp_pipe_queue_t *q, void *item)
+{
+  // Never full: each queue holds at most the buffers of its pool
+  const size_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  const size_t depth = tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+  q->slots[tail & GBP_PIPE_QUEUE_MASK] = item;
+  __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+
+  // Store tail before reading `waiting` (Pairs with the fence in gbp_pipe_queue_pop())
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&q->waiting, __ATOMIC_RELAXED))
+  {
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_signal(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  q->pushes++;
+  q->depthSum += depth;
+  q->depthMax = (depth > q->depthMax) ? depth : q->depthMax;
+}
+
+static void *gbp_pipe_queue_pop(gbp_pipe_queue_t *q)
+{
+  const size_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  unsigned spins = 0;
+  while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+  {
+    if (spins == 0)
+      q->popStalls++;
+    if (++spins <= GBP_PIPE_SPIN_LIMIT)
+      continue;
+
+    // Upstream is slow (e.g. input from a pipe), sleep until the next push
+    pthread_mutex_lock(&q->lock);
+    __atomic_store_n(&q->waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Store `waiting` before reading tail
+    while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+      pthread_cond_wait(&q->wake, &q->lock);
+    __atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->lock);
+  }
+  void *item = q->slots[head & GBP_PIPE_QUEUE_MASK];
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+  return item;
+}
+
+static void gbp_pipe_queue_stats(const gbp_pipe_queue_t *full, const gbp_pipe_queue_t *free, gbp_pipe_queueStats_t *stats)
+{
+  stats->items = full->pushes;
+  stats->depthMax = full->depthMax;
+  stats->depthAvg = full->pushes ? ((double) full->depthSum / full->pushes) : 0;
+  stats->producerStalls = free->popStalls;
+  stats->consumerStalls = full->popStalls;
+}
+
+/*******************************************************************************
+ * Stages
+*******************************************************************************/
+
+typedef struct
+{
+  int fd;
+  const gbp_decode_config_t *config;
+  std::atomic<bool> ok;       ///< Cleared by any stage on failure
+  uint64_t bytesIngested;
+  uint64_t hexNs;
+  gbp_stats_t parseStats;
+
+  gbp_pipe_queue_t bytesFull; ///< ingest --> parse
+  gbp_pipe_queue_t bytesFree; ///< parse --> ingest
+  gbp_pipe_queue_t rowsFull;  ///< parse --> render
+  gbp_pipe_queue_t rowsFree;  ///< render --> parse
+
+  gbp_pipe_rows_t *rows;      ///< Batch being filled by the parse stage
+} gbp_pipe_t;
+
+static void gbp_pipe_ingest_end(gbp_pipe_t *pipe)
+{
+  gbp_pipe_bytes_t *block = (gbp_pipe_bytes_t *) gbp_pipe_queue_pop(&pipe->bytesFree);
+  block->end = true;
+  block->size = 0;
+  gbp_pipe_queue_push(&pipe->bytesFull, block);
+}
+
+static void *gbp_pipe_ingest(void *arg)
+{
+  // Stage 1: Hex text --> byte blocks
+  gbp_pipe_t *pipe = (gbp_pipe_t *) arg;
+  gbp_hex_t hex;
+  gbp_hex_src_t src;
+  const char *chunk = NULL;
+  size_t chunkSize = 0;
+
+  gbp_hex_init(&hex);
+  const bool opened = gbp_hex_src_open(&src, pipe->fd);
+  while (opened && gbp_hex_src_next(&src, &chunk, &chunkSize))
+  {
+    // Source chunks are split so blocks flow downstream early
+    for (size_t offset = 0; offset < chunkSize; offset += GBP_PIPE_BYTES_BLOCK_TEXT)
+    {
+      const size_t textSize = ((chunkSize - offset) < GBP_PIPE_BYTES_BLOCK_TEXT) ? (chunkSize - offset) : GBP_PIPE_BYTES_BLOCK_TEXT;
+      gbp_pipe_bytes_t *block = (gbp_pipe_bytes_t *) gbp_pipe_queue_pop(&pipe->bytesFree);
+      block->end = false;
+      const uint64_t start = pipe->config->stats ? gbp_stats_nowNs() : 0;
+      block->size = gbp_hex_decode(&hex, &chunk[offset], textSize, block->bytes);
+      if (pipe->config->stats)
+        pipe->hexNs += gbp_stats_nowNs() - start;
+      pipe->bytesIngested += block->size;
+      gbp_pipe_queue_push(&pipe->bytesFull, block);
+    }
+  }
+  if (opened)
+    gbp_hex_src_close(&src);
+  else
+    pipe->ok = false;
+
+  gbp_pipe_ingest_end(pipe);
+  return NULL;
+}
+
+static void gbp_pipe_rows_send(gbp_pipe_t *pipe, const bool printEnd, const bool cutPaper)
+{
+  gbp_pipe_rows_t *rows = pipe->rows;
+  rows->printEnd = printEnd;
+  rows->cutPaper = cutPaper;
+  gbp_pipe_queue_push(&pipe->rowsFull, rows);
+
+  pipe->rows = (gbp_pipe_rows_t *) gbp_pipe_queue_pop(&pipe->rowsFree);
+  pipe->rows->end = false;
+  pipe->rows->rowCount = 0;
+}
+
+static void gbp_pipe_gotPrint(void *user, gbp_tile_t *tiles, const bool cutPaper)
+{
+  // Stage 2 (print): Printed tile rows --> row batches
+  gbp_pipe_t *pipe = (gbp_pipe_t *) user;
+  for (int j = 0; j < tiles->tileRowOffset; j++)
+  {
+    const uint8_t *rowLines = gbp_tiles_rowLines(tiles, j);
+    if (!rowLines)
+      break; // Rows beyond here were dropped
+    gbp_pipe_rows_t *rows = pipe->rows;
+    memcpy(&rows->rowLines[rows->rowCount * GBP_PIPE_ROW_SIZE_B], rowLines, GBP_PIPE_ROW_SIZE_B);
+    rows->rowPallets[rows->rowCount] = gbp_tiles_rowPallet(tiles, j);
+    rows->rowCount++;
+    if (rows->rowCount == GBP_PIPE_ROWS_PER_BATCH)
+    {
+      gbp_pipe_rows_send(pipe, false, false);
+    }
+  }
+  // Always sent, even if empty (A print opens the image)
+  gbp_pipe_rows_send(pipe, true, cutPaper);
+}
+
+static void *gbp_pipe_parse(void *arg)
+{
+  // Stage 2: Byte blocks --> packets, decompression and tile decoding
+  gbp_pipe_t *pipe = (gbp_pipe_t *) arg;
+  gbp_decode_config_t config = *pipe->config;
+  config.output = GBP_DECODE_OUTPUT_NONE;
+  config.sinkCount = 0;
+  config.user = pipe;
+  config.onPacket = NULL;
+  config.onPrint = gbp_pipe_gotPrint;
+
+  gbp_decode_t *session = gbp_decode_create(&config);
+  pipe->rows = (gbp_pipe_rows_t *) gbp_pipe_queue_pop(&pipe->rowsFree);
+  pipe->rows->end = false;
+  pipe->rows->rowCount = 0;
+
+  while (true)
+  {
+    gbp_pipe_bytes_t *block = (gbp_pipe_bytes_t *) gbp_pipe_queue_pop(&pipe->bytesFull);
+    const bool end = block->end;
+    if (session)
+      gbp_decode_feed(session, block->bytes, block->size);
+    gbp_pipe_queue_push(&pipe->bytesFree, block);
+    if (end)
+      break;
+  }
+  if (session)
+  {
+    if (gbp_decode_stats(session))
+      pipe->parseStats = *gbp_decode_stats(session);
+    gbp_decode_destroy(session);
+  }
+  else
+  {
+    pipe->ok = false;
+  }
+
+  // Rows of the open batch are never sent without a print, so it only marks the end
+  pipe->rows->end = true;
+  pipe->rows->rowCount = 0;
+  gbp_pipe_queue_push(&pipe->rowsFull, pipe->rows);
+  pipe->rows = NULL;
+  return NULL;
+}
+
+static uint64_t gbp_pipe_render(gbp_pipe_t *pipe, gbp_stats_t *stats)
+{
+  // Stage 3: Row batches --> palette conversion and image writes
+  gbp_decode_t *session = gbp_decode_create(pipe->config);
+  while (true)
+  {
+    gbp_pipe_rows_t *rows = (gbp_pipe_rows_t *) gbp_pipe_queue_pop(&pipe->rowsFull);
+    const bool end = rows->end;
+    if (!end && session)
+      gbp_decode_writeRows(session, rows->rowLines, rows->rowPallets, rows->rowCount, rows->printEnd && rows->cutPaper);
+    gbp_pipe_queue_push(&pipe->rowsFree, rows);
+    if (end)
+      break;
+  }
+  if (!session)
+  {
+    pipe->ok = false;
+    return 0;
+  }
+  gbp_decode_flush(session);
+  const uint64_t images = gbp_decode_imageCount(session);
+  if (gbp_decode_stats(session))
+    gbp_stats_merge(stats, gbp_decode_stats(session));
+  gbp_decode_destroy(session);
+  return images;
+}
+
+static uint64_t gbp_pipe_serial(gbp_pipe_t *pipe, gbp_stats_t *stats)
+{
+  // Fallback when the stage threads cannot be started: all stages in turn on the calling thread
+  gbp_decode_t *session = gbp_decode_create(pipe->config);
+  uint8_t *bytes = (uint8_t *) malloc(GBP_HEX_OUTPUT_MAX(GBP_PIPE_BYTES_BLOCK_TEXT));
+  gbp_hex_t hex;
+  gbp_hex_src_t src;
+  const char *chunk = NULL;
+  size_t chunkSize = 0;
+
+  gbp_hex_init(&hex);
+  const bool opened = session && bytes && gbp_hex_src_open(&src, pipe->fd);
+  while (opened && gbp_hex_src_next(&src, &chunk, &chunkSize))
+  {
+    for (size_t offset = 0; offset < chunkSize; offset += GBP_PIPE_BYTES_BLOCK_TEXT)
+    {
+      const size_t textSize = ((chunkSize - offset) < GBP_PIPE_BYTES_BLOCK_TEXT) ? (chunkSize - offset) : GBP_PIPE_BYTES_BLOCK_TEXT;
+      const uint64_t start = pipe->config->stats ? gbp_stats_nowNs() : 0;
+      const size_t size = gbp_hex_decode(&hex, &chunk[offset], textSize, bytes);
+      if (pipe->config->stats)
+        pipe->hexNs += gbp_stats_nowNs() - start;
+      pipe->bytesIngested += size;
+      gbp_decode_feed(session, bytes, size);
+    }
+  }
+  free(bytes);
+  if (!opened)
+  {
+    if (session)
+      gbp_decode_destroy(session);
+    pipe->ok = false;
+    return 0;
+  }
+  gbp_hex_src_close(&src);
+  gbp_decode_flush(session);
+  const uint64_t images = gbp_decode_imageCount(session);
+  if (gbp_decode_stats(session))
+    gbp_stats_merge(stats, gbp_decode_stats(session));
+  gbp_decode_destroy(session);
+  return images;
+}
+
+/*******************************************************************************
+ * Pipeline
+*******************************************************************************/
+
+static double gbp_pipe_time_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool gbp_pipe_run(int fd, const gbp_decode_config_t *config, gbp_pipe_stats_t *stats)
+{
+  gbp_pipe_t *pipe = new gbp_pipe_t();
+  gbp_pipe_bytes_t *blocks = (gbp_pipe_bytes_t *) calloc(GBP_PIPE_BYTES_BLOCKS, sizeof(gbp_pipe_bytes_t));
+  gbp_pipe_rows_t *batches = (gbp_pipe_rows_t *) calloc(GBP_PIPE_ROWS_BATCHES, sizeof(gbp_pipe_rows_t));
+  pthread_t ingestThread;
+  pthread_t parseThread;
+  const bool ok = (blocks && batches);
+
+  memset(stats, 0, sizeof(*stats));
+  gbp_pipe_queue_init(&pipe->bytesFull);
+  gbp_pipe_queue_init(&pipe->bytesFree);
+  gbp_pipe_queue_init(&pipe->rowsFull);
+  gbp_pipe_queue_init(&pipe->rowsFree);
+  pipe->fd = fd;
+  pipe->config = config;
+  pipe->ok = true;
+
+  // Every buffer starts out free
+  for (int i = 0; ok && (i < GBP_PIPE_BYTES_BLOCKS); i++)
+    gbp_pipe_queue_push(&pipe->bytesFree, &blocks[i]);
+  for (int i = 0; ok && (i < GBP_PIPE_ROWS_BATCHES); i++)
+    gbp_pipe_queue_push(&pipe->rowsFree, &batches[i]);
+  pipe->bytesFree.pushes = pipe->bytesFree.depthSum = pipe->bytesFree.depthMax = 0;
+  pipe->rowsFree.pushes = pipe->rowsFree.depthSum = pipe->rowsFree.depthMax = 0;
+
+  const double start = gbp_pipe_time_sec();
+  // Parse starts first, so if ingest cannot start nothing has read the input yet
+  bool threaded = ok && (pthread_create(&parseThread, NULL, gbp_pipe_parse, pipe) == 0);
+  if (threaded && (pthread_create(&ingestThread, NULL, gbp_pipe_ingest, pipe) != 0))
+  {
+    // Stand in for ingest with an empty input so parse ends (Its rows batch is never rendered)
+    gbp_pipe_ingest_end(pipe);
+    pthread_join(parseThread, NULL);
+    threaded = false;
+  }
+  if (threaded)
+  {
+    stats->images = gbp_pipe_render(pipe, &stats->decode);
+    pthread_join(ingestThread, NULL);
+    pthread_join(parseThread, NULL);
+  }
+  else
+  {
+    stats->images = gbp_pipe_serial(pipe, &stats->decode);
+  }
+  stats->seconds = gbp_pipe_time_sec() - start;
+
+  stats->bytesIngested = pipe->bytesIngested;
+  gbp_stats_merge(&stats->decode, &pipe->parseStats);
+  stats->decode.stageNs[GBP_STATS_STAGE_HEX_PARSE] += pipe->hexNs;
+  gbp_pipe_queue_stats(&pipe->bytesFull, &pipe->bytesFree, &stats->bytes);
+  gbp_pipe_queue_stats(&pipe->rowsFull, &pipe->rowsFree, &stats->rows);
+  const bool pipeOk = pipe->ok;
+
+  gbp_pipe_queue_free(&pipe->bytesFull);
+  gbp_pipe_queue_free(&pipe->bytesFree);
+  gbp_pipe_queue_free(&pipe->rowsFull);
+  gbp_pipe_queue_free(&pipe->rowsFree);
+  free(blocks);
+  free(batches);
+  delete pipe;
+  return pipeOk;
+}
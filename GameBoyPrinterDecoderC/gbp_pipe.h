@@ -0,0 +1,80 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Pipelined Decoder
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on overlapping ingest, decode and image writes on separate threads
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_PIPE_H
+#define GBP_PIPE_H
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include "gbp_decode.h"
+
+/*
+    Dev Note: Pipeline
+    ```
+    [ingest]  hex text --> byte blocks ---(bytes queue)---> [parse]  packets, RLE, tiles --> row batches
+                   ^----------- free blocks ------------'          |
+                                                                   '---(rows queue)---> [render] palette, fwrite
+                                                 ^------------ free batches -------------'
+    ```
+    * ingest and parse run on their own threads, render runs on the calling thread.
+      If the threads cannot be started, all three stages run in turn on the calling thread instead.
+    * Each queue is a bounded lock free single producer single consumer ring. Buffers are
+      recycled through a second ring going the other way, so memory use is fixed.
+      A pop on an empty ring spins briefly, then sleeps on a condition variable that a push only
+      signals while the consumer is waiting, so idle stages (e.g. slow pipe input) use no CPU.
+    * A PRINT sends its rows as one or more batches, the last one carries the cut.
+      The render stage feeds them to gbp_decode_writeRows(), so images match a serial decode.
+
+    Stall counters: A producer stall is a wait for a free buffer (downstream is behind),
+    a consumer stall is a wait on an empty queue (upstream is behind).
+*/
+
+#define GBP_PIPE_BYTES_BLOCK_TEXT 	(64 * 1024) ///< Hex text decoded per byte block
+#define GBP_PIPE_BYTES_BLOCKS     	8
+#define GBP_PIPE_ROWS_PER_BATCH   	32
+#define GBP_PIPE_ROWS_BATCHES     	16
+
+typedef struct
+{
+  uint64_t items;          ///< Buffers passed downstream
+  uint64_t depthMax;       ///< Deepest the queue was seen on push
+  double depthAvg;         ///< Average depth seen on push
+  uint64_t producerStalls; ///< Waits for a free buffer
+  uint64_t consumerStalls; ///< Waits for an item
+} gbp_pipe_queueStats_t;
+
+typedef struct
+{
+  gbp_pipe_queueStats_t bytes; ///< ingest --> parse
+  gbp_pipe_queueStats_t rows;  ///< parse --> render
+  uint64_t bytesIngested;
+  uint64_t images;
+  double seconds;
+  gbp_stats_t decode; ///< Parse and render sessions combined (If config->stats)
+} gbp_pipe_stats_t;
+
+bool gbp_pipe_run(int fd, const gbp_decode_config_t *config, gbp_pipe_stats_t *stats);
+
+#endif // GBP_PIPE_H
@@ -22,12 +22,16 @@
  *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#ifndef GBP_PKT_H
+#define GBP_PKT_H
+
 #include <stdint.h> // uint8_t
 #include <stddef.h> // size_t
 #include <stdbool.h> // bool
 #include "gameboy_printer_protocol.h"
 
 #define GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE GBP_TILE_SIZE_IN_BYTE
+#define GBP_PKT_PAYLOAD_BUFF_SIZE_WHOLE_PACKET (0xFFFF + 1) ///< Larger than any 16bit dataLength, so payload is never streamed
 
 typedef enum
 {
@@ -50,6 +54,11 @@ typedef struct
   uint8_t printerID;
   uint8_t status;
 
+  /* Checksum (Sum of command, compression, length and payload bytes) */
+  uint16_t checksum;     ///< As received
+  uint16_t checksumCalc; ///< Running sum
+  bool checksumOk;       ///< Valid once the whole packet is received
+
   /* Decompressor */
   size_t buffIndex;
   bool compressedRun;
@@ -69,35 +78,39 @@ typedef struct
 
 bool gbp_pkt_init(gbp_pkt_t *_pkt);
 bool gbp_pkt_reset(gbp_pkt_t *_pkt);
-bool gbp_pkt_processByte(gbp_pkt_t *_pkt,  const uint8_t _byte, uint8_t buffer[], uint8_t *bufferSize, const size_t bufferMax);
+bool gbp_pkt_processByte(gbp_pkt_t *_pkt,  const uint8_t _byte, uint8_t buffer[], uint16_t *bufferSize, const size_t bufferMax);
+size_t gbp_pkt_processBytes(gbp_pkt_t *_pkt, const uint8_t bytes[], const size_t bytesSize, uint8_t buffer[], uint16_t *bufferSize, const size_t bufferMax, const uint8_t **payload);
 bool gbp_pkt_decompressor(gbp_pkt_t *_pkt, const uint8_t buff[], const size_t buffSize, gbp_pkt_tileAcc_t *tileBuff);
 bool gbp_pkt_tileAccu_tileReadyCheck(gbp_pkt_tileAcc_t *tileBuff);
+size_t gbp_pkt_tileDirect(gbp_pkt_t *_pkt, const uint8_t buff[], const size_t buffSize, gbp_pkt_tileAcc_t *tileBuff, const uint8_t **tiles);
 
 /*******************************************************************************
  * Print Instruction
 *******************************************************************************/
 
-static inline int gbp_pkt_printInstruction_num_of_sheets(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_num_of_sheets(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_SHEETS  ]);
 }
 
-static inline int gbp_pkt_printInstruction_num_of_linefeed_before_print(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_num_of_linefeed_before_print(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED] >> 4) & 0x0F;
 }
 
-static inline int gbp_pkt_printInstruction_num_of_linefeed_after_print(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_num_of_linefeed_after_print(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED]) & 0x0F;
 }
 
-static inline int gbp_pkt_printInstruction_palette_value(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_palette_value(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_PALETTE_VALUE  ]);
 }
 
-static inline int gbp_pkt_printInstruction_print_density(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_print_density(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_PRINT_DENSITY  ]);
 }
+
+#endif // GBP_PKT_H
@@ -0,0 +1,414 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Indexed PNG Writer
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on streaming decoded tile rows into a 2bit indexed png
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "gbp_tiles.h"
+#include "gbp_png.h"
+#include "gbp_trace.h"
+
+#define GBP_PNG_SIGNATURE_SIZE 8
+#define GBP_PNG_IHDR_SIZE      (4 + 4 + 13 + 4)
+#define GBP_PNG_PLTE_SIZE      (4 + 4 + (3 * GBP_PNG_COLORS) + 4)
+#define GBP_PNG_IDAT_START     (GBP_PNG_SIGNATURE_SIZE + GBP_PNG_IHDR_SIZE + GBP_PNG_PLTE_SIZE + 4 + 4)
+#define GBP_PNG_IEND_SIZE      12
+#define GBP_PNG_TAIL_MAX       (3 + 4 + 4 + GBP_PNG_IEND_SIZE) ///< Final block bits, adler32, IDAT crc, IEND
+
+#define GBP_PNG_MATCH_MIN 3
+#define GBP_PNG_MATCH_MAX 258
+
+/*******************************************************************************
+  Checksums
+*******************************************************************************/
+
+typedef struct
+{
+    uint32_t table[256];
+} gbp_png_crcTable_t;
+
+static gbp_png_crcTable_t gbp_png_crcTable_build(void)
+{
+    gbp_png_crcTable_t crcTable;
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        crcTable.table[n] = c;
+    }
+    return crcTable;
+}
+
+static uint32_t gbp_png_crc(uint32_t crc, const uint8_t *buff, const size_t size)
+{
+    // CRC-32 (ISO 3309) as used by png chunks. Start with 0xFFFFFFFF and invert the result
+    static const gbp_png_crcTable_t crcTable = gbp_png_crcTable_build(); // Built once (Thread safe)
+    for (size_t i = 0; i < size; i++)
+        crc = crcTable.table[(crc ^ buff[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static uint32_t gbp_png_adler32(uint32_t adler, const uint8_t *buff, const size_t size)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    for (size_t i = 0; i < size; i++)
+    {
+        a = (a + buff[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void gbp_png_put32(uint8_t *buff, const uint32_t value)
+{
+    // Big endian
+    buff[0] = (uint8_t)(value >> 24);
+    buff[1] = (uint8_t)(value >> 16);
+    buff[2] = (uint8_t)(value >>  8);
+    buff[3] = (uint8_t)(value >>  0);
+}
+
+/*******************************************************************************
+  IDAT Output
+*******************************************************************************/
+
+static void gbp_png_flush(gbp_png_t * gbp_png)
+{
+    gbp_png->crc = gbp_png_crc(gbp_png->crc, gbp_png->outBuff, gbp_png->outBuffSize);
+    gbp_out_append(&gbp_png->out, gbp_png->outBuff, gbp_png->outBuffSize);
+    gbp_png->idatSize += gbp_png->outBuffSize;
+    gbp_png->outBuffSize = 0;
+}
+
+static inline void gbp_png_putByte(gbp_png_t * gbp_png, const uint8_t byte)
+{
+    gbp_png->outBuff[gbp_png->outBuffSize++] = byte;
+    if (gbp_png->outBuffSize >= GBP_PNG_OUT_BUFF_SIZE)
+        gbp_png_flush(gbp_png);
+}
+
+static inline void gbp_png_putBits(gbp_png_t * gbp_png, const uint32_t value, const uint8_t bitCount)
+{
+    // Deflate packs bits starting from the least significant bit
+    gbp_png->bitBuff |= value << gbp_png->bitCount;
+    gbp_png->bitCount += bitCount;
+    while (gbp_png->bitCount >= 8)
+    {
+        gbp_png_putByte(gbp_png, (uint8_t)gbp_png->bitBuff);
+        gbp_png->bitBuff >>= 8;
+        gbp_png->bitCount -= 8;
+    }
+}
+
+/*******************************************************************************
+  Deflate (Fixed Huffman Codes)
+*******************************************************************************/
+
+static const uint16_t gbp_png_lengthBase[29]  = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const uint8_t  gbp_png_lengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const uint16_t gbp_png_distBase[30]    = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const uint8_t  gbp_png_distExtra[30]   = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+static inline void gbp_png_putCode(gbp_png_t * gbp_png, const uint16_t code, const uint8_t bitCount)
+{
+    // Huffman codes are packed starting from the most significant bit
+    uint16_t reversed = 0;
+    for (int i = 0; i < bitCount; i++)
+        reversed |= ((code >> i) & 1) << (bitCount - 1 - i);
+    gbp_png_putBits(gbp_png, reversed, bitCount);
+}
+
+static void gbp_png_putSymbol(gbp_png_t * gbp_png, const uint16_t symbol)
+{
+    if (symbol < 144)
+        gbp_png_putCode(gbp_png, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        gbp_png_putCode(gbp_png, 0x190 + (symbol - 144), 9);
+    else if (symbol < 280)
+        gbp_png_putCode(gbp_png, symbol - 256, 7);
+    else
+        gbp_png_putCode(gbp_png, 0xC0 + (symbol - 280), 8);
+}
+
+static void gbp_png_putMatch(gbp_png_t * gbp_png, const uint16_t length, const uint16_t distance)
+{
+    int l = 28;
+    while (gbp_png_lengthBase[l] > length)
+        l--;
+    gbp_png_putSymbol(gbp_png, 257 + l);
+    gbp_png_putBits(gbp_png, length - gbp_png_lengthBase[l], gbp_png_lengthExtra[l]);
+
+    int d = 29;
+    while (gbp_png_distBase[d] > distance)
+        d--;
+    gbp_png_putCode(gbp_png, d, 5);
+    gbp_png_putBits(gbp_png, distance - gbp_png_distBase[d], gbp_png_distExtra[d]);
+}
+
+static inline uint32_t gbp_png_hash(const uint8_t *p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - GBP_PNG_HASH_BITS);
+}
+
+static void gbp_png_deflate(gbp_png_t * gbp_png, const uint8_t *data, const uint32_t size)
+{
+    // Append to window (Keeping the previous 32KiB for matches) then encode
+    if ((gbp_png->windowSize + size) > sizeof(gbp_png->window))
+    {
+        const uint32_t shift = gbp_png->windowSize - GBP_PNG_WINDOW_SIZE;
+        memmove(gbp_png->window, &gbp_png->window[shift], GBP_PNG_WINDOW_SIZE);
+        gbp_png->windowSize = GBP_PNG_WINDOW_SIZE;
+        for (int i = 0; i < (1 << GBP_PNG_HASH_BITS); i++)
+            gbp_png->hashHead[i] = (gbp_png->hashHead[i] >= (int32_t)shift) ? (gbp_png->hashHead[i] - shift) : -1;
+    }
+    memcpy(&gbp_png->window[gbp_png->windowSize], data, size);
+    gbp_png->adler32 = gbp_png_adler32(gbp_png->adler32, data, size);
+
+    const uint8_t *window = gbp_png->window;
+    const uint32_t end = gbp_png->windowSize + size;
+    uint32_t i = gbp_png->windowSize;
+    while (i < end)
+    {
+        uint32_t matchLength = 0;
+        uint32_t matchDistance = 0;
+        if ((end - i) >= GBP_PNG_MATCH_MIN)
+        {
+            const uint32_t h = gbp_png_hash(&window[i]);
+            const int32_t candidate = gbp_png->hashHead[h];
+            gbp_png->hashHead[h] = i;
+            if ((candidate >= 0) && ((i - candidate) <= GBP_PNG_WINDOW_SIZE))
+            {
+                const uint32_t maxLength = ((end - i) < GBP_PNG_MATCH_MAX) ? (end - i) : GBP_PNG_MATCH_MAX;
+                while ((matchLength < maxLength) && (window[candidate + matchLength] == window[i + matchLength]))
+                    matchLength++;
+                matchDistance = i - candidate;
+            }
+        }
+
+        if (matchLength >= GBP_PNG_MATCH_MIN)
+        {
+            gbp_png_putMatch(gbp_png, matchLength, matchDistance);
+            for (uint32_t k = 1; (k < matchLength) && ((i + k + GBP_PNG_MATCH_MIN) <= end); k++)
+                gbp_png->hashHead[gbp_png_hash(&window[i + k])] = i + k;
+            i += matchLength;
+        }
+        else
+        {
+            gbp_png_putSymbol(gbp_png, window[i]);
+            i++;
+        }
+    }
+    gbp_png->windowSize = end;
+}
+
+/*******************************************************************************
+  PNG Writer
+*******************************************************************************/
+
+static void gbp_png_publish(gbp_png_t * gbp_png);
+
+bool gbp_png_isopen(gbp_png_t * gbp_png)
+{
+    return gbp_out_isopen(&gbp_png->out);
+}
+
+void gbp_png_open(gbp_png_t * gbp_png, const char *outputFilename, const uint16_t fixed_width_size)
+{
+    // Open file
+    char filenameBuff[400] = {0};
+    snprintf(filenameBuff, sizeof(filenameBuff), "%s%X.png", outputFilename, gbp_png->fileCounter);
+
+    // Skip over png header (Signature, IHDR, PLTE, IDAT length and type)...
+    gbp_out_open(&gbp_png->out, filenameBuff, GBP_PNG_IDAT_START);
+
+    // Deflate State
+    gbp_png->windowSize = 0;
+    for (int i = 0; i < (1 << GBP_PNG_HASH_BITS); i++)
+        gbp_png->hashHead[i] = -1;
+    gbp_png->bitBuff = 0;
+    gbp_png->bitCount = 0;
+    gbp_png->adler32 = 1;
+
+    // IDAT chunk crc covers the chunk type
+    gbp_png->crc = gbp_png_crc(0xFFFFFFFFu, (const uint8_t *)"IDAT", 4);
+    gbp_png->idatSize = 0;
+    gbp_png->outBuffSize = 0;
+    gbp_png_putByte(gbp_png, 0x78); // zlib CMF (deflate, 32KiB window)
+    gbp_png_putByte(gbp_png, 0x01); // zlib FLG (No dictionary, fastest)
+
+    // Update
+    gbp_png->pngSizeWidth  = fixed_width_size;
+    gbp_png->pngSizeHeight = 0;
+    gbp_png->fileCounter++;
+}
+
+void gbp_png_add(gbp_png_t * gbp_png, const uint8_t * bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint8_t pallet, const uint32_t palletColor[4])
+{
+    // Fixed width
+    if (sizex != gbp_png->pngSizeWidth)
+        return;
+
+    // Packed pixels are least significant bits first, png is most significant bits first
+    if (!gbp_png->indexLUTValid || (gbp_png->indexLUTPallet != pallet))
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            uint8_t index = 0;
+            for (int i = 0; i < GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT; i++)
+                index |= GBP_TILES_PALLET_TONE(pallet, b >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(i)) << (6 - 2 * i);
+            gbp_png->indexLUT[b] = index;
+        }
+        gbp_png->indexLUTValid  = true;
+        gbp_png->indexLUTPallet = pallet;
+    }
+    memcpy(gbp_png->palletColor, palletColor, sizeof(gbp_png->palletColor));
+
+    // One deflate block per call
+    const int packedWidth = (sizex + GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT - 1) / GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT;
+    const int packedStride = GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(sizex);
+    uint8_t scanline[GBP_PNG_WINDOW_SIZE];
+    if ((1 + packedWidth) > (int)sizeof(scanline))
+        return;
+
+    gbp_png_putBits(gbp_png, 0, 1); // BFINAL
+    gbp_png_putBits(gbp_png, 1, 2); // BTYPE (Fixed Huffman)
+    for (uint16_t y = 0; y < sizey; y++)
+    {
+        const uint8_t *src = &bmpLineBuffer[y * packedStride];
+        scanline[0] = 0; // Filter: None
+        for (int x = 0; x < packedWidth; x++)
+            scanline[1 + x] = gbp_png->indexLUT[src[x]];
+        gbp_png_deflate(gbp_png, scanline, 1 + packedWidth);
+    }
+    gbp_png_putSymbol(gbp_png, 256); // End of block
+
+    gbp_png->pngSizeHeight += sizey;
+    gbp_png_publish(gbp_png);
+}
+
+static void gbp_png_finish(gbp_png_t * gbp_png)
+{
+    // Close deflate stream with an empty final block, then the zlib adler32
+    uint8_t buff[4];
+    gbp_png_putBits(gbp_png, 1, 1); // BFINAL
+    gbp_png_putBits(gbp_png, 1, 2); // BTYPE (Fixed Huffman)
+    gbp_png_putSymbol(gbp_png, 256);
+    if (gbp_png->bitCount > 0)
+        gbp_png_putBits(gbp_png, 0, 8 - gbp_png->bitCount);
+    gbp_png_put32(buff, gbp_png->adler32);
+    for (int i = 0; i < 4; i++)
+        gbp_png_putByte(gbp_png, buff[i]);
+}
+
+static void gbp_png_header(gbp_png_t * gbp_png, uint8_t buff[GBP_PNG_IDAT_START], const uint32_t idatSize)
+{
+    // Signature, IHDR and PLTE for the rows so far, then the IDAT length and type
+    static const uint8_t signature[GBP_PNG_SIGNATURE_SIZE] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t *p = buff;
+    memcpy(p, signature, sizeof(signature));
+    p += sizeof(signature);
+
+    gbp_png_put32(&p[0], 13);
+    memcpy(&p[4], "IHDR", 4);
+    gbp_png_put32(&p[8], gbp_png->pngSizeWidth);
+    gbp_png_put32(&p[12], gbp_png->pngSizeHeight);
+    p[16] = GBP_PNG_BIT_DEPTH;
+    p[17] = 3; // Color type: Indexed
+    p[18] = 0; // Compression: Deflate
+    p[19] = 0; // Filter: Adaptive
+    p[20] = 0; // Interlace: None
+    gbp_png_put32(&p[21], gbp_png_crc(0xFFFFFFFFu, &p[4], 4 + 13) ^ 0xFFFFFFFFu);
+    p += GBP_PNG_IHDR_SIZE;
+
+    gbp_png_put32(&p[0], 3 * GBP_PNG_COLORS);
+    memcpy(&p[4], "PLTE", 4);
+    for (int i = 0; i < GBP_PNG_COLORS; i++)
+    {
+        p[8 + i * 3 + 0] = (uint8_t)(gbp_png->palletColor[i] >> 16);
+        p[8 + i * 3 + 1] = (uint8_t)(gbp_png->palletColor[i] >>  8);
+        p[8 + i * 3 + 2] = (uint8_t)(gbp_png->palletColor[i] >>  0);
+    }
+    gbp_png_put32(&p[8 + 3 * GBP_PNG_COLORS], gbp_png_crc(0xFFFFFFFFu, &p[4], 4 + 3 * GBP_PNG_COLORS) ^ 0xFFFFFFFFu);
+    p += GBP_PNG_PLTE_SIZE;
+
+    gbp_png_put32(&p[0], idatSize);
+    memcpy(&p[4], "IDAT", 4);
+}
+
+static const uint8_t gbp_png_iend[GBP_PNG_IEND_SIZE] = {0x00, 0x00, 0x00, 0x00, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+
+static void gbp_png_publish(gbp_png_t * gbp_png)
+{
+    // Progressive output, every strip leaves a valid png of the rows so far (See Dev Note in gbp_png.h)
+    if (!gbp_png->out.progressive || !gbp_png_isopen(gbp_png))
+        return;
+    gbp_png_flush(gbp_png);
+
+    // Tail: finish the stream on a copy of the bit state, then IDAT crc and IEND
+    const uint32_t bitBuff = gbp_png->bitBuff;
+    const uint8_t bitCount = gbp_png->bitCount;
+    gbp_png_finish(gbp_png);
+    uint8_t tail[GBP_PNG_TAIL_MAX];
+    const uint16_t streamEnd = gbp_png->outBuffSize;
+    memcpy(tail, gbp_png->outBuff, streamEnd);
+    gbp_png_put32(&tail[streamEnd], gbp_png_crc(gbp_png->crc, tail, streamEnd) ^ 0xFFFFFFFFu);
+    memcpy(&tail[streamEnd + 4], gbp_png_iend, sizeof(gbp_png_iend));
+    gbp_png->outBuffSize = 0;
+    gbp_png->bitBuff = bitBuff;
+    gbp_png->bitCount = bitCount;
+
+    uint8_t header[GBP_PNG_IDAT_START];
+    gbp_png_header(gbp_png, header, gbp_png->idatSize + streamEnd);
+    gbp_out_publish(&gbp_png->out, header, sizeof(header), tail, streamEnd + 4 + sizeof(gbp_png_iend));
+}
+
+void gbp_png_render(gbp_png_t * gbp_png)
+{
+    uint8_t buff[GBP_PNG_IDAT_START];
+
+    gbp_png_finish(gbp_png);
+    gbp_png_flush(gbp_png);
+
+    // IDAT crc and IEND
+    gbp_png_put32(buff, gbp_png->crc ^ 0xFFFFFFFFu);
+    gbp_out_append(&gbp_png->out, buff, 4);
+    gbp_out_append(&gbp_png->out, gbp_png_iend, sizeof(gbp_png_iend));
+
+    // Write header with the now known image size and colors
+    gbp_png_header(gbp_png, buff, gbp_png->idatSize);
+    gbp_out_pwrite(&gbp_png->out, buff, sizeof(buff), 0);
+
+    // Close File
+    gbp_out_close(&gbp_png->out);
+    GBP_TRACE(image_close, gbp_png->pngSizeWidth, gbp_png->pngSizeHeight);
+}
+
+void gbp_png_free(gbp_png_t * gbp_png)
+{
+    gbp_out_free(&gbp_png->out);
+}
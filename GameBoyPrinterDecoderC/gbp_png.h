@@ -0,0 +1,89 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Indexed PNG Writer
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on streaming decoded tile rows into a 2bit indexed png
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "gbp_out.h"
+
+/*
+    Dev Note: Streaming PNG layout
+    The image height (IHDR) and colors (PLTE) are only known once the image is done, so like
+    the bmp writer, their space is reserved on open and they are written on render.
+    All image data goes into a single IDAT chunk whose length is also patched on render.
+
+    ```
+    [Signature 8][IHDR 25][PLTE 24][IDAT len+type 8][zlib stream ...][IDAT crc 4][IEND 12]
+    ```
+
+    The zlib stream is a self contained deflate encoder (Fixed huffman codes with a single
+    probe LZ77 hash match). Each gbp_png_add() call is one deflate block, matches can
+    reach back into earlier blocks.
+
+    Progressive output (See gbp_out.h) publishes after each block: the header for the rows so
+    far, and a tail that ends the image there (an empty final block from a copy of the bit state,
+    adler32, IDAT crc and IEND). The next block is appended over the tail, so the finished file is
+    the same bytes as a normal one.
+*/
+
+#define GBP_PNG_BIT_DEPTH 2
+#define GBP_PNG_COLORS    4
+
+#define GBP_PNG_WINDOW_SIZE   (32 * 1024) ///< Deflate max distance
+#define GBP_PNG_HASH_BITS     12
+#define GBP_PNG_OUT_BUFF_SIZE (8 * 1024)
+
+typedef struct
+{
+    gbp_out_t out;
+    int fileCounter;
+    uint16_t pngSizeWidth;  // x
+    uint32_t pngSizeHeight; // y
+
+    // Packed 2bit byte to png index byte (Print palette applied, MSB first pixel order)
+    bool indexLUTValid;
+    uint8_t indexLUTPallet;
+    uint8_t indexLUT[256];
+    uint32_t palletColor[GBP_PNG_COLORS];
+
+    // Deflate
+    uint8_t window[2 * GBP_PNG_WINDOW_SIZE]; ///< Previous 32KiB and incoming data
+    uint32_t windowSize;
+    int32_t hashHead[1 << GBP_PNG_HASH_BITS]; ///< Last window position of each 3 byte hash
+    uint32_t bitBuff;
+    uint8_t bitCount;
+    uint32_t adler32;
+
+    // Output (IDAT)
+    uint32_t crc;
+    uint32_t idatSize;
+    uint8_t outBuff[GBP_PNG_OUT_BUFF_SIZE];
+    uint16_t outBuffSize;
+} gbp_png_t;
+
+bool gbp_png_isopen(gbp_png_t * gbp_png);
+void gbp_png_open(gbp_png_t * gbp_png, const char *outputFilename, const uint16_t fixed_width_size);
+void gbp_png_add(gbp_png_t * gbp_png, const uint8_t * bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint8_t pallet, const uint32_t palletColor[4]);
+void gbp_png_render(gbp_png_t * gbp_png);
+void gbp_png_free(gbp_png_t * gbp_png);
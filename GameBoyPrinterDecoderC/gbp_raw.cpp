@@ -0,0 +1,220 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Raw Frame Stream
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on streaming whole images as raw frames (e.g. to stdout) for video and image pipelines
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gbp_tiles.h"
+#include "gbp_raw.h"
+#include "gbp_trace.h"
+#include "./image/ppm.h"
+
+#define GBP_RAW_BUFF_MIN (64 * 1024)
+
+void gbp_raw_init(gbp_raw_t *raw, const gbp_raw_format_t format, FILE *f)
+{
+  memset(raw, 0, sizeof(*raw));
+  raw->format = format;
+  raw->f = f;
+  raw->ok = true;
+  switch (format)
+  {
+    case GBP_RAW_FORMAT_GRAY8 : raw->lutBytes = GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT; break;
+    case GBP_RAW_FORMAT_2BPP  : raw->lutBytes = 1; break;
+    default: raw->lutBytes = GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT * 3; break;
+  }
+}
+
+bool gbp_raw_isopen(gbp_raw_t *raw)
+{
+  return raw->open;
+}
+
+void gbp_raw_open(gbp_raw_t *raw, const uint16_t fixed_width_size)
+{
+  raw->open = (raw->f != NULL);
+  raw->width = fixed_width_size;
+  raw->height = 0;
+  raw->size = 0;
+  raw->fileCounter++;
+}
+
+static size_t gbp_raw_rowSize(const gbp_raw_t *raw, const uint16_t sizex)
+{
+  switch (raw->format)
+  {
+    case GBP_RAW_FORMAT_GRAY8 : return sizex;
+    case GBP_RAW_FORMAT_2BPP  : return (sizex + GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT - 1) / GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT;
+    default: return (size_t) sizex * 3;
+  }
+}
+
+static void gbp_raw_lut(gbp_raw_t *raw, const uint8_t pallet, const uint32_t palletColor[4])
+{
+  // Combine print palette and output colors into one packed byte to output pixels table
+  if (raw->lutValid && (raw->lutPallet == pallet) && (memcmp(raw->lutColor, palletColor, sizeof(raw->lutColor)) == 0))
+    return;
+
+  for (int b = 0; b < 256; b++)
+  {
+    uint8_t index = 0;
+    for (int i = 0; i < GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT; i++)
+    {
+      const uint8_t tone = GBP_TILES_PALLET_TONE(pallet, b >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(i));
+      const uint32_t color = palletColor[tone];
+      const uint8_t r = (uint8_t)(color >> 16);
+      const uint8_t g = (uint8_t)(color >>  8);
+      const uint8_t bl = (uint8_t)(color >>  0);
+      switch (raw->format)
+      {
+        case GBP_RAW_FORMAT_GRAY8 :
+          raw->lut[b][i] = (uint8_t)((299 * r + 587 * g + 114 * bl + 500) / 1000);
+          break;
+        case GBP_RAW_FORMAT_2BPP :
+          index |= tone << (6 - 2 * i); // First pixel in the top bits
+          break;
+        default:
+          raw->lut[b][i * 3 + 0] = r;
+          raw->lut[b][i * 3 + 1] = g;
+          raw->lut[b][i * 3 + 2] = bl;
+          break;
+      }
+    }
+    if (raw->format == GBP_RAW_FORMAT_2BPP)
+      raw->lut[b][0] = index;
+  }
+  raw->lutValid = true;
+  raw->lutPallet = pallet;
+  memcpy(raw->lutColor, palletColor, sizeof(raw->lutColor));
+}
+
+void gbp_raw_add(gbp_raw_t *raw, const uint8_t *bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint8_t pallet, const uint32_t palletColor[4])
+{
+  // Fixed width
+  if (!raw->open || (sizex != raw->width))
+    return;
+
+  gbp_raw_lut(raw, pallet, palletColor);
+  memcpy(raw->palletColor, palletColor, sizeof(raw->palletColor));
+
+  // Whole frame is kept until render (Header needs the height)
+  const size_t rowSize = gbp_raw_rowSize(raw, sizex);
+  const size_t need = raw->size + rowSize * sizey;
+  if (need > raw->max)
+  {
+    size_t max = raw->max ? raw->max : GBP_RAW_BUFF_MIN;
+    while (max < need)
+      max *= 2;
+    uint8_t *grown = (uint8_t *) realloc(raw->pixels, max);
+    if (!grown)
+    {
+      raw->ok = false;
+      return;
+    }
+    raw->pixels = grown;
+    raw->max = max;
+  }
+
+  // Dev Note: Every packed byte (4 pixels) is expanded in one lookup
+  //           (Widths are a multiple of 4, checked in gbp_decode_create(), so no partial byte)
+  const int packedWidth = GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(sizex);
+  for (uint16_t y = 0; y < sizey; y++)
+  {
+    const uint8_t *src = &bmpLineBuffer[y * packedWidth];
+    uint8_t *dst = &raw->pixels[raw->size];
+    for (int x = 0; x < packedWidth; x++)
+    {
+      memcpy(dst, raw->lut[src[x]], raw->lutBytes);
+      dst += raw->lutBytes;
+    }
+    raw->size += rowSize;
+  }
+  raw->height += sizey;
+}
+
+static void gbp_raw_put16(uint8_t *buf, const uint16_t value)
+{
+  buf[0] = (uint8_t)(value >> 0);
+  buf[1] = (uint8_t)(value >> 8);
+}
+
+static void gbp_raw_put32(uint8_t *buf, const uint32_t value)
+{
+  gbp_raw_put16(&buf[0], (uint16_t)(value >>  0));
+  gbp_raw_put16(&buf[2], (uint16_t)(value >> 16));
+}
+
+void gbp_raw_render(gbp_raw_t *raw)
+{
+  if (!raw->open)
+    return;
+  raw->open = false;
+
+  // An image without rows has no frame (A zero height frame breaks most readers)
+  if (raw->height > 0)
+  {
+    switch (raw->format)
+    {
+      case GBP_RAW_FORMAT_PPM :
+        raw->ok = ppm_write(raw->pixels, raw->width, raw->height, raw->f) && raw->ok;
+        break;
+      case GBP_RAW_FORMAT_PAM :
+        raw->ok = pam_write(raw->pixels, raw->width, raw->height, raw->f) && raw->ok;
+        break;
+      default:
+      {
+        uint8_t header[GBP_RAW_HEADER_SIZE] = {0};
+        memcpy(&header[0], GBP_RAW_MAGIC, 4);
+        gbp_raw_put16(&header[4], raw->width);
+        header[6] = (raw->format == GBP_RAW_FORMAT_GRAY8) ? 8 : 2;
+        gbp_raw_put32(&header[8], raw->height);
+        gbp_raw_put32(&header[12], (uint32_t) raw->size);
+        for (int i = 0; i < 4; i++)
+          gbp_raw_put32(&header[16 + 4 * i], raw->palletColor[i] & 0xFFFFFF);
+        raw->ok = (fwrite(header, 1, sizeof(header), raw->f) == sizeof(header)) && raw->ok;
+        raw->ok = (fwrite(raw->pixels, 1, raw->size, raw->f) == raw->size) && raw->ok;
+        break;
+      }
+    }
+    // Frame is whole, hand it on now (e.g. to a live pipeline)
+    raw->ok = (fflush(raw->f) == 0) && raw->ok;
+  }
+  else
+  {
+    // No frame, so the next image keeps this frame number
+    raw->fileCounter--;
+  }
+  GBP_TRACE(image_close, raw->width, raw->height);
+}
+
+void gbp_raw_free(gbp_raw_t *raw)
+{
+  free(raw->pixels);
+  raw->pixels = NULL;
+  raw->max = 0;
+  raw->size = 0;
+}
@@ -0,0 +1,96 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Raw Frame Stream
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on streaming whole images as raw frames (e.g. to stdout) for video and image pipelines
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_RAW_H
+#define GBP_RAW_H
+
+#include <stdio.h>
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+
+/*
+    Dev Note: Raw frame stream
+    Every image is one frame and frames go back to back into one stream, e.g. stdout piped into
+    ffmpeg or a thumbnailer, so there are no temporary image files and nothing to re-encode.
+    Frame headers hold the height, so rows are converted as they are added and gathered in memory
+    until the image is cut, then the frame is written with one fwrite() and flushed.
+
+    Formats:
+    * ppm   : Binary PPM (P6) 24bit RGB, ppm_write() in image/ppm.h (ffmpeg: -f ppm_pipe)
+    * pam   : PAM (P7) 24bit RGB, pam_write() in image/ppm.h (ffmpeg: -f pam_pipe)
+    * gray8 : Raw header, then one byte per pixel (The pallet color as luma, BT.601)
+    * 2bpp  : Raw header, then 4 pixels per byte with the first pixel in the top bits. Values are
+              pallet color indexes (Print palette applied), rows are (width + 3) / 4 bytes
+
+    Raw header (GBP_RAW_HEADER_SIZE bytes, little endian, same size for every frame):
+    ```
+    [magic "GBPF" 4][width u16][bitsPerPixel u8][reserved 1][height u32][frameSize u32][palletColor u32 x4 (0xRRGGBB)]
+    ```
+    frameSize is the number of pixel bytes that follow the header.
+*/
+
+#define GBP_RAW_HEADER_SIZE 32
+#define GBP_RAW_MAGIC       "GBPF"
+
+typedef enum
+{
+  GBP_RAW_FORMAT_PPM,
+  GBP_RAW_FORMAT_PAM,
+  GBP_RAW_FORMAT_GRAY8,
+  GBP_RAW_FORMAT_2BPP
+} gbp_raw_format_t;
+
+typedef struct
+{
+  gbp_raw_format_t format;
+  FILE *f;
+  bool ok;           ///< No frame write failed
+  bool open;
+  int fileCounter;   ///< Frame number of the next image
+  uint16_t width;
+  uint32_t height;
+  uint32_t palletColor[4];
+
+  // Frame being gathered
+  uint8_t *pixels;
+  size_t size;
+  size_t max;
+
+  // Packed 2bit byte (4 pixels) to output pixel bytes for the current print palette and colors
+  bool lutValid;
+  uint8_t lutPallet;
+  uint32_t lutColor[4];
+  uint8_t lutBytes; ///< Output bytes per packed byte (12 rgb, 4 gray8, 1 2bpp)
+  uint8_t lut[256][4 * 3];
+} gbp_raw_t;
+
+void gbp_raw_init(gbp_raw_t *raw, const gbp_raw_format_t format, FILE *f);
+bool gbp_raw_isopen(gbp_raw_t *raw);
+void gbp_raw_open(gbp_raw_t *raw, const uint16_t fixed_width_size);
+void gbp_raw_add(gbp_raw_t *raw, const uint8_t *bmpLineBuffer, const uint16_t sizex, const uint16_t sizey, const uint8_t pallet, const uint32_t palletColor[4]);
+void gbp_raw_render(gbp_raw_t *raw);
+void gbp_raw_free(gbp_raw_t *raw);
+
+#endif // GBP_RAW_H
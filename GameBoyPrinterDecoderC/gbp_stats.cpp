@@ -0,0 +1,110 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decoder Statistics
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on counting what the decoder did and where its time went
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "gameboy_printer_protocol.h"
+#include "gbp_decode.h"
+#include "gbp_stats.h"
+
+static const int gbp_stats_commands[GBP_STATS_COMMAND_COUNT] =
+{
+  GBP_COMMAND_INIT,
+  GBP_COMMAND_PRINT,
+  GBP_COMMAND_DATA,
+  GBP_COMMAND_BREAK,
+  GBP_COMMAND_INQUIRY,
+  -1 // Unknown
+};
+
+void gbp_stats_packet(gbp_stats_t *stats, const uint8_t command, const uint8_t compression, const uint16_t dataLength)
+{
+  int i = 0;
+  while ((i < (GBP_STATS_COMMAND_COUNT - 1)) && (gbp_stats_commands[i] != command))
+    i++;
+  stats->packets++;
+  stats->packetsByCommand[i]++;
+  if (command == GBP_COMMAND_DATA)
+  {
+    if (compression)
+      stats->payloadCompressed += dataLength;
+    else
+      stats->payloadUncompressed += dataLength;
+  }
+}
+
+void gbp_stats_merge(gbp_stats_t *stats, const gbp_stats_t *add)
+{
+  stats->bytesIngested       += add->bytesIngested;
+  stats->packets             += add->packets;
+  stats->payloadCompressed   += add->payloadCompressed;
+  stats->payloadUncompressed += add->payloadUncompressed;
+  stats->checksumFailures    += add->checksumFailures;
+  stats->tiles               += add->tiles;
+  stats->rows                += add->rows;
+  stats->images              += add->images;
+  stats->tileCacheHits       += add->tileCacheHits;
+  stats->tileCacheMisses     += add->tileCacheMisses;
+  for (int i = 0; i < GBP_STATS_COMMAND_COUNT; i++)
+    stats->packetsByCommand[i] += add->packetsByCommand[i];
+  for (int i = 0; i < GBP_STATS_STAGE_COUNT; i++)
+    stats->stageNs[i] += add->stageNs[i];
+  // Dev Note: wallNs is not summed, it belongs to whoever ran the sessions
+}
+
+const char *gbp_stats_stageName(const gbp_stats_stage_t stage)
+{
+  switch (stage)
+  {
+    case GBP_STATS_STAGE_HEX_PARSE          : return "hex_parse";
+    case GBP_STATS_STAGE_PKT_PROCESS        : return "pkt_processByte";
+    case GBP_STATS_STAGE_PKT_DECOMPRESS     : return "pkt_decompressor";
+    case GBP_STATS_STAGE_TILES_LINE_DECODER : return "tiles_line_decoder";
+    case GBP_STATS_STAGE_TILES_PRINT        : return "tiles_print";
+    case GBP_STATS_STAGE_IMAGE_ADD          : return "image_add";
+    case GBP_STATS_STAGE_IMAGE_RENDER       : return "image_render";
+    default: return "?";
+  }
+}
+
+void gbp_stats_json(FILE *f, const gbp_stats_t *stats)
+{
+  fprintf(f, "{\"bytesIngested\":%llu,\"packets\":{\"total\":%llu",
+      (unsigned long long) stats->bytesIngested, (unsigned long long) stats->packets);
+  for (int i = 0; i < GBP_STATS_COMMAND_COUNT; i++)
+    fprintf(f, ",\"%s\":%llu", gbpCommand_toStr(gbp_stats_commands[i]), (unsigned long long) stats->packetsByCommand[i]);
+  fprintf(f, "},\"payloadBytes\":{\"compressed\":%llu,\"uncompressed\":%llu}",
+      (unsigned long long) stats->payloadCompressed, (unsigned long long) stats->payloadUncompressed);
+  fprintf(f, ",\"checksumFailures\":%llu,\"tiles\":%llu,\"rows\":%llu,\"images\":%llu",
+      (unsigned long long) stats->checksumFailures, (unsigned long long) stats->tiles,
+      (unsigned long long) stats->rows, (unsigned long long) stats->images);
+  fprintf(f, ",\"stageNs\":{");
+  for (int i = 0; i < GBP_STATS_STAGE_COUNT; i++)
+    fprintf(f, "%s\"%s\":%llu", (i == 0) ? "" : ",", gbp_stats_stageName((gbp_stats_stage_t) i), (unsigned long long) stats->stageNs[i]);
+  fprintf(f, "},\"tileCache\":{\"hits\":%llu,\"misses\":%llu}",
+      (unsigned long long) stats->tileCacheHits, (unsigned long long) stats->tileCacheMisses);
+  fprintf(f, ",\"wallNs\":%llu}\n", (unsigned long long) stats->wallNs);
+}
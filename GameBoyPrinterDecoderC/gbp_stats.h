@@ -0,0 +1,111 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decoder Statistics
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on counting what the decoder did and where its time went
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_STATS_H
+#define GBP_STATS_H
+
+#include <stdio.h>
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include <time.h>
+
+/*
+    Dev Note: Statistics
+    Collected per decode session when gbp_decode_config_t.stats is set (See gbp_decode_stats()).
+    Sessions on other threads are combined with gbp_stats_merge().
+
+    Stage timings are exclusive (e.g. pkt_decompressor excludes the tile decoding it triggers)
+    and include the cost of reading the clock around each call, which is noticeable for the
+    per tile stages. Compare them against each other and against earlier runs, not as absolutes.
+
+    gbp_stats_json() writes one line of JSON, so it can be picked out of a log:
+    ```
+    {"bytesIngested":..., "packets":{"total":...,"INIT":...,...}, "payloadBytes":{"compressed":...,"uncompressed":...},
+     "checksumFailures":..., "tiles":..., "rows":..., "images":..., "stageNs":{"hex_parse":...,...},
+     "tileCache":{"hits":...,"misses":...}, "wallNs":...}
+    ```
+    Like the stage timings, tile cache counts depend on how the work was split (Each session has its own cache).
+*/
+
+typedef enum
+{
+  GBP_STATS_STAGE_HEX_PARSE,          ///< Ascii hex to bytes
+  GBP_STATS_STAGE_PKT_PROCESS,        ///< gbp_pkt_processByte() (Via gbp_pkt_processBytes())
+  GBP_STATS_STAGE_PKT_DECOMPRESS,     ///< gbp_pkt_decompressor() and gbp_pkt_tileDirect()
+  GBP_STATS_STAGE_TILES_LINE_DECODER, ///< gbp_tiles_line_decoder() and its bulk version
+  GBP_STATS_STAGE_TILES_PRINT,        ///< gbp_tiles_print()
+  GBP_STATS_STAGE_IMAGE_ADD,          ///< gbp_bmp_add() or gbp_png_add()
+  GBP_STATS_STAGE_IMAGE_RENDER,       ///< gbp_bmp_render() or gbp_png_render()
+  GBP_STATS_STAGE_COUNT
+} gbp_stats_stage_t;
+
+// Packet commands in gbpCommand_toStr() order, anything else is counted as unknown
+#define GBP_STATS_COMMAND_COUNT 6
+
+typedef struct
+{
+  uint64_t bytesIngested;       ///< Bytes fed to the packet parser
+  uint64_t packets;
+  uint64_t packetsByCommand[GBP_STATS_COMMAND_COUNT];
+  uint64_t payloadCompressed;   ///< DATA payload bytes of compressed packets
+  uint64_t payloadUncompressed; ///< DATA payload bytes of uncompressed packets
+  uint64_t checksumFailures;
+  uint64_t tiles;               ///< Tiles decoded into lines
+  uint64_t rows;                ///< Tile rows (8 lines) written to images
+  uint64_t images;
+  uint64_t tileCacheHits;       ///< Tiles copied from the tile cache (See gbp_tiles.h)
+  uint64_t tileCacheMisses;
+  uint64_t stageNs[GBP_STATS_STAGE_COUNT];
+  uint64_t wallNs;              ///< Set by the caller (e.g. whole run)
+} gbp_stats_t;
+
+static inline uint64_t gbp_stats_nowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// Timing helpers, no op (and no clock read) when stats is NULL
+static inline uint64_t gbp_stats_start(const gbp_stats_t *stats)
+{
+  return stats ? gbp_stats_nowNs() : 0;
+}
+
+static inline uint64_t gbp_stats_stop(gbp_stats_t *stats, const gbp_stats_stage_t stage, const uint64_t start)
+{
+  if (!stats)
+    return 0;
+  const uint64_t elapsed = gbp_stats_nowNs() - start;
+  stats->stageNs[stage] += elapsed;
+  return elapsed;
+}
+
+void gbp_stats_packet(gbp_stats_t *stats, const uint8_t command, const uint8_t compression, const uint16_t dataLength);
+void gbp_stats_merge(gbp_stats_t *stats, const gbp_stats_t *add);
+const char *gbp_stats_stageName(const gbp_stats_stage_t stage);
+void gbp_stats_json(FILE *f, const gbp_stats_t *stats);
+
+#endif // GBP_STATS_H
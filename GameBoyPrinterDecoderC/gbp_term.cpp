@@ -0,0 +1,457 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Terminal Preview
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on drawing printed rows to a terminal with as few bytes and writes as possible
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "gbp_tiles.h"
+#include "gbp_term.h"
+
+#define GBP_TERM_WIDTH          (GBP_TILE_PIXEL_WIDTH * GBP_TILES_PER_LINE)
+#define GBP_TERM_QUERY_MS       200 ///< How long to wait on the device attributes reply
+#define GBP_TERM_SIXEL_HEIGHT   6
+
+static const char gbp_term_upperHalf[] = "\xE2\x96\x80"; // U+2580 ▀
+static const char gbp_term_fullBlock[] = "\xE2\x96\x88"; // U+2588 █
+
+/*******************************************************************************
+ * Buffer
+*******************************************************************************/
+
+static bool gbp_term_reserve(gbp_term_t *term, const size_t size)
+{
+  if ((term->size + size) <= term->max)
+    return true;
+  size_t max = term->max ? term->max : (64 * 1024);
+  while (max < (term->size + size))
+    max *= 2;
+  char *grown = (char *) realloc(term->buff, max);
+  if (!grown)
+  {
+    term->ok = false;
+    return false;
+  }
+  term->buff = grown;
+  term->max = max;
+  return true;
+}
+
+static inline void gbp_term_append(gbp_term_t *term, const char *str, const size_t size)
+{
+  // Caller has reserved the space
+  memcpy(&term->buff[term->size], str, size);
+  term->size += size;
+}
+
+static bool gbp_term_flush(gbp_term_t *term)
+{
+  // The whole frame in one write() (More only if the terminal takes it in parts)
+  size_t done = 0;
+  while (term->ok && (done < term->size))
+  {
+    const ssize_t n = write(term->fd, &term->buff[done], term->size - done);
+    if ((n < 0) && (errno == EINTR))
+      continue;
+    term->ok = (n > 0);
+    done += (n > 0) ? (size_t) n : 0;
+  }
+  term->size = 0;
+  return term->ok;
+}
+
+/*******************************************************************************
+ * Pixels
+*******************************************************************************/
+
+static inline int gbp_term_tone(const uint8_t *line, const uint8_t pallet, const int x)
+{
+  return GBP_TILES_PALLET_TONE(pallet, line[GBP_TILE_2BIT_LINEPACK_INDEX(x)] >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(x));
+}
+
+static const uint8_t *gbp_term_line(gbp_tile_t *tiles, const uint16_t rowStart, const uint32_t y, uint8_t *pallet)
+{
+  // Pixel line y counted from rowStart (NULL if the row was dropped)
+  const uint16_t tileRow = (uint16_t) (rowStart + y / GBP_TILE_PIXEL_HEIGHT);
+  const uint8_t *lines = gbp_tiles_rowLines(tiles, tileRow);
+  *pallet = gbp_tiles_rowPallet(tiles, tileRow);
+  return lines ? &lines[(y % GBP_TILE_PIXEL_HEIGHT) * GBP_TILES_LINE_SIZE_B] : NULL;
+}
+
+/*******************************************************************************
+ * Blocks
+*******************************************************************************/
+
+static void gbp_term_blocks(gbp_term_t *term, gbp_tile_t *tiles, const uint16_t rowStart, const uint32_t height)
+{
+  // Colour escapes per tone: [0] foreground, [1] background
+  char escape[2][4][24];
+  size_t escapeSize[2][4];
+  for (int i = 0; i < 4; i++)
+  {
+    const uint32_t c = term->palletColor[i];
+    escapeSize[0][i] = (size_t) snprintf(escape[0][i], sizeof(escape[0][i]), "\x1B[38;2;%u;%u;%um", (unsigned) (c >> 16) & 0xFF, (unsigned) (c >> 8) & 0xFF, (unsigned) c & 0xFF);
+    escapeSize[1][i] = (size_t) snprintf(escape[1][i], sizeof(escape[1][i]), "\x1B[48;2;%u;%u;%um", (unsigned) (c >> 16) & 0xFF, (unsigned) (c >> 8) & 0xFF, (unsigned) c & 0xFF);
+  }
+
+  for (uint32_t y = 0; (y + 1) < height; y += 2)
+  {
+    uint8_t palletTop = 0;
+    uint8_t palletBottom = 0;
+    const uint8_t *top = gbp_term_line(tiles, rowStart, y, &palletTop);
+    const uint8_t *bottom = gbp_term_line(tiles, rowStart, y + 1, &palletBottom);
+    if (!top || !bottom || !gbp_term_reserve(term, GBP_TERM_WIDTH * (2 * 24 + 3) + 8))
+      return;
+
+    int fg = -1;
+    int bg = -1;
+    for (int x = 0; x < GBP_TERM_WIDTH; x++)
+    {
+      const int upper = gbp_term_tone(top, palletTop, x);
+      const int lower = gbp_term_tone(bottom, palletBottom, x);
+      if (upper == lower)
+      {
+        // One colour cell, use whichever colour is already set
+        if (bg == upper)
+        {
+          gbp_term_append(term, " ", 1);
+        }
+        else if (fg == upper)
+        {
+          gbp_term_append(term, gbp_term_fullBlock, sizeof(gbp_term_fullBlock) - 1);
+        }
+        else
+        {
+          gbp_term_append(term, escape[1][upper], escapeSize[1][upper]);
+          gbp_term_append(term, " ", 1);
+          bg = upper;
+        }
+        continue;
+      }
+      if (fg != upper)
+      {
+        gbp_term_append(term, escape[0][upper], escapeSize[0][upper]);
+        fg = upper;
+      }
+      if (bg != lower)
+      {
+        gbp_term_append(term, escape[1][lower], escapeSize[1][lower]);
+        bg = lower;
+      }
+      gbp_term_append(term, gbp_term_upperHalf, sizeof(gbp_term_upperHalf) - 1);
+    }
+    gbp_term_append(term, "\x1B[0m\r\n", 6);
+  }
+}
+
+/*******************************************************************************
+ * Sixel
+*******************************************************************************/
+
+static void gbp_term_sixelRun(gbp_term_t *term, const char sixel, const int count)
+{
+  // Space reserved by the caller
+  if (count > 3)
+  {
+    term->size += (size_t) snprintf(&term->buff[term->size], 8, "!%d", count);
+    gbp_term_append(term, &sixel, 1);
+    return;
+  }
+  for (int i = 0; i < count; i++)
+    gbp_term_append(term, &sixel, 1);
+}
+
+static void gbp_term_sixel(gbp_term_t *term, gbp_tile_t *tiles, const uint16_t rowStart, const uint32_t height)
+{
+  if (!gbp_term_reserve(term, 128))
+    return;
+  term->size += (size_t) snprintf(&term->buff[term->size], 128, "\x1BPq\"1;1;%d;%u", GBP_TERM_WIDTH, (unsigned) height);
+  for (int i = 0; i < 4; i++)
+  {
+    // Colour registers are in percent
+    const uint32_t c = term->palletColor[i];
+    if (!gbp_term_reserve(term, 32))
+      return;
+    term->size += (size_t) snprintf(&term->buff[term->size], 32, "#%d;2;%u;%u;%u", i,
+        (unsigned) (((c >> 16) & 0xFF) * 100 + 127) / 255, (unsigned) (((c >> 8) & 0xFF) * 100 + 127) / 255, (unsigned) ((c & 0xFF) * 100 + 127) / 255);
+  }
+
+  for (uint32_t y0 = 0; y0 < height; y0 += GBP_TERM_SIXEL_HEIGHT)
+  {
+    // One band of six pixel lines, drawn once per colour that is used in it
+    uint8_t tones[GBP_TERM_SIXEL_HEIGHT][GBP_TERM_WIDTH];
+    int lines = 0;
+    for (; (lines < GBP_TERM_SIXEL_HEIGHT) && ((y0 + lines) < height); lines++)
+    {
+      uint8_t pallet = 0;
+      const uint8_t *line = gbp_term_line(tiles, rowStart, y0 + lines, &pallet);
+      if (!line)
+        break;
+      for (int x = 0; x < GBP_TERM_WIDTH; x++)
+        tones[lines][x] = (uint8_t) gbp_term_tone(line, pallet, x);
+    }
+    if (!gbp_term_reserve(term, 4 * (GBP_TERM_WIDTH + 4) + 2))
+      return;
+    for (int c = 0; c < 4; c++)
+    {
+      char sixels[GBP_TERM_WIDTH];
+      bool used = false;
+      for (int x = 0; x < GBP_TERM_WIDTH; x++)
+      {
+        int bits = 0;
+        for (int j = 0; j < lines; j++)
+          bits |= (tones[j][x] == c) << j;
+        sixels[x] = (char) (63 + bits);
+        used = used || bits;
+      }
+      if (!used)
+        continue;
+      term->size += (size_t) snprintf(&term->buff[term->size], 4, "#%d", c);
+      int run = 1;
+      for (int x = 1; x <= GBP_TERM_WIDTH; x++)
+      {
+        if ((x < GBP_TERM_WIDTH) && (sixels[x] == sixels[x - 1]))
+        {
+          run++;
+          continue;
+        }
+        gbp_term_sixelRun(term, sixels[x - 1], run);
+        run = 1;
+      }
+      gbp_term_append(term, "$", 1);
+    }
+    gbp_term_append(term, "-", 1);
+    if (lines < GBP_TERM_SIXEL_HEIGHT)
+      break;
+  }
+  if (gbp_term_reserve(term, 2))
+    gbp_term_append(term, "\x1B\\", 2);
+}
+
+/*******************************************************************************
+ * Kitty
+*******************************************************************************/
+
+static void gbp_term_kittyChunk(gbp_term_t *term, const uint8_t *rgb, const size_t size, const bool first, const bool more, const uint32_t height)
+{
+  static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  if (!gbp_term_reserve(term, 64 + (size + 2) / 3 * 4))
+    return;
+  if (first)
+    term->size += (size_t) snprintf(&term->buff[term->size], 64, "\x1B_Ga=T,f=24,s=%d,v=%u,m=%d;", GBP_TERM_WIDTH, (unsigned) height, more ? 1 : 0);
+  else
+    term->size += (size_t) snprintf(&term->buff[term->size], 64, "\x1B_Gm=%d;", more ? 1 : 0);
+  char *out = &term->buff[term->size];
+  size_t i = 0;
+  for (; (i + 3) <= size; i += 3)
+  {
+    const uint32_t v = ((uint32_t) rgb[i] << 16) | ((uint32_t) rgb[i + 1] << 8) | rgb[i + 2];
+    *out++ = base64[(v >> 18) & 0x3F];
+    *out++ = base64[(v >> 12) & 0x3F];
+    *out++ = base64[(v >> 6) & 0x3F];
+    *out++ = base64[v & 0x3F];
+  }
+  if (i < size)
+  {
+    const uint32_t v = ((uint32_t) rgb[i] << 16) | (((i + 1) < size) ? ((uint32_t) rgb[i + 1] << 8) : 0);
+    *out++ = base64[(v >> 18) & 0x3F];
+    *out++ = base64[(v >> 12) & 0x3F];
+    *out++ = ((i + 1) < size) ? base64[(v >> 6) & 0x3F] : '=';
+    *out++ = '=';
+  }
+  term->size = (size_t) (out - term->buff);
+  gbp_term_append(term, "\x1B\\", 2);
+}
+
+static void gbp_term_kitty(gbp_term_t *term, gbp_tile_t *tiles, const uint16_t rowStart, const uint32_t height)
+{
+  // Pixels are converted to RGB one chunk at a time (Chunks are a multiple of 3 bytes, so each is whole base64)
+  uint8_t rgb[GBP_TERM_KITTY_CHUNK / 4 * 3];
+  size_t size = 0;
+  bool first = true;
+  const size_t total = (size_t) height * GBP_TERM_WIDTH * 3;
+  size_t sent = 0;
+  for (uint32_t y = 0; y < height; y++)
+  {
+    uint8_t pallet = 0;
+    const uint8_t *line = gbp_term_line(tiles, rowStart, y, &pallet);
+    for (int x = 0; x < GBP_TERM_WIDTH; x++)
+    {
+      const uint32_t c = term->palletColor[line ? gbp_term_tone(line, pallet, x) : 0];
+      rgb[size++] = (uint8_t) (c >> 16);
+      rgb[size++] = (uint8_t) (c >> 8);
+      rgb[size++] = (uint8_t) c;
+      if (size == sizeof(rgb))
+      {
+        sent += size;
+        gbp_term_kittyChunk(term, rgb, size, first, sent < total, height);
+        first = false;
+        size = 0;
+      }
+    }
+  }
+  if (size > 0)
+    gbp_term_kittyChunk(term, rgb, size, first, false, height);
+  if (gbp_term_reserve(term, 2))
+    gbp_term_append(term, "\r\n", 2);
+}
+
+/*******************************************************************************
+ * Detection
+*******************************************************************************/
+
+static bool gbp_term_querySixel(void)
+{
+  // Primary device attributes: the reply (e.g. `ESC [ ? 62 ; 4 ; 22 c`) lists 4 if sixel is supported
+  const int tty = open("/dev/tty", O_RDWR | O_NOCTTY);
+  if (tty < 0)
+    return false;
+  struct termios saved;
+  if (tcgetattr(tty, &saved) != 0)
+  {
+    close(tty);
+    return false;
+  }
+  struct termios raw = saved;
+  raw.c_lflag &= ~(ICANON | ECHO);
+  raw.c_cc[VMIN] = 0;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr(tty, TCSANOW, &raw);
+
+  char reply[64];
+  size_t size = 0;
+  if (write(tty, "\x1B[c", 3) == 3)
+  {
+    struct pollfd pfd = {tty, POLLIN, 0};
+    while ((size < (sizeof(reply) - 1)) && (poll(&pfd, 1, GBP_TERM_QUERY_MS) > 0))
+    {
+      const ssize_t n = read(tty, &reply[size], sizeof(reply) - 1 - size);
+      if (n <= 0)
+        break;
+      size += (size_t) n;
+      if (memchr(reply, 'c', size))
+        break;
+    }
+  }
+  tcsetattr(tty, TCSANOW, &saved);
+  close(tty);
+  reply[size] = '\0';
+
+  const char *p = strstr(reply, "\x1B[?");
+  if (!p)
+    return false;
+  for (p += 3; *p && (*p != 'c'); )
+  {
+    char *end = NULL;
+    const long attribute = strtol(p, &end, 10);
+    if (end == p)
+      break;
+    if (attribute == 4)
+      return true;
+    p = (*end == ';') ? end + 1 : end;
+  }
+  return false;
+}
+
+gbp_term_mode_t gbp_term_detect(const int fd)
+{
+  if (!isatty(fd))
+    return GBP_TERM_MODE_BLOCKS;
+  const char *term = getenv("TERM");
+  const char *program = getenv("TERM_PROGRAM");
+  if (getenv("KITTY_WINDOW_ID") || (term && (strstr(term, "kitty") || strstr(term, "ghostty")))
+      || (program && ((strcmp(program, "WezTerm") == 0) || (strcmp(program, "ghostty") == 0))))
+    return GBP_TERM_MODE_KITTY;
+  if (gbp_term_querySixel())
+    return GBP_TERM_MODE_SIXEL;
+  return GBP_TERM_MODE_BLOCKS;
+}
+
+bool gbp_term_parseMode(const char *str, gbp_term_mode_t *mode)
+{
+  for (int i = GBP_TERM_MODE_AUTO; i <= GBP_TERM_MODE_KITTY; i++)
+  {
+    if (strcmp(str, gbp_term_modeName((gbp_term_mode_t) i)) == 0)
+    {
+      *mode = (gbp_term_mode_t) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *gbp_term_modeName(const gbp_term_mode_t mode)
+{
+  switch (mode)
+  {
+    case GBP_TERM_MODE_AUTO   : return "auto";
+    case GBP_TERM_MODE_BLOCKS : return "blocks";
+    case GBP_TERM_MODE_SIXEL  : return "sixel";
+    case GBP_TERM_MODE_KITTY  : return "kitty";
+    default: return "?";
+  }
+}
+
+/*******************************************************************************
+ * Preview
+*******************************************************************************/
+
+void gbp_term_init(gbp_term_t *term, const int fd, const gbp_term_mode_t mode, const uint32_t palletColor[4])
+{
+  memset(term, 0, sizeof(*term));
+  term->fd = fd;
+  term->mode = (mode == GBP_TERM_MODE_AUTO) ? gbp_term_detect(fd) : mode;
+  memcpy(term->palletColor, palletColor, sizeof(term->palletColor));
+  term->ok = true;
+}
+
+bool gbp_term_rows(gbp_term_t *term, gbp_tile_t *tiles, const uint16_t rowStart, const uint16_t rowCount)
+{
+  // Draw tile rows [rowStart, rowStart + rowCount) as one frame
+  const uint32_t height = (uint32_t) rowCount * GBP_TILE_PIXEL_HEIGHT;
+  if (height == 0)
+    return term->ok;
+  switch (term->mode)
+  {
+    case GBP_TERM_MODE_SIXEL : gbp_term_sixel(term, tiles, rowStart, height); break;
+    case GBP_TERM_MODE_KITTY : gbp_term_kitty(term, tiles, rowStart, height); break;
+    default                  : gbp_term_blocks(term, tiles, rowStart, height); break;
+  }
+  return gbp_term_flush(term);
+}
+
+void gbp_term_free(gbp_term_t *term)
+{
+  free(term->buff);
+  term->buff = NULL;
+  term->size = 0;
+  term->max = 0;
+}
@@ -0,0 +1,78 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Terminal Preview
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on drawing printed rows to a terminal with as few bytes and writes as possible
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_TERM_H
+#define GBP_TERM_H
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+#include "gbp_tiles.h"
+
+/*
+    Dev Note: Terminal preview
+    Each gbp_term_rows() call (e.g. from onPrint()) is drawn into one buffer and sent with a single write(),
+    so a preview over ssh is one burst instead of one tiny write per pixel.
+
+    Modes:
+    * blocks : Two pixel lines per character cell. `▀` takes the upper pixel as foreground colour and the
+               lower pixel as background colour (A space if both match). 24bit colour escapes are only
+               sent when the colour changes, so flat areas cost one byte per cell.
+    * sixel  : DEC sixel image, one colour register per pallet colour, runs are `!n` repeat compressed.
+    * kitty  : Kitty graphics protocol, raw RGB sent as base64 in 4KiB chunks.
+
+    gbp_term_detect() picks kitty from the environment (KITTY_WINDOW_ID, TERM, TERM_PROGRAM), sixel if the
+    terminal lists sixel (4) in its primary device attributes reply (asked for on /dev/tty, so it works
+    when the capture comes in on stdin), else blocks. Output that is not a terminal always gets blocks.
+*/
+
+#define GBP_TERM_KITTY_CHUNK 4096 ///< Base64 bytes per kitty graphics escape
+
+typedef enum
+{
+  GBP_TERM_MODE_AUTO,
+  GBP_TERM_MODE_BLOCKS,
+  GBP_TERM_MODE_SIXEL,
+  GBP_TERM_MODE_KITTY
+} gbp_term_mode_t;
+
+typedef struct
+{
+  gbp_term_mode_t mode;
+  int fd;
+  uint32_t palletColor[4];
+  char *buff;
+  size_t size;
+  size_t max;
+  bool ok;
+} gbp_term_t;
+
+bool gbp_term_parseMode(const char *str, gbp_term_mode_t *mode);
+const char *gbp_term_modeName(const gbp_term_mode_t mode);
+gbp_term_mode_t gbp_term_detect(const int fd);
+void gbp_term_init(gbp_term_t *term, const int fd, const gbp_term_mode_t mode, const uint32_t palletColor[4]);
+bool gbp_term_rows(gbp_term_t *term, gbp_tile_t *tiles, const uint16_t rowStart, const uint16_t rowCount);
+void gbp_term_free(gbp_term_t *term);
+
+#endif // GBP_TERM_H
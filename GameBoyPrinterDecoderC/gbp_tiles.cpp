@@ -25,8 +25,18 @@
 #include <stdint.h> // uint8_t
 #include <stddef.h> // size_t
 #include <stdbool.h> // bool
+#include <stdlib.h> // realloc
+#include <string.h> // memcpy
 #include "gameboy_printer_protocol.h"
 #include "gbp_tiles.h"
+#include "gbp_trace.h"
+
+#if (GBP_TILES_DECODER == GBP_TILES_DECODER_SIMD) && defined(__SSE2__)
+#define GBP_TILES_SSE2 1
+#include <emmintrin.h>
+#else
+#define GBP_TILES_SSE2 0
+#endif
 
 static void gbp_tiles_toBuff(
                         uint8_t *buff,
@@ -63,21 +73,244 @@ static void gbp_tiles_toBuff(
     }
 }
 
-bool gbp_tiles_line_decoder(gbp_tile_t *gbp_tiles, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
+/*
+    Dev Note: Packed line decoding
+    Each tile line is a low bit plane byte followed by a high bit plane byte, with the leftmost pixel in bit 7.
+    The packed output line has pixel `i` at bits `2*i` (see GBP_TILE_2BIT_LINEPACK_*), so the two output bytes
+    of a tile line are just the bit reversed planes interleaved (`lo0 hi0 lo1 hi1 ...`).
+    * LUT  : `spread[b]` places bit `7-i` of `b` at bit `2*i`, so a line is `spread[lo] | (spread[hi] << 1)`
+    * SIMD : Bit reverse every byte then perfect shuffle (Hacker's Delight 7-2) every 16bit lane.
+             All 8 lines of a tile are done at once with SSE2, or 4 lines at a time in a uint64_t.
+*/
+
+#if GBP_TILES_DECODER == GBP_TILES_DECODER_LUT
+typedef struct
+{
+    uint16_t spread[256];
+} gbp_tiles_spreadLUT_t;
+
+static gbp_tiles_spreadLUT_t gbp_tiles_spreadLUT_build(void)
+{
+    gbp_tiles_spreadLUT_t lut;
+    for (int b = 0; b < 256; b++)
+    {
+        uint16_t spread = 0;
+        for (int i = 0; i < GBP_TILE_PIXEL_WIDTH; i++)
+        {
+            spread |= (uint16_t)(((b >> (7 - i)) & 1) << (2 * i));
+        }
+        lut.spread[b] = spread;
+    }
+    return lut;
+}
+
+static inline void gbp_tiles_tileToLines(uint8_t *dst, const int lineWidthSize, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
+{
+    static const gbp_tiles_spreadLUT_t lut = gbp_tiles_spreadLUT_build(); // Built once (Thread safe)
+    const uint16_t *spread = lut.spread;
+    for (int j = 0; j < GBP_TILE_PIXEL_HEIGHT; j++)
+    {
+        const uint16_t line = spread[tileBuff[j*2]] | (uint16_t)(spread[tileBuff[j*2 + 1]] << 1);
+        dst[j * lineWidthSize + 0] = (uint8_t)(line >> 0);
+        dst[j * lineWidthSize + 1] = (uint8_t)(line >> 8);
+    }
+}
+#elif (GBP_TILES_DECODER == GBP_TILES_DECODER_SIMD) || (GBP_TILES_DECODER == GBP_TILES_DECODER_SWAR)
+static inline uint64_t gbp_tiles_shuffle64(uint64_t x)
+{
+    // Bit reverse each byte
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    // Interleave low and high byte of each 16bit lane
+    x = ((x & 0x00F000F000F000F0ULL) << 4) | ((x >> 4) & 0x00F000F000F000F0ULL) | (x & 0xF00FF00FF00FF00FULL);
+    x = ((x & 0x0C0C0C0C0C0C0C0CULL) << 2) | ((x >> 2) & 0x0C0C0C0C0C0C0C0CULL) | (x & 0xC3C3C3C3C3C3C3C3ULL);
+    x = ((x & 0x2222222222222222ULL) << 1) | ((x >> 1) & 0x2222222222222222ULL) | (x & 0x9999999999999999ULL);
+    return x;
+}
+
+static inline void gbp_tiles_tileToLines(uint8_t *dst, const int lineWidthSize, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
+{
+    uint8_t lines[GBP_TILE_SIZE_IN_BYTE];
+#if GBP_TILES_SSE2
+#define GBP_TILES_SHUFFLE(x, mask, shift) \
+    _mm_or_si128(_mm_or_si128(_mm_slli_epi64(_mm_and_si128(x, mask), shift), _mm_and_si128(_mm_srli_epi64(x, shift), mask)), _mm_andnot_si128(_mm_or_si128(mask, _mm_slli_epi64(mask, shift)), x))
+    __m128i x = _mm_loadu_si128((const __m128i *)tileBuff);
+    // Bit reverse each byte
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0F);
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi64(x, 1), m1), _mm_slli_epi64(_mm_and_si128(x, m1), 1));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi64(x, 2), m2), _mm_slli_epi64(_mm_and_si128(x, m2), 2));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi64(x, 4), m4), _mm_slli_epi64(_mm_and_si128(x, m4), 4));
+    // Interleave low and high byte of each 16bit lane
+    x = GBP_TILES_SHUFFLE(x, _mm_set1_epi16(0x00F0), 4);
+    x = GBP_TILES_SHUFFLE(x, _mm_set1_epi16(0x0C0C), 2);
+    x = GBP_TILES_SHUFFLE(x, _mm_set1_epi16(0x2222), 1);
+    _mm_storeu_si128((__m128i *)lines, x);
+#undef GBP_TILES_SHUFFLE
+#else
+    for (int k = 0; k < 2; k++)
+    {
+        uint64_t x = 0;
+        for (int b = 0; b < 8; b++)
+            x |= (uint64_t)tileBuff[k*8 + b] << (8 * b);
+        x = gbp_tiles_shuffle64(x);
+        for (int b = 0; b < 8; b++)
+            lines[k*8 + b] = (uint8_t)(x >> (8 * b));
+    }
+#endif
+    for (int j = 0; j < GBP_TILE_PIXEL_HEIGHT; j++)
+    {
+        dst[j * lineWidthSize + 0] = lines[j*2 + 0];
+        dst[j * lineWidthSize + 1] = lines[j*2 + 1];
+    }
+}
+#endif
+
+#if GBP_TILES_CACHE
+static inline void gbp_tiles_cacheDecode(gbp_tiles_cache_t *cache, uint8_t *dst, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
+{
+    // Direct mapped, a miss decodes into the entry and then copies out like a hit
+    uint64_t lo;
+    uint64_t hi;
+    memcpy(&lo, &tileBuff[0], sizeof(lo));
+    memcpy(&hi, &tileBuff[8], sizeof(hi));
+    const uint32_t slot = (uint32_t)(((lo * 0x9E3779B97F4A7C15ULL) ^ (hi * 0xC2B2AE3D27D4EB4FULL)) >> (64 - GBP_TILES_CACHE_BITS));
+    gbp_tiles_cacheEntry_t *entry = &cache->entry[slot];
+    if ((entry->tile[0] == lo) && (entry->tile[1] == hi))
+    {
+        cache->hits++;
+    }
+    else
+    {
+        cache->misses++;
+        entry->tile[0] = lo;
+        entry->tile[1] = hi;
+        gbp_tiles_tileToLines(entry->lines, GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(GBP_TILE_PIXEL_WIDTH), tileBuff);
+    }
+    for (int j = 0; j < GBP_TILE_PIXEL_HEIGHT; j++)
+    {
+        dst[j * GBP_TILES_LINE_SIZE_B + 0] = entry->lines[j*2 + 0];
+        dst[j * GBP_TILES_LINE_SIZE_B + 1] = entry->lines[j*2 + 1];
+    }
+}
+#endif
+
+/*****************************************************************************/
+
+static gbp_tiles_rowBlock_t *gbp_tiles_rowBlock(gbp_tile_t *gbp_tiles, const uint16_t tileRow, const bool grow)
+{
+    // Block holding a tile row, grows the pool on request. NULL if not avaliable
+    const uint16_t block = tileRow / GBP_TILES_PER_ROW;
+    if (block == 0)
+        return &gbp_tiles->rowBlock;
+
+    if (block > gbp_tiles->rowBlockPoolSize)
+    {
+        if (!grow || (tileRow >= GBP_TILES_ROW_MAX))
+            return NULL;
+
+        gbp_tiles_rowBlock_t **pool = (gbp_tiles_rowBlock_t **)realloc(gbp_tiles->rowBlockPool, block * sizeof(pool[0]));
+        if (!pool)
+            return NULL;
+        gbp_tiles->rowBlockPool = pool;
+        while (gbp_tiles->rowBlockPoolSize < block)
+        {
+            pool[gbp_tiles->rowBlockPoolSize] = (gbp_tiles_rowBlock_t *)calloc(1, sizeof(gbp_tiles_rowBlock_t));
+            if (!pool[gbp_tiles->rowBlockPoolSize])
+                return NULL;
+            gbp_tiles->rowBlockPoolSize++;
+        }
+    }
+    return gbp_tiles->rowBlockPool[block - 1];
+}
+
+static uint8_t *gbp_tiles_rowBuff(gbp_tile_t *gbp_tiles, const uint16_t tileRow, const bool grow)
+{
+    gbp_tiles_rowBlock_t *rowBlock = gbp_tiles_rowBlock(gbp_tiles, tileRow, grow);
+    if (!rowBlock)
+        return NULL;
+    return &rowBlock->bmpLineBuffer[(tileRow % GBP_TILES_PER_ROW) * GBP_TILE_PIXEL_HEIGHT][0];
+}
+
+const uint8_t *gbp_tiles_rowLines(gbp_tile_t *gbp_tiles, const uint16_t tileRow)
+{
+    // GBP_TILE_PIXEL_HEIGHT lines of GBP_TILES_LINE_SIZE_B packed bytes (NULL if row was dropped)
+    return gbp_tiles_rowBuff(gbp_tiles, tileRow, false);
+}
+
+uint8_t gbp_tiles_rowPallet(gbp_tile_t *gbp_tiles, const uint16_t tileRow)
+{
+    gbp_tiles_rowBlock_t *rowBlock = gbp_tiles_rowBlock(gbp_tiles, tileRow, false);
+    return rowBlock ? rowBlock->tileRowPallet[tileRow % GBP_TILES_PER_ROW] : 0xE4;
+}
+
+static inline void gbp_tiles_decodeScalar(uint8_t *rowBuff, const int tileLineOffset, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
 {
     gbp_tiles_toBuff(
-                        (uint8_t *)gbp_tiles->bmpLineBuffer,
+                        rowBuff,
                         GBP_TILE_PIXEL_HEIGHT * GBP_TILE_PIXEL_WIDTH * GBP_TILES_PER_LINE,
                         GBP_TILES_PER_LINE,
-                        gbp_tiles->tileLineOffset,
-                        gbp_tiles->tileRowOffset,
+                        tileLineOffset,
+                        0,
                         tileBuff);
+}
+
+static void gbp_tiles_decode(gbp_tile_t *gbp_tiles, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
+{
+    uint8_t *rowBuff = gbp_tiles_rowBuff(gbp_tiles, gbp_tiles->tileRowOffset, true);
+    if (!rowBuff)
+        return; // Out of tile row storage, tile dropped
+
+#if GBP_TILES_DECODER == GBP_TILES_DECODER_SCALAR
+    gbp_tiles_decodeScalar(rowBuff, gbp_tiles->tileLineOffset, tileBuff);
+#else
+    uint8_t *dst = rowBuff + (gbp_tiles->tileLineOffset * GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(GBP_TILE_PIXEL_WIDTH));
+#if GBP_TILES_CACHE
+    gbp_tiles_cacheDecode(&gbp_tiles->cache, dst, tileBuff);
+#else
+    gbp_tiles_tileToLines(dst, GBP_TILES_LINE_SIZE_B, tileBuff);
+#endif
+#endif
+}
+
+const char *gbp_tiles_decoder_name(void)
+{
+#if GBP_TILES_DECODER == GBP_TILES_DECODER_SCALAR
+    return "scalar";
+#elif GBP_TILES_DECODER == GBP_TILES_DECODER_LUT
+    return "lut";
+#elif GBP_TILES_SSE2
+    return "sse2";
+#else
+    return "swar";
+#endif
+}
+
+void gbp_tiles_cacheCounts(const gbp_tile_t *gbp_tiles, uint64_t *hits, uint64_t *misses)
+{
+    // Tile cache hits and misses so far (Both zero if the cache is compiled out)
+#if GBP_TILES_CACHE
+    *hits = gbp_tiles->cache.hits;
+    *misses = gbp_tiles->cache.misses;
+#else
+    (void)gbp_tiles;
+    *hits = 0;
+    *misses = 0;
+#endif
+}
+
+static bool gbp_tiles_line_advance(gbp_tile_t *gbp_tiles)
+{
     gbp_tiles->tileLineOffset++;
     if (gbp_tiles->tileLineOffset >= GBP_TILES_PER_LINE)
     {
         // Enough tiles decoded to output a fully decoded line
         gbp_tiles->tileLineOffset = 0;
-        gbp_tiles->tileRowOffset++;
+        if (gbp_tiles->tileRowOffset < GBP_TILES_ROW_MAX)
+            gbp_tiles->tileRowOffset++;
+        GBP_TRACE(row_complete, gbp_tiles->tileRowOffset, 0);
         return true;
     }
 
@@ -85,6 +318,57 @@ bool gbp_tiles_line_decoder(gbp_tile_t *gbp_tiles, const uint8_t tileBuff[GBP_TI
     return false;
 }
 
+bool gbp_tiles_line_decoder(gbp_tile_t *gbp_tiles, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
+{
+    gbp_tiles_decode(gbp_tiles, tileBuff);
+    return gbp_tiles_line_advance(gbp_tiles);
+}
+
+// Reference decoder (Always the per pixel gbp_tiles_toBuff() whatever GBP_TILES_DECODER is, for benchmarks)
+bool gbp_tiles_line_decoder_scalar(gbp_tile_t *gbp_tiles, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE])
+{
+    uint8_t *rowBuff = gbp_tiles_rowBuff(gbp_tiles, gbp_tiles->tileRowOffset, true);
+    if (rowBuff)
+        gbp_tiles_decodeScalar(rowBuff, gbp_tiles->tileLineOffset, tileBuff);
+    return gbp_tiles_line_advance(gbp_tiles);
+}
+
+uint16_t gbp_tiles_line_decoder_bulk(gbp_tile_t *gbp_tiles, const uint8_t tiles[], const size_t tileCount)
+{
+    // Decode a run of contiguous tiles (e.g. a whole data packet). Returns number of lines completed
+    uint16_t lineCount = 0;
+    size_t i = 0;
+    while (i < tileCount)
+    {
+        if ((gbp_tiles->tileLineOffset == 0) && ((tileCount - i) >= GBP_TILES_PER_LINE))
+        {
+            // Whole row in one go
+            gbp_tiles_row_decoder(gbp_tiles, &tiles[i * GBP_TILE_SIZE_IN_BYTE]);
+            i += GBP_TILES_PER_LINE;
+            lineCount++;
+            continue;
+        }
+        if (gbp_tiles_line_decoder(gbp_tiles, &tiles[i * GBP_TILE_SIZE_IN_BYTE]))
+            lineCount++;
+        i++;
+    }
+    return lineCount;
+}
+
+void gbp_tiles_row_decoder(gbp_tile_t *gbp_tiles, const uint8_t tiles[GBP_TILES_PER_LINE * GBP_TILE_SIZE_IN_BYTE])
+{
+    // Decode a full row of tiles (Must be at the start of a row)
+    for (int i = 0; i < GBP_TILES_PER_LINE; i++)
+    {
+        gbp_tiles->tileLineOffset = i;
+        gbp_tiles_decode(gbp_tiles, &tiles[i * GBP_TILE_SIZE_IN_BYTE]);
+    }
+    gbp_tiles->tileLineOffset = 0;
+    if (gbp_tiles->tileRowOffset < GBP_TILES_ROW_MAX)
+        gbp_tiles->tileRowOffset++;
+    GBP_TRACE(row_complete, gbp_tiles->tileRowOffset, 0);
+}
+
 /*****************************************************************************/
 
 void gbp_tiles_reset(gbp_tile_t *gbp_tiles)
@@ -95,6 +379,19 @@ void gbp_tiles_reset(gbp_tile_t *gbp_tiles)
     gbp_tiles->tileRowOffsetHarmonised =0;
 }
 
+void gbp_tiles_free(gbp_tile_t *gbp_tiles)
+{
+    // Release extra tile row blocks
+    for (int i = 0; i < gbp_tiles->rowBlockPoolSize; i++)
+    {
+        free(gbp_tiles->rowBlockPool[i]);
+    }
+    free(gbp_tiles->rowBlockPool);
+    gbp_tiles->rowBlockPool = NULL;
+    gbp_tiles->rowBlockPoolSize = 0;
+    gbp_tiles_reset(gbp_tiles);
+}
+
 void gbp_tiles_print(gbp_tile_t *gbp_tiles, uint8_t sheet, uint8_t linefeed, uint8_t pallet, uint8_t density)
 {
     (void)gbp_tiles;
@@ -103,30 +400,25 @@ void gbp_tiles_print(gbp_tile_t *gbp_tiles, uint8_t sheet, uint8_t linefeed, uin
     (void)pallet;
     (void)density;
 
+    GBP_TRACE(print, ((uint32_t) sheet << 8) | linefeed, ((uint32_t) pallet << 8) | density);
+
     /* Harmonise Pallete */
     // Ref: https://github.com/Raphael-Boichot/The-Arduino-SD-Game-Boy-Printer#some-technical-facts
     // Palette 0x00 has the same effect than palette 0xE4 (the mainly encountered palette in games)
-    uint8_t tonePallet[GBP_TILE_MAX_TONES] = {0};
+    // Dev Note: Decoded pixels are left as is. The palette is recorded per tile row and
+    //           applied while rendering (e.g. gbp_bmp_add()), so pixels are only touched once.
     pallet = (pallet == 0x00) ? 0xE4 : pallet;
-    tonePallet[0] = ((pallet >> 0) & 0b11);
-    tonePallet[1] = ((pallet >> 2) & 0b11);
-    tonePallet[2] = ((pallet >> 4) & 0b11);
-    tonePallet[3] = ((pallet >> 6) & 0b11);
-    const int startH = GBP_TILE_PIXEL_HEIGHT * gbp_tiles->tileRowOffsetHarmonised;
-    const int endH   = GBP_TILE_PIXEL_HEIGHT * gbp_tiles->tileRowOffset;
-
-    if (startH > endH)
+    const int startRow = gbp_tiles->tileRowOffsetHarmonised;
+    const int endRow   = gbp_tiles->tileRowOffset;
+
+    if (startRow > endRow)
         return;
 
-    for (int j = startH; j < endH; j++)
+    for (int j = startRow; j < endRow; j++)
     {
-        for (int i = 0; i < GBP_TILE_PIXEL_WIDTH * GBP_TILES_PER_LINE; i++)
-        {
-            const uint8_t pixel = 0b11 & (gbp_tiles->bmpLineBuffer[j][GBP_TILE_2BIT_LINEPACK_INDEX(i)] >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(i));
-            const uint8_t harmonised = tonePallet[pixel & 0b11];
-            gbp_tiles->bmpLineBuffer[j][GBP_TILE_2BIT_LINEPACK_INDEX(i)] &= ~(0b11 << GBP_TILE_2BIT_LINEPACK_BITOFFSET(i));
-            gbp_tiles->bmpLineBuffer[j][GBP_TILE_2BIT_LINEPACK_INDEX(i)] |= (harmonised << GBP_TILE_2BIT_LINEPACK_BITOFFSET(i));
-        }
+        gbp_tiles_rowBlock_t *rowBlock = gbp_tiles_rowBlock(gbp_tiles, j, false);
+        if (rowBlock)
+            rowBlock->tileRowPallet[j % GBP_TILES_PER_ROW] = pallet;
     }
     gbp_tiles->tileRowOffsetHarmonised = gbp_tiles->tileRowOffset;
 }
@@ -22,6 +22,9 @@
  *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#ifndef GBP_TILES_H
+#define GBP_TILES_H
+
 #include <stdint.h> // uint8_t
 #include <stddef.h> // size_t
 #include <stdbool.h> // bool
@@ -56,6 +59,68 @@
 #define GBP_TILE_2BIT_LINEPACK_IN_BYTE_COUNT (4) ///< 4 2bit pixel in 8bit byte
 #define GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(byteCount) (byteCount/4) ///< Row sized when 2bit packed is reduced by factor of 4
 
+// Tile decoder kernel (Compile time selectable e.g. `-DGBP_TILES_DECODER=GBP_TILES_DECODER_SCALAR`)
+#define GBP_TILES_DECODER_SCALAR 0 ///< Original per pixel decoder (Reference)
+#define GBP_TILES_DECODER_LUT    1 ///< 256 entry lookup table per tile byte
+#define GBP_TILES_DECODER_SIMD   2 ///< Bit shuffle of whole tiles (SSE2 or 64bit SWAR)
+#define GBP_TILES_DECODER_SWAR   3 ///< Bit shuffle of whole tiles, 64bit SWAR even where SSE2 is available
+#ifndef GBP_TILES_DECODER
+#define GBP_TILES_DECODER GBP_TILES_DECODER_SIMD
+#endif
+
+// Tile cache of decoded tiles (LUT and SIMD decoders only, `-DGBP_TILES_CACHE=1` to enable)
+#ifndef GBP_TILES_CACHE
+#define GBP_TILES_CACHE 0
+#endif
+#if GBP_TILES_DECODER == GBP_TILES_DECODER_SCALAR
+#undef GBP_TILES_CACHE
+#define GBP_TILES_CACHE 0 // The reference decoder is never cached
+#endif
+#define GBP_TILES_CACHE_BITS 8 ///< 256 entries (8KiB)
+
+#define GBP_TILES_LINE_SIZE_B GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(GBP_TILE_PIXEL_WIDTH * GBP_TILES_PER_LINE) ///< Packed bytes per pixel line
+#define GBP_TILES_ROW_MAX 0xFFFF ///< Tile rows that can be held between print commands (Rows beyond this are dropped)
+
+/*
+    Dev Note: Tile row store
+    Decoded tile rows are kept in blocks of GBP_TILES_PER_ROW tile rows. The first block is part of gbp_tile_t
+    (Same size as a real printer buffer) and further blocks are only allocated if more rows arrive before
+    a print command (e.g. long banner prints or senders that do not wait on INQUIRY).
+    Blocks are kept in a pool and reused after gbp_tiles_reset(), so the memory used is set by the
+    longest stretch between two print commands and not by the overall length of the print.
+*/
+typedef struct
+{
+    // Print palette of each decoded tile row (Set by gbp_tiles_print(), applied on output)
+    uint8_t tileRowPallet[GBP_TILES_PER_ROW];
+
+    // Each array entry represents a decoded 2bit pixel
+    uint8_t bmpLineBuffer[GBP_TILE_PIXEL_HEIGHT * GBP_TILES_PER_ROW][GBP_TILES_LINE_SIZE_B];
+} gbp_tiles_rowBlock_t;
+
+/*
+    Dev Note: Tile cache
+    Printouts repeat a lot of tiles (blank paper, borders, fonts), so decoded tiles are kept in a small
+    direct mapped cache keyed on a hash of the 16 tile bytes. A hit copies the 8 packed lines instead of
+    decoding them. Each entry holds its whole tile as the key, so a hash collision is just a miss.
+    A zeroed cache is valid as is (The all zero tile decodes to all zero lines).
+    Off by default: the hash, compare and copy cost about as much as the SSE2/LUT decode they replace, and
+    the hit or miss branch is unpredictable, so `make bench` showed it slower per tile despite 50-80% hits.
+    It pays off where decoding a tile is expensive (e.g. a port of this decoder to a small micro).
+*/
+typedef struct
+{
+    uint64_t tile[GBP_TILE_SIZE_IN_BYTE / sizeof(uint64_t)]; ///< Key (The tile bytes)
+    uint8_t lines[GBP_TILE_PIXEL_HEIGHT * GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(GBP_TILE_PIXEL_WIDTH)]; ///< Packed lines back to back
+} gbp_tiles_cacheEntry_t;
+
+typedef struct
+{
+    gbp_tiles_cacheEntry_t entry[1 << GBP_TILES_CACHE_BITS];
+    uint64_t hits;
+    uint64_t misses;
+} gbp_tiles_cache_t;
+
 typedef struct
 {
     // This is the tile to bmp decoder
@@ -63,10 +128,29 @@ typedef struct
     uint16_t tileRowOffset;
     uint16_t tileRowOffsetHarmonised;
 
-    // Each array entry represents a decoded 2bit pixel
-    uint8_t bmpLineBuffer[GBP_TILE_PIXEL_HEIGHT * GBP_TILES_PER_ROW][GBP_TILE_2BIT_LINEPACK_ROWSIZE_B(GBP_TILE_PIXEL_WIDTH * GBP_TILES_PER_LINE)];
+    // Tile row store
+    gbp_tiles_rowBlock_t rowBlock;          ///< First block of tile rows
+    gbp_tiles_rowBlock_t **rowBlockPool;    ///< Extra blocks (index 0 is the second block of tile rows)
+    uint16_t rowBlockPoolSize;
+
+#if GBP_TILES_CACHE
+    gbp_tiles_cache_t cache;                ///< Kept across gbp_tiles_reset()
+#endif
 } gbp_tile_t;
 
+// Tone of a decoded 2bit pixel after applying a print palette
+#define GBP_TILES_PALLET_TONE(pallet, pixel) (((pallet) >> (2 * ((pixel) & 0b11))) & 0b11)
+
 bool gbp_tiles_line_decoder(gbp_tile_t *gbp_tiles, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE]);
+bool gbp_tiles_line_decoder_scalar(gbp_tile_t *gbp_tiles, const uint8_t tileBuff[GBP_TILE_SIZE_IN_BYTE]);
+uint16_t gbp_tiles_line_decoder_bulk(gbp_tile_t *gbp_tiles, const uint8_t tiles[], const size_t tileCount);
+void gbp_tiles_row_decoder(gbp_tile_t *gbp_tiles, const uint8_t tiles[GBP_TILES_PER_LINE * GBP_TILE_SIZE_IN_BYTE]);
+const char *gbp_tiles_decoder_name(void);
+void gbp_tiles_cacheCounts(const gbp_tile_t *gbp_tiles, uint64_t *hits, uint64_t *misses);
 void gbp_tiles_reset(gbp_tile_t *gbp_tiles);
-void gbp_tiles_print(gbp_tile_t *gbp_tiles, uint8_t sheet, uint8_t linefeed, uint8_t pallet, uint8_t density);
\ No newline at end of file
+void gbp_tiles_free(gbp_tile_t *gbp_tiles);
+const uint8_t *gbp_tiles_rowLines(gbp_tile_t *gbp_tiles, const uint16_t tileRow);
+uint8_t gbp_tiles_rowPallet(gbp_tile_t *gbp_tiles, const uint16_t tileRow);
+void gbp_tiles_print(gbp_tile_t *gbp_tiles, uint8_t sheet, uint8_t linefeed, uint8_t pallet, uint8_t density);
+
+#endif // GBP_TILES_H
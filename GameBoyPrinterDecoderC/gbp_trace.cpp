@@ -0,0 +1,169 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decoder Tracing
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on recording hot path events (USDT probes and an in memory ring)
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "gbp_stats.h"
+#include "gbp_trace.h"
+
+typedef struct
+{
+  uint64_t seq;      ///< Event index + 1 once the slot is written (0 while being written)
+  uint64_t ns;
+  uint32_t tid;
+  uint16_t id;
+  uint16_t reserved;
+  uint32_t arg0;
+  uint32_t arg1;
+} gbp_trace_slot_t;
+
+bool gbp_trace_on = false;
+
+static gbp_trace_slot_t *gbp_trace_ring = NULL;
+static uint64_t gbp_trace_mask = 0;
+static uint64_t gbp_trace_head = 0;    ///< Events claimed so far
+static uint64_t gbp_trace_startNs = 0;
+
+static uint32_t gbp_trace_tid(void)
+{
+  static thread_local uint32_t tid = 0;
+  if (tid == 0)
+    tid = (uint32_t) syscall(SYS_gettid);
+  return tid;
+}
+
+bool gbp_trace_start(size_t capacity)
+{
+  // Capacity is rounded up to a power of two
+  size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+
+  gbp_trace_stop();
+  free(gbp_trace_ring);
+  gbp_trace_ring = (gbp_trace_slot_t *) calloc(size, sizeof(gbp_trace_slot_t));
+  if (!gbp_trace_ring)
+    return false;
+  gbp_trace_mask = size - 1;
+  gbp_trace_head = 0;
+  gbp_trace_startNs = gbp_stats_nowNs();
+  __atomic_store_n(&gbp_trace_on, true, __ATOMIC_RELEASE);
+  return true;
+}
+
+void gbp_trace_stop(void)
+{
+  // Events already in progress on other threads may still land, stop those threads first
+  __atomic_store_n(&gbp_trace_on, false, __ATOMIC_RELEASE);
+}
+
+void gbp_trace_event(const gbp_trace_id_t id, const uint32_t arg0, const uint32_t arg1)
+{
+  // Lock free: every event claims its own slot, oldest events are overwritten
+  const uint64_t index = __atomic_fetch_add(&gbp_trace_head, 1, __ATOMIC_RELAXED);
+  gbp_trace_slot_t *slot = &gbp_trace_ring[index & gbp_trace_mask];
+  __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+  slot->ns = gbp_stats_nowNs();
+  slot->tid = gbp_trace_tid();
+  slot->id = (uint16_t) id;
+  slot->arg0 = arg0;
+  slot->arg1 = arg1;
+  __atomic_store_n(&slot->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t gbp_trace_dropped(void)
+{
+  const uint64_t head = __atomic_load_n(&gbp_trace_head, __ATOMIC_ACQUIRE);
+  const uint64_t capacity = gbp_trace_mask + 1;
+  return (gbp_trace_ring && (head > capacity)) ? (head - capacity) : 0;
+}
+
+static void gbp_trace_chromeEvent(FILE *f, const gbp_trace_slot_t *slot, const int pid, const bool first)
+{
+  const double ts = (slot->ns - gbp_trace_startNs) / 1000.0; // Chrome trace time is in microseconds
+  fprintf(f, "%s\n{\"pid\":%d,\"tid\":%u,\"ts\":%.3f,", first ? "" : ",", pid, (unsigned) slot->tid, ts);
+  switch ((gbp_trace_id_t) slot->id)
+  {
+    case GBP_TRACE_ID_packet_start:
+      fprintf(f, "\"ph\":\"B\",\"name\":\"packet\",\"args\":{\"command\":%u,\"dataLength\":%u}}",
+          (unsigned) slot->arg0, (unsigned) slot->arg1);
+      break;
+    case GBP_TRACE_ID_packet_end:
+      fprintf(f, "\"ph\":\"E\",\"name\":\"packet\",\"args\":{\"command\":%u,\"checksumOk\":%u}}",
+          (unsigned) slot->arg0, (unsigned) slot->arg1);
+      break;
+    case GBP_TRACE_ID_tile_ready:
+      fprintf(f, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"tile_ready\",\"args\":{\"tiles\":%u}}", (unsigned) slot->arg0);
+      break;
+    case GBP_TRACE_ID_row_complete:
+      fprintf(f, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"row_complete\",\"args\":{\"row\":%u}}", (unsigned) slot->arg0);
+      break;
+    case GBP_TRACE_ID_print:
+      fprintf(f, "\"ph\":\"i\",\"s\":\"p\",\"name\":\"print\",\"args\":{\"sheets\":%u,\"linefeed\":%u,\"pallet\":%u,\"density\":%u}}",
+          (unsigned) (slot->arg0 >> 8) & 0xFF, (unsigned) slot->arg0 & 0xFF, (unsigned) (slot->arg1 >> 8) & 0xFF, (unsigned) slot->arg1 & 0xFF);
+      break;
+    case GBP_TRACE_ID_image_close:
+      fprintf(f, "\"ph\":\"i\",\"s\":\"p\",\"name\":\"image_close\",\"args\":{\"width\":%u,\"height\":%u}}",
+          (unsigned) slot->arg0, (unsigned) slot->arg1);
+      break;
+    default:
+      fprintf(f, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"?\"}");
+      break;
+  }
+}
+
+bool gbp_trace_dumpChrome(const char *filename)
+{
+  // Call after gbp_trace_stop() and once the decoding threads are done
+  if (!gbp_trace_ring)
+    return false;
+  FILE *f = fopen(filename, "w");
+  if (!f)
+    return false;
+
+  const uint64_t head = __atomic_load_n(&gbp_trace_head, __ATOMIC_ACQUIRE);
+  const uint64_t capacity = gbp_trace_mask + 1;
+  const uint64_t first = (head > capacity) ? (head - capacity) : 0;
+  const int pid = (int) getpid();
+  bool none = true;
+
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"events\":%llu,\"dropped\":%llu},\"traceEvents\":[",
+      (unsigned long long) head, (unsigned long long) first);
+  for (uint64_t i = first; i < head; i++)
+  {
+    const gbp_trace_slot_t *slot = &gbp_trace_ring[i & gbp_trace_mask];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (i + 1))
+      continue; // Torn or overwritten
+    gbp_trace_chromeEvent(f, slot, pid, none);
+    none = false;
+  }
+  fprintf(f, "\n]}\n");
+  return fclose(f) == 0;
+}
@@ -0,0 +1,96 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decoder Tracing
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This module focus on recording hot path events (USDT probes and an in memory ring)
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_TRACE_H
+#define GBP_TRACE_H
+
+#include <stdint.h> // uint8_t
+#include <stddef.h> // size_t
+#include <stdbool.h> // bool
+
+/*
+    Dev Note: Trace points
+    | Probe (gbpdecode:*) | Where                                     | arg0                  | arg1                   |
+    |---------------------|-------------------------------------------|-----------------------|------------------------|
+    | packet_start        | gbp_pkt_processByte() header received     | command               | dataLength             |
+    | packet_end          | gbp_pkt_processByte() last byte received  | command               | checksumOk             |
+    | tile_ready          | gbp_pkt tile accumulator or tileDirect    | tiles                 | 0                      |
+    | row_complete        | gbp_tiles line/row decoder                | tile row              | 0                      |
+    | print               | gbp_tiles_print()                         | sheets << 8 | linefeed | pallet << 8 | density |
+    | image_close         | gbp_bmp_render() / gbp_png_render()       | width                 | height                 |
+
+    Two independent sinks, both optional:
+    * USDT: Built with GBP_TRACE_USDT=1 (make TRACE=usdt, needs <sys/sdt.h>). Each probe is a nop
+      until perf or bpftrace attaches, e.g. `bpftrace -e 'usdt:./gpbdecoder:gbpdecode:print { @[arg1 & 0xFF] = count(); }'`
+    * Ring: A fixed size lock free ring of the latest events in memory, started with
+      gbp_trace_start() (e.g. gpbdecoder --trace=FILE) and written out as Chrome trace JSON
+      (chrome://tracing or https://ui.perfetto.dev). When not started each trace point is
+      one predictable branch.
+    Defining GBP_TRACE_DISABLE compiles both out.
+*/
+
+typedef enum
+{
+  GBP_TRACE_ID_packet_start,
+  GBP_TRACE_ID_packet_end,
+  GBP_TRACE_ID_tile_ready,
+  GBP_TRACE_ID_row_complete,
+  GBP_TRACE_ID_print,
+  GBP_TRACE_ID_image_close,
+  GBP_TRACE_ID_COUNT
+} gbp_trace_id_t;
+
+#define GBP_TRACE_DEFAULT_EVENTS (1u << 20) ///< Ring capacity (Power of two, 32 bytes per event)
+
+extern bool gbp_trace_on;
+
+bool gbp_trace_start(size_t capacity);
+void gbp_trace_stop(void);
+void gbp_trace_event(const gbp_trace_id_t id, const uint32_t arg0, const uint32_t arg1);
+uint64_t gbp_trace_dropped(void);
+bool gbp_trace_dumpChrome(const char *filename);
+
+#if defined(GBP_TRACE_USDT) && GBP_TRACE_USDT && !defined(GBP_TRACE_DISABLE)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define GBP_TRACE_USDT_PROBE(name, arg0, arg1) DTRACE_PROBE2(gbpdecode, name, arg0, arg1)
+#else
+#error "GBP_TRACE_USDT needs <sys/sdt.h> (e.g. systemtap-sdt-dev)"
+#endif
+#else
+#define GBP_TRACE_USDT_PROBE(name, arg0, arg1) do {} while (0)
+#endif
+
+#ifndef GBP_TRACE_DISABLE
+#define GBP_TRACE(name, arg0, arg1) \
+  do { \
+    GBP_TRACE_USDT_PROBE(name, arg0, arg1); \
+    if (__builtin_expect(__atomic_load_n(&gbp_trace_on, __ATOMIC_RELAXED), 0)) \
+      gbp_trace_event(GBP_TRACE_ID_##name, (uint32_t) (arg0), (uint32_t) (arg1)); \
+  } while (0)
+#else
+#define GBP_TRACE(name, arg0, arg1) do {} while (0)
+#endif
+
+#endif // GBP_TRACE_H
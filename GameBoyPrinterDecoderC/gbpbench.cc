@@ -0,0 +1,606 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decoder Benchmark
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This program times each decode kernel in isolation on a fixed set of captures
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "gameboy_printer_protocol.h"
+#include "gbp_hex.h"
+#include "gbp_pkt.h"
+#include "gbp_tiles.h"
+#include "gbp_bmp.h"
+#include "gbp_stats.h"
+
+/* The official name of this program (e.g., no 'g' prefix).  */
+#define PROGRAM_NAME "gbpbench"
+
+/*
+    Dev Note: Method
+    * All captures are read and split up front (hex text, packet bytes, DATA payloads by compression,
+      decompressed tiles and one printer buffer worth of decoded tile rows), so no kernel touches a file.
+    * Each kernel is one pass over its corpus. A repetition runs enough passes to take at least
+      GBPBENCH_REP_NS (calibrated once), and reports the time of one pass.
+    * After the warmup repetitions, median and p99 of the repetitions are reported per byte of input
+      (hex text for hex_decode, packet bytes for pkt_processByte, payload bytes for pkt_decompressor,
+      header bytes for bmp_header), per 8x8 tile and per call.
+    * Build with optimisation and without sanitizers (`make bench` does this).
+*/
+
+#define GBPBENCH_REP_NS       (2 * 1000 * 1000) ///< Minimum time of one repetition
+#define GBPBENCH_WARMUP       3
+#define GBPBENCH_REPS         51
+#define GBPBENCH_PRINT_OPS    64   ///< gbp_tiles_print() calls per pass
+#define GBPBENCH_HEADER_OPS   1024 ///< bmp_header() calls per pass
+
+/******************************************************************************/
+
+typedef struct
+{
+  uint8_t *data;
+  size_t size;
+  size_t max;
+} gbpbench_buffer_t;
+
+typedef struct
+{
+  gbpbench_buffer_t data;    ///< Payloads back to back
+  gbpbench_buffer_t lengths; ///< uint32_t length of each payload
+  uint64_t tiles;            ///< Tiles the payloads decompress to
+} gbpbench_payloads_t;
+
+typedef struct
+{
+  const char *name;
+  void (*run)(void);
+  uint64_t bytes; ///< Input bytes per pass (0: not applicable)
+  uint64_t tiles; ///< Tiles per pass (0: not applicable)
+  uint64_t ops;   ///< Calls per pass
+} gbpbench_kernel_t;
+
+typedef struct
+{
+  uint32_t passes; ///< Passes per repetition
+  uint64_t medianNs;
+  uint64_t p99Ns;
+  uint64_t minNs;
+} gbpbench_result_t;
+
+// Corpus
+static gbpbench_buffer_t text = {};    ///< Ascii hex captures
+static gbpbench_buffer_t bytes = {};   ///< Decoded packet bytes
+static gbpbench_buffer_t scratch = {}; ///< Output of hex_decode
+static gbpbench_payloads_t payloadsRaw = {};
+static gbpbench_payloads_t payloadsRle = {};
+static gbpbench_buffer_t tiles = {};   ///< Decompressed tiles (16 bytes each)
+static gbp_tile_t block = {};          ///< Up to one printer buffer of decoded tile rows
+static gbp_tile_t decodeTiles = {};
+static gbp_bmp_t bmp24 = {};
+static gbp_bmp_t bmp2 = {};
+static const uint32_t palletColor[4] = {0xFFFFFF, 0xAAAAAA, 0x555555, 0x000000};
+
+// Results are folded into this, so the compiler cannot drop a kernel
+static volatile uint64_t sink = 0;
+
+static bool verbose_flag = false;
+
+/*******************************************************************************
+ * Corpus
+*******************************************************************************/
+
+static bool gbpbench_append(gbpbench_buffer_t *buffer, const void *data, const size_t size)
+{
+  if ((buffer->size + size) > buffer->max)
+  {
+    size_t max = buffer->max ? buffer->max : (64 * 1024);
+    while (max < (buffer->size + size))
+      max *= 2;
+    uint8_t *grown = (uint8_t *) realloc(buffer->data, max);
+    if (!grown)
+      return false;
+    buffer->data = grown;
+    buffer->max = max;
+  }
+  memcpy(&buffer->data[buffer->size], data, size);
+  buffer->size += size;
+  return true;
+}
+
+static bool gbpbench_readFile(const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  if (!f)
+    return false;
+  uint8_t block[64 * 1024];
+  size_t n;
+  bool ok = true;
+  while (ok && ((n = fread(block, 1, sizeof(block), f)) > 0))
+    ok = gbpbench_append(&text, block, n);
+  fclose(f);
+  // Captures are joined, so make sure one never runs into the next
+  return ok && gbpbench_append(&text, "\n", 1);
+}
+
+static uint64_t gbpbench_decompressTiles(const uint8_t *payload, const size_t size, const bool compression, gbpbench_buffer_t *out)
+{
+  gbp_pkt_t pkt = {};
+  gbp_pkt_tileAcc_t tileBuff = {};
+  pkt.compression = compression;
+  uint64_t count = 0;
+  while (gbp_pkt_decompressor(&pkt, payload, size, &tileBuff))
+  {
+    if (gbp_pkt_tileAccu_tileReadyCheck(&tileBuff))
+    {
+      if (out)
+        gbpbench_append(out, tileBuff.tile, GBP_TILE_SIZE_IN_BYTE);
+      count++;
+    }
+  }
+  return count;
+}
+
+static bool gbpbench_corpus(void)
+{
+  // Ascii hex --> packet bytes
+  gbp_hex_t hex;
+  gbp_hex_init(&hex);
+  scratch.max = GBP_HEX_OUTPUT_MAX(text.size);
+  scratch.data = (uint8_t *) malloc(scratch.max);
+  bytes.max = scratch.max;
+  bytes.data = (uint8_t *) malloc(bytes.max);
+  if (!scratch.data || !bytes.data)
+    return false;
+  bytes.size = gbp_hex_decode(&hex, (const char *) text.data, text.size, bytes.data);
+
+  // Packet bytes --> DATA payloads (Whole packets, so payloads are never streamed)
+  static uint8_t payload[GBP_PKT_PAYLOAD_BUFF_SIZE_WHOLE_PACKET];
+  uint16_t payloadSize = 0;
+  gbp_pkt_t pkt;
+  gbp_pkt_init(&pkt);
+  for (size_t i = 0; i < bytes.size; i++)
+  {
+    if (!gbp_pkt_processByte(&pkt, bytes.data[i], payload, &payloadSize, sizeof(payload)))
+      continue;
+    if ((pkt.received != GBP_REC_GOT_PACKET) || (pkt.command != GBP_COMMAND_DATA) || (pkt.dataLength == 0))
+      continue;
+    gbpbench_payloads_t *payloads = pkt.compression ? &payloadsRle : &payloadsRaw;
+    const uint32_t length = pkt.dataLength;
+    gbpbench_append(&payloads->data, payload, length);
+    gbpbench_append(&payloads->lengths, &length, sizeof(length));
+    payloads->tiles += gbpbench_decompressTiles(payload, length, pkt.compression, &tiles);
+  }
+
+  // Tiles --> decoded tile rows
+  const size_t tileCount = tiles.size / GBP_TILE_SIZE_IN_BYTE;
+  for (size_t i = 0; (i < tileCount) && (block.tileRowOffset < GBP_TILES_PER_ROW); i++)
+    gbp_tiles_line_decoder(&block, &tiles.data[i * GBP_TILE_SIZE_IN_BYTE]);
+
+  // Images are never opened, so gbp_bmp_add() converts pixels without writing
+  bmp24.bmpSizeWidth = GBP_BMP_WIDTH;
+  bmp24.bitsPerPixel = 24;
+  bmp2.bmpSizeWidth = GBP_BMP_WIDTH;
+  bmp2.bitsPerPixel = 2;
+  return true;
+}
+
+/*******************************************************************************
+ * Kernels (One pass over the corpus each)
+*******************************************************************************/
+
+static void gbpbench_hex_decode(void)
+{
+  gbp_hex_t hex;
+  gbp_hex_init(&hex);
+  sink += gbp_hex_decode(&hex, (const char *) text.data, text.size, scratch.data);
+}
+
+static void gbpbench_hex_decode_scalar(void)
+{
+  gbp_hex_t hex;
+  gbp_hex_init(&hex);
+  sink += gbp_hex_decode_scalar(&hex, (const char *) text.data, text.size, scratch.data);
+}
+
+static void gbpbench_pkt_processByte(void)
+{
+  // Tile sized payload chunks, same as the decoder default
+  uint8_t buffer[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE];
+  uint16_t bufferSize = 0;
+  gbp_pkt_t pkt;
+  gbp_pkt_init(&pkt);
+  uint64_t events = 0;
+  for (size_t i = 0; i < bytes.size; i++)
+  {
+    if (gbp_pkt_processByte(&pkt, bytes.data[i], buffer, &bufferSize, sizeof(buffer)))
+      events += bufferSize;
+  }
+  sink += events;
+}
+
+static void gbpbench_decompress(const gbpbench_payloads_t *payloads, const bool compression)
+{
+  const uint32_t *lengths = (const uint32_t *) payloads->lengths.data;
+  const size_t count = payloads->lengths.size / sizeof(uint32_t);
+  const uint8_t *payload = payloads->data.data;
+  uint64_t check = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    gbp_pkt_t pkt = {};
+    gbp_pkt_tileAcc_t tileBuff = {};
+    pkt.compression = compression;
+    while (gbp_pkt_decompressor(&pkt, payload, lengths[i], &tileBuff))
+    {
+      if (gbp_pkt_tileAccu_tileReadyCheck(&tileBuff))
+        check += tileBuff.tile[0];
+    }
+    payload += lengths[i];
+  }
+  sink += check;
+}
+
+static void gbpbench_pkt_decompressor_raw(void)
+{
+  gbpbench_decompress(&payloadsRaw, false);
+}
+
+static void gbpbench_pkt_decompressor_rle(void)
+{
+  gbpbench_decompress(&payloadsRle, true);
+}
+
+static void gbpbench_tiles_line_decoder(void)
+{
+  const size_t tileCount = tiles.size / GBP_TILE_SIZE_IN_BYTE;
+  gbp_tiles_reset(&decodeTiles);
+  for (size_t i = 0; i < tileCount; i++)
+  {
+    gbp_tiles_line_decoder(&decodeTiles, &tiles.data[i * GBP_TILE_SIZE_IN_BYTE]);
+    if (decodeTiles.tileRowOffset >= GBP_TILES_PER_ROW)
+      gbp_tiles_reset(&decodeTiles); // Stay within the first row block, like a print every 26 rows
+  }
+  sink += decodeTiles.rowBlock.bmpLineBuffer[0][0];
+}
+
+static void gbpbench_tiles_line_decoder_scalar(void)
+{
+  const size_t tileCount = tiles.size / GBP_TILE_SIZE_IN_BYTE;
+  gbp_tiles_reset(&decodeTiles);
+  for (size_t i = 0; i < tileCount; i++)
+  {
+    gbp_tiles_line_decoder_scalar(&decodeTiles, &tiles.data[i * GBP_TILE_SIZE_IN_BYTE]);
+    if (decodeTiles.tileRowOffset >= GBP_TILES_PER_ROW)
+      gbp_tiles_reset(&decodeTiles);
+  }
+  sink += decodeTiles.rowBlock.bmpLineBuffer[0][0];
+}
+
+static void gbpbench_tiles_line_decoder_bulk(void)
+{
+  const size_t tileCount = tiles.size / GBP_TILE_SIZE_IN_BYTE;
+  const size_t blockTiles = GBP_TILES_PER_ROW * GBP_TILES_PER_LINE;
+  for (size_t i = 0; i < tileCount; i += blockTiles)
+  {
+    gbp_tiles_reset(&decodeTiles);
+    gbp_tiles_line_decoder_bulk(&decodeTiles, &tiles.data[i * GBP_TILE_SIZE_IN_BYTE], (tileCount - i) < blockTiles ? (tileCount - i) : blockTiles);
+  }
+  sink += decodeTiles.rowBlock.bmpLineBuffer[0][0];
+}
+
+static void gbpbench_tiles_print(void)
+{
+  // Palette harmonisation of a full printer buffer
+  static const uint8_t pallets[4] = {0x00, 0xE4, 0x1B, 0xD2};
+  for (int i = 0; i < GBPBENCH_PRINT_OPS; i++)
+  {
+    block.tileRowOffsetHarmonised = 0;
+    gbp_tiles_print(&block, 1, 0x13, pallets[i & 3], 0x40);
+  }
+  sink += block.rowBlock.tileRowPallet[0];
+}
+
+static void gbpbench_bmp_set(void)
+{
+  // Reference per pixel path (bmp_set() of image/bmp_FixedWidthStream.h)
+  const uint8_t pallet = 0xE4;
+  for (int row = 0; row < block.tileRowOffset; row++)
+  {
+    const uint8_t *lines = gbp_tiles_rowLines(&block, row);
+    for (int y = 0; y < GBP_TILE_PIXEL_HEIGHT; y++)
+    {
+      const uint8_t *line = &lines[y * GBP_TILES_LINE_SIZE_B];
+      for (int x = 0; x < GBP_BMP_WIDTH; x++)
+      {
+        const uint8_t pixel = line[GBP_TILE_2BIT_LINEPACK_INDEX(x)] >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(x);
+        bmp_set(bmp24.bmpBuffer, GBP_BMP_WIDTH, x, y, palletColor[GBP_TILES_PALLET_TONE(pallet, pixel)]);
+      }
+    }
+  }
+  sink += bmp24.bmpBuffer[0];
+}
+
+static void gbpbench_bmp_add(void)
+{
+  for (int row = 0; row < block.tileRowOffset; row++)
+    gbp_bmp_add(&bmp24, gbp_tiles_rowLines(&block, row), GBP_BMP_WIDTH, GBP_TILE_PIXEL_HEIGHT, 0xE4, palletColor);
+  sink += bmp24.bmpBuffer[0];
+}
+
+static void gbpbench_bmp_add_indexed(void)
+{
+  for (int row = 0; row < block.tileRowOffset; row++)
+    gbp_bmp_add(&bmp2, gbp_tiles_rowLines(&block, row), GBP_BMP_WIDTH, GBP_TILE_PIXEL_HEIGHT, 0xE4, palletColor);
+  sink += bmp2.bmpBuffer[0];
+}
+
+static void gbpbench_bmp_header(void)
+{
+  unsigned char header[BMP_PIXEL_START_OFFSET];
+  for (int i = 0; i < GBPBENCH_HEADER_OPS; i++)
+  {
+    bmp_header(header, GBP_BMP_WIDTH, GBP_TILE_PIXEL_HEIGHT * (i + 1));
+    sink += header[2];
+  }
+}
+
+/*******************************************************************************
+ * Measurement
+*******************************************************************************/
+
+static int gbpbench_compare(const void *a, const void *b)
+{
+  const uint64_t x = *(const uint64_t *) a;
+  const uint64_t y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+static void gbpbench_measure(const gbpbench_kernel_t *kernel, const int warmup, const int reps, gbpbench_result_t *result)
+{
+  // Calibrate passes per repetition on one pass (Also the first warmup)
+  uint64_t start = gbp_stats_nowNs();
+  kernel->run();
+  const uint64_t once = gbp_stats_nowNs() - start;
+  uint64_t passes = (once > 0) ? (GBPBENCH_REP_NS + once - 1) / once : GBPBENCH_REP_NS;
+  passes = (passes < 1) ? 1 : (passes > 1000000) ? 1000000 : passes;
+
+  for (int w = 0; w < warmup; w++)
+    for (uint64_t p = 0; p < passes; p++)
+      kernel->run();
+
+  uint64_t *samples = (uint64_t *) calloc(reps, sizeof(uint64_t));
+  for (int r = 0; r < reps; r++)
+  {
+    start = gbp_stats_nowNs();
+    for (uint64_t p = 0; p < passes; p++)
+      kernel->run();
+    samples[r] = (gbp_stats_nowNs() - start) / passes;
+  }
+  qsort(samples, reps, sizeof(uint64_t), gbpbench_compare);
+  int p99 = (int) ceil(0.99 * reps) - 1;
+  result->passes = (uint32_t) passes;
+  result->minNs = samples[0];
+  result->medianNs = samples[reps / 2];
+  result->p99Ns = samples[(p99 < 0) ? 0 : p99];
+  free(samples);
+}
+
+static const char *gbpbench_per(char *buf, const size_t bufSize, const uint64_t ns, const uint64_t count, const char *none)
+{
+  // Time per unit, or `none` where the unit does not apply to a kernel
+  if (count == 0)
+    return none;
+  snprintf(buf, bufSize, "%.4f", (double) ns / (double) count);
+  return buf;
+}
+
+/*******************************************************************************
+ * Main
+*******************************************************************************/
+
+void gbpbench_help(void)
+{
+  printf (
+      "Usage: gbpbench [OPTION]... CAPTURE...\n"
+      "Times each decode kernel in isolation on the given ascii hex captures\n"
+      "\n"
+      "-w, --warmup=N       warmup repetitions per kernel (default: %d)\n"
+      "-r, --reps=N         timed repetitions per kernel (default: %d)\n"
+      "-k, --kernel=NAME    only run kernels whose name starts with NAME\n"
+      "-o, --output=FILE    append results as one line of JSON to FILE\n"
+      "-l, --label=LABEL    label stored with the JSON results (e.g. commit)\n"
+      "-v, --verbose        print corpus details\n"
+      "-h, --help           display this help and exit\n"
+      "\n"
+      "Examples:\n"
+      "  gbpbench -o /tmp/gbpbench.jsonl -l \"$(git describe --always --dirty)\" ./test/*.txt ../research/Captures/*/*.txt\n",
+      GBPBENCH_WARMUP, GBPBENCH_REPS
+    );
+}
+
+int
+main (int argc, char **argv)
+{
+  int warmup = GBPBENCH_WARMUP;
+  int reps = GBPBENCH_REPS;
+  const char *kernelFilter = NULL;
+  const char *ofilename = NULL;
+  const char *label = "";
+
+  int c;
+  static struct option const long_options[] =
+  {
+    {"warmup",  required_argument, NULL, 'w'},
+    {"reps",    required_argument, NULL, 'r'},
+    {"kernel",  required_argument, NULL, 'k'},
+    {"output",  required_argument, NULL, 'o'},
+    {"label",   required_argument, NULL, 'l'},
+    {"verbose", no_argument,       NULL, 'v'},
+    {"help",    no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  while ((c = getopt_long (argc, argv, "w:r:k:o:l:vh", long_options, NULL))
+         != -1)
+  {
+    switch (c)
+    {
+        case 'w':
+          warmup = atoi(optarg);
+          break;
+
+        case 'r':
+          reps = atoi(optarg);
+          break;
+
+        case 'k':
+          kernelFilter = optarg;
+          break;
+
+        case 'o':
+          ofilename = optarg;
+          break;
+
+        case 'l':
+          label = optarg;
+          break;
+
+        case 'v':
+          verbose_flag = true;
+          break;
+
+        case 'h':
+          gbpbench_help();
+          return 0;
+
+        default:
+          gbpbench_help();
+          return 1;
+    }
+  }
+
+  if ((optind >= argc) || (warmup < 0) || (reps < 1))
+  {
+    gbpbench_help();
+    return 1;
+  }
+
+  for (int i = optind; i < argc; i++)
+  {
+    if (!gbpbench_readFile(argv[i]))
+    {
+      printf("cannot read `%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  if (!gbpbench_corpus())
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+
+  const uint64_t tileCount = tiles.size / GBP_TILE_SIZE_IN_BYTE;
+  const uint64_t blockTiles = (uint64_t) block.tileRowOffset * GBP_TILES_PER_LINE;
+  const uint64_t blockTilesMax = GBP_TILES_PER_ROW * GBP_TILES_PER_LINE;
+  if (verbose_flag)
+  {
+    printf("Corpus: %d captures, %zu hex chars, %zu packet bytes\n", argc - optind, text.size, bytes.size);
+    printf("        raw payloads %zu bytes (%llu tiles), rle payloads %zu bytes (%llu tiles), %u tile rows for image kernels\n",
+        payloadsRaw.data.size, (unsigned long long) payloadsRaw.tiles,
+        payloadsRle.data.size, (unsigned long long) payloadsRle.tiles, (unsigned) block.tileRowOffset);
+  }
+
+  const gbpbench_kernel_t kernels[] =
+  {
+    {"hex_decode",               gbpbench_hex_decode,              text.size,              0,                   1},
+    {"hex_decode_scalar",        gbpbench_hex_decode_scalar,       text.size,              0,                   1},
+    {"pkt_processByte",          gbpbench_pkt_processByte,         bytes.size,             0,                   bytes.size},
+    {"pkt_decompressor_raw",     gbpbench_pkt_decompressor_raw,    payloadsRaw.data.size,  payloadsRaw.tiles,   payloadsRaw.lengths.size / sizeof(uint32_t)},
+    {"pkt_decompressor_rle",     gbpbench_pkt_decompressor_rle,    payloadsRle.data.size,  payloadsRle.tiles,   payloadsRle.lengths.size / sizeof(uint32_t)},
+    {"tiles_line_decoder",       gbpbench_tiles_line_decoder,      tileCount * GBP_TILE_SIZE_IN_BYTE, tileCount, tileCount},
+    {"tiles_line_decoder_scalar", gbpbench_tiles_line_decoder_scalar, tileCount * GBP_TILE_SIZE_IN_BYTE, tileCount, tileCount},
+    {"tiles_line_decoder_bulk",  gbpbench_tiles_line_decoder_bulk, tileCount * GBP_TILE_SIZE_IN_BYTE, tileCount, (tileCount + blockTilesMax - 1) / blockTilesMax},
+    {"tiles_print",              gbpbench_tiles_print,             0, blockTiles * GBPBENCH_PRINT_OPS, GBPBENCH_PRINT_OPS},
+    {"bmp_set",                  gbpbench_bmp_set,                 0, blockTiles,                      blockTiles * GBP_TILE_PIXEL_WIDTH * GBP_TILE_PIXEL_HEIGHT},
+    {"bmp_add",                  gbpbench_bmp_add,                 0, blockTiles,                      block.tileRowOffset},
+    {"bmp_add_indexed2",         gbpbench_bmp_add_indexed,         0, blockTiles,                      block.tileRowOffset},
+    {"bmp_header",               gbpbench_bmp_header,              BMP_PIXEL_START_OFFSET * GBPBENCH_HEADER_OPS, 0, GBPBENCH_HEADER_OPS},
+  };
+  const int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+
+  FILE *json = NULL;
+  if (ofilename)
+  {
+    json = fopen(ofilename, "a");
+    if (!json)
+    {
+      printf("cannot write `%s'\n", ofilename);
+      return 1;
+    }
+    fprintf(json, "{\"label\":\"%s\",\"tilesDecoder\":\"%s\",\"hexDecoder\":\"%s\",\"warmup\":%d,\"reps\":%d,\"corpusBytes\":%zu,\"kernels\":[",
+        label, gbp_tiles_decoder_name(), gbp_hex_simd_name(), warmup, reps, text.size);
+  }
+
+  printf("Tiles decoder: %s, hex decoder: %s, %d warmup, %d reps\n", gbp_tiles_decoder_name(), gbp_hex_simd_name(), warmup, reps);
+  printf("%-24s %8s %12s %12s %10s %10s %10s\n", "kernel", "passes", "median_ns", "p99_ns", "ns/byte", "ns/tile", "ns/op");
+  bool first = true;
+  for (int i = 0; i < kernelCount; i++)
+  {
+    const gbpbench_kernel_t *kernel = &kernels[i];
+    if (kernelFilter && (strncmp(kernel->name, kernelFilter, strlen(kernelFilter)) != 0))
+      continue;
+    if ((kernel->bytes == 0) && (kernel->tiles == 0))
+      continue; // Nothing in the corpus for this kernel (e.g. no compressed payloads)
+
+    gbpbench_result_t result;
+    gbpbench_measure(kernel, warmup, reps, &result);
+    char perByte[32], perTile[32], perOp[32];
+    printf("%-24s %8u %12llu %12llu %10s %10s %10s\n", kernel->name, (unsigned) result.passes,
+        (unsigned long long) result.medianNs, (unsigned long long) result.p99Ns,
+        gbpbench_per(perByte, sizeof(perByte), result.medianNs, kernel->bytes, "-"),
+        gbpbench_per(perTile, sizeof(perTile), result.medianNs, kernel->tiles, "-"),
+        gbpbench_per(perOp, sizeof(perOp), result.medianNs, kernel->ops, "-"));
+    if (json)
+    {
+      fprintf(json, "%s{\"name\":\"%s\",\"bytes\":%llu,\"tiles\":%llu,\"ops\":%llu,\"passes\":%u,"
+          "\"minNs\":%llu,\"medianNs\":%llu,\"p99Ns\":%llu,\"nsPerByte\":%s,\"nsPerTile\":%s,\"nsPerOp\":%s}",
+          first ? "" : ",", kernel->name, (unsigned long long) kernel->bytes, (unsigned long long) kernel->tiles,
+          (unsigned long long) kernel->ops, (unsigned) result.passes, (unsigned long long) result.minNs,
+          (unsigned long long) result.medianNs, (unsigned long long) result.p99Ns,
+          gbpbench_per(perByte, sizeof(perByte), result.medianNs, kernel->bytes, "null"),
+          gbpbench_per(perTile, sizeof(perTile), result.medianNs, kernel->tiles, "null"),
+          gbpbench_per(perOp, sizeof(perOp), result.medianNs, kernel->ops, "null"));
+    }
+    first = false;
+  }
+
+  if (json)
+  {
+    fprintf(json, "]}\n");
+    fclose(json);
+  }
+  return 0;
+}
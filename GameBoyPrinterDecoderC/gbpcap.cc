@@ -0,0 +1,305 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Capture Converter
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This program converts packet captures between ascii hex and binary .gbpcap
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "gbp_decode.h"
+#include "gbp_hex.h"
+#include "gbp_jobs.h"
+#include "gbp_cap.h"
+
+/* The official name of this program (e.g., no 'g' prefix).  */
+#define PROGRAM_NAME "gbpcap"
+
+/******************************************************************************/
+
+static bool list_flag = false;
+
+const char * ifilename = NULL;
+const char * ofilename = NULL;
+
+/******************************************************************************/
+
+typedef struct
+{
+  uint8_t *bytes;
+  size_t size;
+  size_t max;
+  bool ok;
+} gbpcap_capture_t;
+
+static void gbpcap_capture_gotBytes(void *user, const uint8_t *bytes, const size_t bytesSize)
+{
+  gbpcap_capture_t *capture = (gbpcap_capture_t *) user;
+  if (!capture->ok)
+    return;
+  if ((capture->size + bytesSize) > capture->max)
+  {
+    size_t max = capture->max ? capture->max : (1024 * 1024);
+    while (max < (capture->size + bytesSize))
+      max *= 2;
+    uint8_t *grown = (uint8_t *) realloc(capture->bytes, max);
+    if (!grown)
+    {
+      capture->ok = false;
+      return;
+    }
+    capture->bytes = grown;
+    capture->max = max;
+  }
+  memcpy(&capture->bytes[capture->size], bytes, bytesSize);
+  capture->size += bytesSize;
+}
+
+/*******************************************************************************
+ * Hex Text --> .gbpcap
+*******************************************************************************/
+
+static int gbpcap_fromHex(FILE *in, const char *outputFilename)
+{
+  gbpcap_capture_t capture = {NULL, 0, 0, true};
+  gbp_cap_writer_t writer;
+
+  gbp_hex_ingest(fileno(in), gbpcap_capture_gotBytes, &capture);
+  if (!capture.ok)
+  {
+    printf("out of memory\n");
+    free(capture.bytes);
+    return 1;
+  }
+
+  if (!gbp_cap_writer_open(&writer, outputFilename, false))
+  {
+    printf("cannot write `%s'\n", outputFilename);
+    free(capture.bytes);
+    return 1;
+  }
+  const size_t packets = gbp_cap_writer_addBytes(&writer, capture.bytes, capture.size);
+  const size_t jobs = writer.jobs.count + ((writer.jobFirstPacket < writer.packetCount) ? 1 : 0);
+  const uint64_t streamSize = writer.streamSize;
+  const bool ok = gbp_cap_writer_close(&writer);
+  free(capture.bytes);
+
+  if (!ok)
+  {
+    printf("write failed `%s'\n", outputFilename);
+    return 1;
+  }
+  printf("%lu packets, %lu print jobs, %lu of %lu bytes kept --> `%s'\n",
+      (unsigned long) packets, (unsigned long) jobs, (unsigned long) streamSize, (unsigned long) capture.size, outputFilename);
+  return 0;
+}
+
+/*******************************************************************************
+ * .gbpcap --> Hex Text
+*******************************************************************************/
+
+static int gbpcap_toHex(gbp_cap_t *cap, FILE *out)
+{
+  // Same layout as the emulator's packet capture mode (See test/test.txt)
+  fprintf(out, "// GAMEBOY PRINTER EMULATION PROJECT (Packet Capture Mode)\n");
+  fprintf(out, "// Converted from .gbpcap (%u packets, %u print jobs)\n", (unsigned) cap->packetCount, (unsigned) cap->jobCount);
+  fprintf(out, "// Note: Each byte is from each GBP packet is from the gameboy\n");
+  fprintf(out, "//       except for the last two bytes which is from the printer\n");
+
+  uint32_t job = 0;
+  gbp_jobs_job_t jobInfo = {};
+  uint32_t jobFirstPacket = 0;
+  bool jobValid = gbp_cap_job(cap, job, &jobInfo, &jobFirstPacket);
+  for (uint32_t i = 0; i < cap->packetCount; i++)
+  {
+    gbp_cap_packet_t packet;
+    if (!gbp_cap_packet(cap, i, &packet))
+    {
+      printf("corrupt packet table at packet %u\n", (unsigned) i);
+      return 1;
+    }
+
+    if (jobValid && (i == jobFirstPacket))
+    {
+      fprintf(out, "// Print Job %u\n", (unsigned) job);
+      job++;
+      jobValid = gbp_cap_job(cap, job, &jobInfo, &jobFirstPacket);
+    }
+
+    if (cap->flags & GBP_CAP_FLAG_TIMESTAMPS)
+      fprintf(out, "// %u : %s @ %llu us\n", (unsigned) i, gbpCommand_toStr(packet.command), (unsigned long long) packet.timestampUs);
+    else
+      fprintf(out, "// %u : %s\n", (unsigned) i, gbpCommand_toStr(packet.command));
+
+    const uint8_t *pkt = &cap->stream[packet.streamOffset];
+    for (uint32_t b = 0; b < packet.size; b++)
+    {
+      fprintf(out, (b == 0) ? "%02X" : " %02X", pkt[b]);
+    }
+    fprintf(out, "\n");
+  }
+  return 0;
+}
+
+static int gbpcap_list(gbp_cap_t *cap)
+{
+  printf("packets: %u, print jobs: %u, stream: %llu bytes%s\n",
+      (unsigned) cap->packetCount, (unsigned) cap->jobCount, (unsigned long long) cap->streamSize,
+      (cap->flags & GBP_CAP_FLAG_TIMESTAMPS) ? ", timestamped" : "");
+  for (uint32_t i = 0; i < cap->jobCount; i++)
+  {
+    gbp_jobs_job_t job;
+    uint32_t firstPacket = 0;
+    if (!gbp_cap_job(cap, i, &job, &firstPacket))
+      return 1;
+    printf("job %4u : packets %6u..%6u, stream 0x%08llX..0x%08llX%s\n",
+        (unsigned) i, (unsigned) firstPacket, (unsigned) (firstPacket + job.packets),
+        (unsigned long long) job.start, (unsigned long long) job.end, job.cut ? "" : " (uncut)");
+  }
+  return 0;
+}
+
+/*******************************************************************************
+ * Main
+*******************************************************************************/
+void gbpcap_help(void)
+{
+  printf (
+      "Usage: gbpcap [OPTION]...\n"
+      "This program converts packet captures between ascii hex and binary .gbpcap\n"
+      "The direction follows the input: .gbpcap input is written as hex, otherwise hex is written as .gbpcap\n"
+      "\n"
+      "With no FILE, read standard input (hex only).\n"
+      "\n"
+      "-i, --input=FILE     input capture (ascii hex or .gbpcap)\n"
+      "-o, --output=OUTFILE output capture (default: stdout for hex)\n"
+      "-l, --list           list print jobs of a .gbpcap input and exit\n"
+      "-h, --help           display this help and exit\n"
+      "\n"
+      "Examples:\n"
+      "  gbpcap -i ./test/test.txt -o ./test/test.gbpcap      hex to binary\n"
+      "  gbpcap -i ./test/test.gbpcap -o ./test/test.txt      binary to hex\n"
+    );
+}
+
+int
+main (int argc, char **argv)
+{
+  int c;
+  static struct option const long_options[] =
+  {
+    {"input",   required_argument, NULL, 'i'},
+    {"output",  required_argument, NULL, 'o'},
+    {"list",    no_argument,       NULL, 'l'},
+    {"help",    no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  while ((c = getopt_long (argc, argv, "i:o:lh", long_options, NULL))
+         != -1)
+  {
+    switch (c)
+    {
+        case 'i':
+          ifilename = optarg;
+          break;
+
+        case 'o':
+          ofilename = optarg;
+          break;
+
+        case 'l':
+          list_flag = true;
+          break;
+
+        case 'h':
+        default:
+          gbpcap_help();
+          return 0;
+    }
+  }
+
+  FILE *in = stdin;
+  if (ifilename)
+  {
+    in = fopen(ifilename, "rb");
+    if (!in)
+    {
+      printf("file not found\n");
+      gbpcap_help();
+      return 1;
+    }
+  }
+
+  int ret = 0;
+  if (gbp_cap_isCap(fileno(in)))
+  {
+    gbp_cap_t cap;
+    if (!gbp_cap_open(&cap, fileno(in)))
+    {
+      printf("invalid .gbpcap (bad header or index)\n");
+      ret = 1;
+    }
+    else if (list_flag)
+    {
+      ret = gbpcap_list(&cap);
+      gbp_cap_close(&cap);
+    }
+    else
+    {
+      FILE *out = ofilename ? fopen(ofilename, "w") : stdout;
+      if (!out)
+      {
+        printf("cannot write `%s'\n", ofilename);
+        ret = 1;
+      }
+      else
+      {
+        ret = gbpcap_toHex(&cap, out);
+        if (out != stdout)
+          fclose(out);
+      }
+      gbp_cap_close(&cap);
+    }
+  }
+  else if (list_flag)
+  {
+    printf("not a .gbpcap input\n");
+    ret = 1;
+  }
+  else if (!ofilename)
+  {
+    printf("an output file (-o) is required for .gbpcap output\n");
+    ret = 1;
+  }
+  else
+  {
+    ret = gbpcap_fromHex(in, ofilename);
+  }
+
+  if (in != stdin)
+    fclose(in);
+  return ret;
+}
@@ -0,0 +1,393 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Synthetic Capture Generator
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This program writes reproducible synthetic captures for scale and load testing
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "gbp_decode.h"
+#include "gbp_cap.h"
+#include "gbp_gen.h"
+
+/* The official name of this program (e.g., no 'g' prefix).  */
+#define PROGRAM_NAME "gbpgen"
+
+#define GBPGEN_OUT_BUFFER_SIZE (1024 * 1024)
+
+/******************************************************************************/
+
+typedef enum
+{
+  GBPGEN_FORMAT_HEX,    ///< Ascii hex, same layout as the emulator's packet capture mode (See test/test.txt)
+  GBPGEN_FORMAT_GBPCAP, ///< Binary .gbpcap (Noise is not stored)
+  GBPGEN_FORMAT_BIN     ///< Raw link bytes
+} gbpgen_format_t;
+
+typedef struct
+{
+  gbpgen_format_t format;
+  FILE *f;
+  gbp_cap_writer_t cap;
+  uint64_t written;     ///< Output bytes so far
+  char *line;           ///< Hex line buffer
+  bool ok;
+} gbpgen_out_t;
+
+const char * ofilename = NULL;
+
+/*******************************************************************************
+ * Output
+*******************************************************************************/
+
+static void gbpgen_gotPacket(void *user, const uint8_t *bytes, const size_t size, const int command)
+{
+  gbpgen_out_t *out = (gbpgen_out_t *) user;
+  static const char hex[] = "0123456789ABCDEF";
+  static uint64_t packetIndex = 0;
+
+  switch (out->format)
+  {
+    case GBPGEN_FORMAT_HEX:
+    {
+      int n = (command == GBP_GEN_COMMAND_NOISE) ? snprintf(out->line, 64, "// noise\n")
+          : snprintf(out->line, 64, "// %llu : %s\n", (unsigned long long) packetIndex++, gbpCommand_toStr(command));
+      char *p = &out->line[n];
+      for (size_t i = 0; i < size; i++)
+      {
+        *p++ = hex[bytes[i] >> 4];
+        *p++ = hex[bytes[i] & 0xF];
+        *p++ = ' ';
+      }
+      p[-1] = '\n';
+      const size_t lineSize = p - out->line;
+      out->ok = (fwrite(out->line, 1, lineSize, out->f) == lineSize) && out->ok;
+      out->written += lineSize;
+      break;
+    }
+    case GBPGEN_FORMAT_GBPCAP:
+      if (command == GBP_GEN_COMMAND_NOISE)
+        break;
+      out->ok = gbp_cap_writer_addPacket(&out->cap, bytes, size, 0) && out->ok;
+      out->written += size;
+      break;
+    case GBPGEN_FORMAT_BIN:
+      out->ok = (fwrite(bytes, 1, size, out->f) == size) && out->ok;
+      out->written += size;
+      break;
+  }
+}
+
+/*******************************************************************************
+ * Option Parsing
+*******************************************************************************/
+
+static bool gbpgen_parseSize(const char *s, uint64_t *size)
+{
+  // e.g. 4096, 64K, 100M, 4G
+  char *end = NULL;
+  const unsigned long long v = strtoull(s, &end, 10);
+  if (end == s)
+    return false;
+  switch (*end)
+  {
+    case '\0': *size = v; return true;
+    case 'k': case 'K': *size = v << 10; break;
+    case 'm': case 'M': *size = v << 20; break;
+    case 'g': case 'G': *size = v << 30; break;
+    default: return false;
+  }
+  return end[1] == '\0';
+}
+
+static bool gbpgen_parseRange(const char *s, uint16_t *min, uint16_t *max)
+{
+  // N or MIN-MAX
+  unsigned a = 0, b = 0;
+  if (sscanf(s, "%u-%u", &a, &b) == 2)
+  {
+    *min = (uint16_t) a;
+    *max = (uint16_t) b;
+    return (a <= b) && (b <= 0xFFFF);
+  }
+  if (sscanf(s, "%u", &a) == 1)
+  {
+    *min = *max = (uint16_t) a;
+    return a <= 0xFFFF;
+  }
+  return false;
+}
+
+static bool gbpgen_parsePallets(const char *s, gbp_gen_config_t *config)
+{
+  // Comma separated hex bytes e.g. E4,1B,00
+  config->palletCount = 0;
+  while (*s && (config->palletCount < GBP_GEN_PALLETS_MAX))
+  {
+    char *end = NULL;
+    const unsigned long v = strtoul(s, &end, 16);
+    if ((end == s) || (v > 0xFF))
+      return false;
+    config->pallets[config->palletCount++] = (uint8_t) v;
+    s = (*end == ',') ? end + 1 : end;
+    if (*end && (*end != ','))
+      return false;
+  }
+  return config->palletCount > 0;
+}
+
+/*******************************************************************************
+ * Main
+*******************************************************************************/
+void gbpgen_help(void)
+{
+  printf (
+      "Usage: gbpgen [OPTION]...\n"
+      "This program writes valid synthetic packet captures, the same seed and options give the same capture\n"
+      "\n"
+      "-o, --output=OUTFILE    output capture (default: stdout, required for gbpcap)\n"
+      "-f, --format=FORMAT     hex (default), gbpcap or bin (raw link bytes)\n"
+      "-s, --seed=N            random seed (default: 1)\n"
+      "-n, --images=N          number of images (default: 1, or unlimited with --size)\n"
+      "-S, --size=SIZE         stop after the image that brings the output to SIZE bytes (suffix K, M or G)\n"
+      "-H, --height=ROWS       image height in tile rows, or MIN-MAX (default: 18, rounded up to even)\n"
+      "-c, --compression=RATIO RLE compress DATA payloads to about RATIO of their size (e.g. 0.4, default: 0 off)\n"
+      "-r, --raw               with -c, send the same image content uncompressed\n"
+      "-p, --pallets=LIST      print palettes to pick from per PRINT, e.g. E4,1B,00 (default: E4)\n"
+      "-k, --sheets=N          PRINT sheet count (default: 1)\n"
+      "-m, --margins=B,A       feeds before and after each image, 0..15 (default: 1,3, an after margin of 0 never cuts)\n"
+      "-d, --data-per-print=N  DATA packets (2 tile rows each) per PRINT (default: 9)\n"
+      "-N, --noise=MAX         up to MAX noise bytes before each packet (default: 0)\n"
+      "-b, --breaks=PERCENT    chance of a BREAK packet after each image (default: 0)\n"
+      "-h, --help              display this help and exit\n"
+      "\n"
+      "Examples:\n"
+      "  gbpgen -n 100 -H 8-40 -c 0.4 -p E4,1B -o ./test/gen.txt       100 images of 8 to 40 tile rows\n"
+      "  gbpgen -S 4G -f gbpcap -N 16 -o ./big.gbpcap                  4GiB of binary capture\n"
+      "  gbpgen -S 1G | gpbdecoder -P -o ./out/gen                       decode a generated stream\n"
+    );
+}
+
+int
+main (int argc, char **argv)
+{
+  gbp_gen_config_t config;
+  gbp_gen_defaults(&config);
+  gbpgen_format_t format = GBPGEN_FORMAT_HEX;
+  uint64_t images = 0;
+  uint64_t size = 0;
+
+  int c;
+  static struct option const long_options[] =
+  {
+    {"output",      required_argument, NULL, 'o'},
+    {"format",      required_argument, NULL, 'f'},
+    {"seed",        required_argument, NULL, 's'},
+    {"images",      required_argument, NULL, 'n'},
+    {"size",        required_argument, NULL, 'S'},
+    {"height",      required_argument, NULL, 'H'},
+    {"compression", required_argument, NULL, 'c'},
+    {"raw",         no_argument,       NULL, 'r'},
+    {"pallets",     required_argument, NULL, 'p'},
+    {"sheets",      required_argument, NULL, 'k'},
+    {"margins",     required_argument, NULL, 'm'},
+    {"data-per-print", required_argument, NULL, 'd'},
+    {"noise",       required_argument, NULL, 'N'},
+    {"breaks",      required_argument, NULL, 'b'},
+    {"help",        no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  while ((c = getopt_long (argc, argv, "o:f:s:n:S:H:c:rp:k:m:d:N:b:h", long_options, NULL))
+         != -1)
+  {
+    bool ok = true;
+    unsigned a = 0, b = 0;
+    switch (c)
+    {
+        case 'o':
+          ofilename = optarg;
+          break;
+
+        case 'f':
+          if (strcmp(optarg, "hex") == 0)
+            format = GBPGEN_FORMAT_HEX;
+          else if (strcmp(optarg, "gbpcap") == 0)
+            format = GBPGEN_FORMAT_GBPCAP;
+          else if (strcmp(optarg, "bin") == 0)
+            format = GBPGEN_FORMAT_BIN;
+          else
+            ok = false;
+          break;
+
+        case 's':
+          config.seed = strtoull(optarg, NULL, 0);
+          break;
+
+        case 'n':
+          images = strtoull(optarg, NULL, 0);
+          break;
+
+        case 'S':
+          ok = gbpgen_parseSize(optarg, &size);
+          break;
+
+        case 'H':
+          ok = gbpgen_parseRange(optarg, &config.heightMin, &config.heightMax);
+          break;
+
+        case 'c':
+          config.compression = atof(optarg);
+          ok = (config.compression >= 0.0);
+          break;
+
+        case 'r':
+          config.raw = true;
+          break;
+
+        case 'p':
+          ok = gbpgen_parsePallets(optarg, &config);
+          break;
+
+        case 'k':
+          config.sheets = (uint8_t) atoi(optarg);
+          break;
+
+        case 'm':
+          ok = (sscanf(optarg, "%u,%u", &a, &b) == 2) && (a <= 15) && (b <= 15);
+          config.marginBefore = (uint8_t) a;
+          config.marginAfter = (uint8_t) b;
+          break;
+
+        case 'd':
+          a = (unsigned) atoi(optarg);
+          ok = (a >= 1) && (a <= 0xFF);
+          config.dataPerPrint = (uint8_t) a;
+          break;
+
+        case 'N':
+          a = (unsigned) atoi(optarg);
+          ok = (a <= 0xFFFF);
+          config.noiseMax = (uint16_t) a;
+          break;
+
+        case 'b':
+          a = (unsigned) atoi(optarg);
+          ok = (a <= 100);
+          config.breakPercent = (uint8_t) a;
+          break;
+
+        case 'h':
+          gbpgen_help();
+          return 0;
+
+        default:
+          ok = false;
+          break;
+    }
+    if (!ok)
+    {
+      printf("invalid option `-%c %s'\n", c, optarg ? optarg : "");
+      gbpgen_help();
+      return 1;
+    }
+  }
+
+  if ((images == 0) && (size == 0))
+    images = 1;
+
+  /* Output */
+  gbpgen_out_t out = {};
+  out.format = format;
+  out.ok = true;
+  if (format == GBPGEN_FORMAT_GBPCAP)
+  {
+    if (!ofilename)
+    {
+      printf("an output file (-o) is required for .gbpcap output\n");
+      return 1;
+    }
+    if (!gbp_cap_writer_open(&out.cap, ofilename, false))
+    {
+      printf("cannot write `%s'\n", ofilename);
+      return 1;
+    }
+  }
+  else
+  {
+    out.f = ofilename ? fopen(ofilename, "wb") : stdout;
+    if (!out.f)
+    {
+      printf("cannot write `%s'\n", ofilename);
+      return 1;
+    }
+    setvbuf(out.f, NULL, _IOFBF, GBPGEN_OUT_BUFFER_SIZE);
+  }
+  out.line = (char *) malloc(64 + 3 * 0x10000);
+  gbp_gen_t *gen = (gbp_gen_t *) malloc(sizeof(gbp_gen_t));
+  if (!out.line || !gen)
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+
+  if (format == GBPGEN_FORMAT_HEX)
+  {
+    fprintf(out.f, "// GAMEBOY PRINTER EMULATION PROJECT (Packet Capture Mode)\n");
+    fprintf(out.f, "// Generated by gbpgen (seed %llu)\n", (unsigned long long) config.seed);
+    fprintf(out.f, "// Note: Each byte is from each GBP packet is from the gameboy\n");
+    fprintf(out.f, "//       except for the last two bytes which is from the printer\n");
+  }
+
+  /* Generate whole images until either limit */
+  gbp_gen_init(gen, &config, gbpgen_gotPacket, &out);
+  while (out.ok && ((images == 0) || (gen->stats.images < images)) && ((size == 0) || (out.written < size)))
+    gbp_gen_image(gen);
+
+  if (format == GBPGEN_FORMAT_GBPCAP)
+    out.ok = gbp_cap_writer_close(&out.cap) && out.ok;
+  else if (out.f != stdout)
+    out.ok = (fclose(out.f) == 0) && out.ok;
+  else
+    out.ok = (fflush(out.f) == 0) && out.ok;
+
+  // Summary goes to stderr when the capture itself goes to stdout
+  FILE *info = ofilename ? stdout : stderr;
+  const gbp_gen_stats_t *stats = &gen->stats;
+  fprintf(info, "%llu images (%llu tile rows), %llu packets, %llu link bytes (%llu noise), payload %.3f of raw --> %llu bytes `%s'\n",
+      (unsigned long long) stats->images, (unsigned long long) stats->rows, (unsigned long long) stats->packets,
+      (unsigned long long) stats->bytes, (unsigned long long) stats->noiseBytes,
+      stats->payloadRaw ? (double) stats->payloadSent / (double) stats->payloadRaw : 0.0,
+      (unsigned long long) out.written, ofilename ? ofilename : "stdout");
+  free(gen);
+  free(out.line);
+  if (!out.ok)
+  {
+    fprintf(info, "write failed `%s'\n", ofilename ? ofilename : "stdout");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,665 @@
+/*************************************************************************
+ *
+ * Gameboy Printer Decoder Regression Runner
+ * Part of GAMEBOY PRINTER EMULATION PROJECT V2 (Arduino)
+ * Copyright (C) 2020 Brian Khuu
+ *
+ * PURPOSE: This program checks decoded images against golden images and end to end throughput against a baseline
+ * LICENCE:
+ *   This file is part of Arduino Gameboy Printer Emulator.
+ *
+ *   Arduino Gameboy Printer Emulator is free software:
+ *   you can redistribute it and/or modify it under the terms of the
+ *   GNU General Public License as published by the Free Software Foundation,
+ *   either version 3 of the License, or (at your option) any later version.
+ *
+ *   Arduino Gameboy Printer Emulator is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Arduino Gameboy Printer Emulator.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h> // PATH_MAX
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "gbp_decode.h"
+#include "gbp_hex.h"
+#include "gbp_stats.h"
+
+/* The official name of this program (e.g., no 'g' prefix).  */
+#define PROGRAM_NAME "gbpregress"
+
+/*
+    Dev Note: Method
+    * The manifest lists each capture with a golden image prefix and the pallet the golden images were rendered
+      with. Extra captures on the command line have no golden images and are only timed (once, if the manifest
+      already lists them).
+    * Every capture is read into memory once, then decoded once end to end (hex --> decode session --> 24bit
+      bmp files) into the scratch directory for the golden image compare.
+    * Throughput is timed apart from that, on hex decode and the decode session only (No output, so no file
+      writes or session setup in the timing). A repetition decodes the capture as many times as fit in
+      GBPREGRESS_REP_NS (calibrated once) and reports the time of one decode. After the warmup repetitions,
+      the median of the repetitions is kept.
+    * Decoded and golden bmp pixels are both mapped back through the pallet to 2bpp tones and compared
+      pixel for pixel. A colour outside the pallet is reported on its own, so a pallet change shows up as
+      a pallet problem rather than as every pixel differing.
+    * MB/s is capture file bytes (1MB = 1e6 bytes) per second. Only the total over all captures is gated
+      against the baseline, single small captures are too noisy to gate on.
+*/
+
+#define GBPREGRESS_PATH_MAX        1024
+#define GBPREGRESS_REP_NS          (20 * 1000 * 1000) ///< Minimum time of one repetition
+#define GBPREGRESS_WARMUP          2
+#define GBPREGRESS_REPS            21
+#define GBPREGRESS_THRESHOLD       15.0 ///< Allowed throughput drop in percent
+#define GBPREGRESS_TOTAL           "total"
+
+/******************************************************************************/
+
+typedef struct
+{
+  char capture[GBPREGRESS_PATH_MAX];
+  char golden[GBPREGRESS_PATH_MAX];  ///< Golden image path prefix (empty: timing only)
+  char name[GBPREGRESS_PATH_MAX];    ///< Capture file name without extention
+  uint32_t palletColor[4];
+  char *text;        ///< Capture file contents
+  uint64_t bytes;
+  uint64_t medianNs; ///< One decode, median of the repetitions
+  uint32_t images;
+  bool ok;
+} gbpregress_case_t;
+
+typedef struct
+{
+  int32_t width;
+  int32_t height;
+  uint8_t *rgb; ///< Top down, 3 bytes per pixel (r, g, b)
+} gbpregress_image_t;
+
+static gbpregress_case_t *cases = NULL;
+static int caseCount = 0;
+
+static bool verbose_flag = false;
+
+/*******************************************************************************
+ * Manifest
+*******************************************************************************/
+
+static int gbpregress_palletParse(uint32_t *palletColor, const char *str)
+{
+  // `#RRGGBB#RRGGBB...`, anything past the 4th colour is ignored
+  int count = 0;
+  while ((count < 4) && (str = strchr(str, '#')))
+  {
+    char *end = NULL;
+    const unsigned long v = strtoul(str + 1, &end, 16);
+    if ((end - str) < 7)
+      return count;
+    palletColor[count++] = (uint32_t) (v >> (4 * ((end - str) - 7))) & 0xFFFFFF;
+    str = end;
+  }
+  return count;
+}
+
+static gbpregress_case_t *gbpregress_add(const char *capture)
+{
+  gbpregress_case_t *grown = (gbpregress_case_t *) realloc(cases, (caseCount + 1) * sizeof(gbpregress_case_t));
+  if (!grown)
+    return NULL;
+  cases = grown;
+  gbpregress_case_t *c = &cases[caseCount++];
+  memset(c, 0, sizeof(*c));
+  snprintf(c->capture, sizeof(c->capture), "%s", capture);
+  const char *base = strrchr(capture, '/');
+  snprintf(c->name, sizeof(c->name), "%s", base ? base + 1 : capture);
+  char *ext = strrchr(c->name, '.');
+  if (ext)
+    *ext = '\0';
+  c->palletColor[0] = 0xFFFFFF;
+  c->palletColor[1] = 0xAAAAAA;
+  c->palletColor[2] = 0x555555;
+  c->palletColor[3] = 0x000000;
+  c->ok = true;
+  return c;
+}
+
+static bool gbpregress_listed(const char *capture)
+{
+  // Extra captures already in the manifest are not decoded twice
+  char path[PATH_MAX];
+  char listed[PATH_MAX];
+  if (!realpath(capture, path))
+    return false;
+  for (int i = 0; i < caseCount; i++)
+  {
+    if (realpath(cases[i].capture, listed) && (strcmp(path, listed) == 0))
+      return true;
+  }
+  return false;
+}
+
+static bool gbpregress_manifest(const char *filename)
+{
+  // Paths are relative to the manifest
+  FILE *f = fopen(filename, "r");
+  if (!f)
+    return false;
+  char dir[GBPREGRESS_PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", filename);
+  char *slash = strrchr(dir, '/');
+  if (slash)
+    slash[1] = '\0';
+  else
+    dir[0] = '\0';
+
+  char line[4 * GBPREGRESS_PATH_MAX];
+  while (fgets(line, sizeof(line), f))
+  {
+    char capture[GBPREGRESS_PATH_MAX];
+    char golden[GBPREGRESS_PATH_MAX];
+    char pallet[GBPREGRESS_PATH_MAX];
+    if ((line[0] == '#') || (sscanf(line, "%1023s %1023s %1023s", capture, golden, pallet) != 3))
+      continue;
+    char path[2 * GBPREGRESS_PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", dir, capture);
+    gbpregress_case_t *c = gbpregress_add(path);
+    if (!c)
+      break;
+    snprintf(c->golden, sizeof(c->golden), "%s%s", dir, golden);
+    if (gbpregress_palletParse(c->palletColor, pallet) != 4)
+    {
+      printf("%s: pallet needs 4 colours `%s'\n", filename, pallet);
+      fclose(f);
+      return false;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/*******************************************************************************
+ * Decode
+*******************************************************************************/
+
+static bool gbpregress_load(gbpregress_case_t *c)
+{
+  const int fd = open(c->capture, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  bool ok = (fstat(fd, &st) == 0);
+  c->bytes = ok ? (uint64_t) st.st_size : 0;
+  c->text = ok ? (char *) malloc(c->bytes + 1) : NULL;
+  ok = ok && c->text && (read(fd, c->text, c->bytes) == (ssize_t) c->bytes);
+  close(fd);
+  return ok;
+}
+
+static void gbpregress_run(gbp_decode_t *session, const gbpregress_case_t *c, uint8_t *bin)
+{
+  // One whole decode of the capture from memory
+  gbp_hex_t hex;
+  gbp_hex_init(&hex);
+  const size_t binSize = gbp_hex_decode(&hex, c->text, c->bytes, bin);
+  gbp_decode_feed(session, bin, binSize);
+  gbp_decode_flush(session);
+}
+
+static bool gbpregress_decode(gbpregress_case_t *c, const char *outputDir, uint8_t *bin)
+{
+  // Golden image decode, once
+  char output[2 * GBPREGRESS_PATH_MAX];
+  snprintf(output, sizeof(output), "%s/%s", outputDir, c->name);
+  gbp_decode_config_t config = {};
+  config.output = GBP_DECODE_OUTPUT_BMP;
+  config.outputFilename = output;
+  memcpy(config.palletColor, c->palletColor, sizeof(config.palletColor));
+  gbp_decode_t *session = gbp_decode_create(&config);
+  if (!session)
+    return false;
+  gbpregress_run(session, c, bin);
+  c->images = gbp_decode_imageCount(session);
+  gbp_decode_destroy(session);
+  return true;
+}
+
+static int gbpregress_compareNs(const void *a, const void *b)
+{
+  const uint64_t x = *(const uint64_t *) a;
+  const uint64_t y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+static bool gbpregress_time(gbpregress_case_t *c, const int reps, uint8_t *bin)
+{
+  // Decode only, the session is created once and reset between decodes
+  gbp_decode_config_t config = {};
+  config.output = GBP_DECODE_OUTPUT_NONE;
+  memcpy(config.palletColor, c->palletColor, sizeof(config.palletColor));
+  gbp_decode_t *session = gbp_decode_create(&config);
+  uint64_t *samples = (uint64_t *) calloc(reps, sizeof(uint64_t));
+  if (!session || !samples)
+  {
+    gbp_decode_destroy(session);
+    free(samples);
+    return false;
+  }
+
+  // Calibrate decodes per repetition on one decode (Also the first warmup)
+  uint64_t start = gbp_stats_nowNs();
+  gbpregress_run(session, c, bin);
+  const uint64_t once = gbp_stats_nowNs() - start;
+  uint64_t passes = (once > 0) ? (GBPREGRESS_REP_NS + once - 1) / once : GBPREGRESS_REP_NS;
+  passes = (passes < 1) ? 1 : (passes > 1000000) ? 1000000 : passes;
+
+  for (int r = -GBPREGRESS_WARMUP; r < reps; r++)
+  {
+    start = gbp_stats_nowNs();
+    for (uint64_t p = 0; p < passes; p++)
+    {
+      gbp_decode_reset(session, NULL);
+      gbpregress_run(session, c, bin);
+    }
+    if (r >= 0)
+      samples[r] = (gbp_stats_nowNs() - start) / passes;
+  }
+  qsort(samples, reps, sizeof(uint64_t), gbpregress_compareNs);
+  c->medianNs = samples[reps / 2];
+  gbp_decode_destroy(session);
+  free(samples);
+  return true;
+}
+
+/*******************************************************************************
+ * Golden Image Compare
+*******************************************************************************/
+
+static uint32_t gbpregress_le32(const uint8_t *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static bool gbpregress_bmpLoad(const char *filename, gbpregress_image_t *image)
+{
+  // Uncompressed 24bit bmp only, as written by gbp_bmp
+  memset(image, 0, sizeof(*image));
+  FILE *f = fopen(filename, "rb");
+  if (!f)
+    return false;
+  uint8_t header[54];
+  bool ok = (fread(header, 1, sizeof(header), f) == sizeof(header)) && (header[0] == 'B') && (header[1] == 'M')
+      && (header[28] == 24) && (gbpregress_le32(&header[30]) == 0);
+  const uint32_t offset = gbpregress_le32(&header[10]);
+  const int32_t width = (int32_t) gbpregress_le32(&header[18]);
+  const int32_t height = (int32_t) gbpregress_le32(&header[22]);
+  const bool topDown = height < 0;
+  image->width = width;
+  image->height = topDown ? -height : height;
+  ok = ok && (width > 0) && (image->height > 0) && (fseek(f, offset, SEEK_SET) == 0);
+
+  const size_t stride = ((size_t) width * 3 + 3) & ~(size_t) 3;
+  uint8_t *row = ok ? (uint8_t *) malloc(stride) : NULL;
+  image->rgb = ok ? (uint8_t *) malloc((size_t) width * image->height * 3) : NULL;
+  ok = ok && row && image->rgb;
+  for (int32_t y = 0; ok && (y < image->height); y++)
+  {
+    ok = fread(row, 1, stride, f) == stride;
+    uint8_t *dst = &image->rgb[(size_t) (topDown ? y : (image->height - 1 - y)) * width * 3];
+    for (int32_t x = 0; ok && (x < width); x++)
+    {
+      dst[x * 3 + 0] = row[x * 3 + 2];
+      dst[x * 3 + 1] = row[x * 3 + 1];
+      dst[x * 3 + 2] = row[x * 3 + 0];
+    }
+  }
+  free(row);
+  fclose(f);
+  if (!ok)
+  {
+    free(image->rgb);
+    image->rgb = NULL;
+  }
+  return ok;
+}
+
+static int gbpregress_tone(const uint32_t *palletColor, const uint8_t *rgb)
+{
+  // 2bpp tone of a pixel, -1 if the colour is not in the pallet
+  const uint32_t color = ((uint32_t) rgb[0] << 16) | ((uint32_t) rgb[1] << 8) | rgb[2];
+  for (int i = 0; i < 4; i++)
+  {
+    if (palletColor[i] == color)
+      return i;
+  }
+  return -1;
+}
+
+static bool gbpregress_compareImage(const gbpregress_case_t *c, const char *goldenFile, const char *decodedFile, const uint32_t imageIndex)
+{
+  gbpregress_image_t golden;
+  gbpregress_image_t decoded;
+  const bool goldenOk = gbpregress_bmpLoad(goldenFile, &golden);
+  const bool decodedOk = gbpregress_bmpLoad(decodedFile, &decoded);
+  bool ok = goldenOk && decodedOk;
+  if (!goldenOk)
+    printf("  %s image %u: cannot read golden image `%s'\n", c->name, (unsigned) imageIndex, goldenFile);
+  if (!decodedOk)
+    printf("  %s image %u: cannot read decoded image `%s'\n", c->name, (unsigned) imageIndex, decodedFile);
+  if (ok && ((golden.width != decoded.width) || (golden.height != decoded.height)))
+  {
+    printf("  %s image %u: size %dx%d, golden is %dx%d\n", c->name, (unsigned) imageIndex,
+        (int) decoded.width, (int) decoded.height, (int) golden.width, (int) golden.height);
+    ok = false;
+  }
+
+  if (ok)
+  {
+    uint64_t toneDiff = 0;
+    uint64_t goldenOffPallet = 0;
+    uint64_t decodedOffPallet = 0;
+    int32_t firstX = -1, firstY = -1, firstGolden = 0, firstDecoded = 0;
+    for (int32_t y = 0; y < golden.height; y++)
+    {
+      for (int32_t x = 0; x < golden.width; x++)
+      {
+        const size_t i = ((size_t) y * golden.width + x) * 3;
+        const int g = gbpregress_tone(c->palletColor, &golden.rgb[i]);
+        const int d = gbpregress_tone(c->palletColor, &decoded.rgb[i]);
+        goldenOffPallet += (g < 0);
+        decodedOffPallet += (d < 0);
+        if ((g < 0) || (d < 0) || (g == d))
+          continue;
+        if (toneDiff++ == 0)
+        {
+          firstX = x;
+          firstY = y;
+          firstGolden = g;
+          firstDecoded = d;
+        }
+      }
+    }
+    if (toneDiff)
+      printf("  %s image %u: %llu pixels differ in 2bpp, first at (%d, %d) tone %d, golden %d\n", c->name, (unsigned) imageIndex,
+          (unsigned long long) toneDiff, (int) firstX, (int) firstY, (int) firstDecoded, (int) firstGolden);
+    if (goldenOffPallet)
+      printf("  %s image %u: %llu golden pixels are not in the pallet (Check the manifest pallet)\n", c->name, (unsigned) imageIndex,
+          (unsigned long long) goldenOffPallet);
+    if (decodedOffPallet)
+      printf("  %s image %u: %llu decoded pixels are not in the pallet (Pallet mapping changed)\n", c->name, (unsigned) imageIndex,
+          (unsigned long long) decodedOffPallet);
+    ok = (toneDiff == 0) && (goldenOffPallet == 0) && (decodedOffPallet == 0);
+  }
+
+  free(golden.rgb);
+  free(decoded.rgb);
+  return ok;
+}
+
+static bool gbpregress_compare(gbpregress_case_t *c, const char *outputDir)
+{
+  // Golden images are numbered from 0 without gaps, the decoder must produce exactly as many
+  uint32_t goldenCount = 0;
+  for (;; goldenCount++)
+  {
+    char goldenFile[2 * GBPREGRESS_PATH_MAX];
+    snprintf(goldenFile, sizeof(goldenFile), "%s%u.bmp", c->golden, (unsigned) goldenCount);
+    if (access(goldenFile, R_OK) != 0)
+      break;
+  }
+  if (goldenCount != c->images)
+  {
+    printf("  %s: %u images decoded, %u golden images\n", c->name, (unsigned) c->images, (unsigned) goldenCount);
+    c->ok = false;
+  }
+
+  const uint32_t count = (goldenCount < c->images) ? goldenCount : c->images;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    char goldenFile[2 * GBPREGRESS_PATH_MAX];
+    char decodedFile[3 * GBPREGRESS_PATH_MAX];
+    snprintf(goldenFile, sizeof(goldenFile), "%s%u.bmp", c->golden, (unsigned) i);
+    snprintf(decodedFile, sizeof(decodedFile), "%s/%s%u.bmp", outputDir, c->name, (unsigned) i);
+    c->ok = gbpregress_compareImage(c, goldenFile, decodedFile, i) && c->ok;
+  }
+  return c->ok;
+}
+
+/*******************************************************************************
+ * Baseline
+*******************************************************************************/
+
+static double gbpregress_mbps(const uint64_t bytes, const uint64_t ns)
+{
+  return ns ? ((double) bytes * 1000.0 / (double) ns) : 0.0;
+}
+
+static bool gbpregress_baselineGet(const char *filename, const char *name, double *mbps)
+{
+  // One `name MB/s` pair per line
+  FILE *f = fopen(filename, "r");
+  if (!f)
+    return false;
+  char line[2 * GBPREGRESS_PATH_MAX];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), f))
+  {
+    char key[GBPREGRESS_PATH_MAX];
+    double value = 0;
+    found = (line[0] != '#') && (sscanf(line, "%1023s %lf", key, &value) == 2) && (strcmp(key, name) == 0);
+    if (found)
+      *mbps = value;
+  }
+  fclose(f);
+  return found;
+}
+
+static bool gbpregress_baselineWrite(const char *filename, const double totalMbps)
+{
+  FILE *f = fopen(filename, "w");
+  if (!f)
+    return false;
+  fprintf(f, "# gbpregress decode throughput baseline (MB/s of capture file), update with gbpregress -u\n");
+  fprintf(f, "%s %.3f\n", GBPREGRESS_TOTAL, totalMbps);
+  for (int i = 0; i < caseCount; i++)
+    fprintf(f, "%s %.3f\n", cases[i].name, gbpregress_mbps(cases[i].bytes, cases[i].medianNs));
+  return fclose(f) == 0;
+}
+
+static void gbpregress_printRate(const char *baselineFile, const char *name, const double mbps, double *baseline)
+{
+  double base = 0;
+  if (gbpregress_baselineGet(baselineFile, name, &base) && (base > 0))
+  {
+    printf(" %10.2f %10.2f %+7.1f%%\n", mbps, base, (mbps / base - 1.0) * 100.0);
+    if (baseline)
+      *baseline = base;
+  }
+  else
+  {
+    printf(" %10.2f %10s %8s\n", mbps, "-", "-");
+  }
+}
+
+/*******************************************************************************
+ * Main
+*******************************************************************************/
+void gbpregress_help(void)
+{
+  printf (
+      "Usage: gbpregress [OPTION]... [CAPTURE]...\n"
+      "This program decodes each capture in the manifest end to end, compares the images against golden images\n"
+      "in 2bpp and fails if total throughput drops below the baseline. Extra captures are only timed.\n"
+      "\n"
+      "-m, --manifest=FILE     capture, golden image prefix and pallet per line (default: ./test/regress.txt)\n"
+      "-b, --baseline=FILE     throughput baseline (default: ./regress_baseline.txt, fails if missing)\n"
+      "-t, --threshold=PERCENT allowed total throughput drop (default: 15)\n"
+      "-u, --update            write this run as the new baseline\n"
+      "-r, --reps=N            timed repetitions per capture, the median is kept (default: 21)\n"
+      "-o, --output=DIR        scratch directory for decoded images (default: ./regress.out)\n"
+      "-v, --verbose           list every image compared\n"
+      "-h, --help              display this help and exit\n"
+      "\n"
+      "Examples:\n"
+      "  gbpregress\n"
+      "  gbpregress -t 5 ../research/Captures/*/*.txt\n"
+      "  gbpregress -u\n"
+    );
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *manifestFilename = "./test/regress.txt";
+  const char *baselineFilename = "./regress_baseline.txt";
+  const char *outputDir = "./regress.out";
+  double threshold = GBPREGRESS_THRESHOLD;
+  bool update = false;
+  int reps = GBPREGRESS_REPS;
+
+  int c;
+  static struct option const long_options[] =
+  {
+    {"manifest",  required_argument, NULL, 'm'},
+    {"baseline",  required_argument, NULL, 'b'},
+    {"threshold", required_argument, NULL, 't'},
+    {"update",    no_argument,       NULL, 'u'},
+    {"reps",      required_argument, NULL, 'r'},
+    {"output",    required_argument, NULL, 'o'},
+    {"verbose",   no_argument,       NULL, 'v'},
+    {"help",      no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  while ((c = getopt_long (argc, argv, "m:b:t:ur:o:vh", long_options, NULL))
+         != -1)
+  {
+    switch (c)
+    {
+        case 'm':
+          manifestFilename = optarg;
+          break;
+
+        case 'b':
+          baselineFilename = optarg;
+          break;
+
+        case 't':
+          threshold = atof(optarg);
+          break;
+
+        case 'u':
+          update = true;
+          break;
+
+        case 'r':
+          reps = atoi(optarg);
+          reps = (reps < 1) ? 1 : reps;
+          break;
+
+        case 'o':
+          outputDir = optarg;
+          break;
+
+        case 'v':
+          verbose_flag = true;
+          break;
+
+        case 'h':
+          gbpregress_help();
+          return 0;
+
+        default:
+          gbpregress_help();
+          return 1;
+    }
+  }
+
+  if (!gbpregress_manifest(manifestFilename))
+  {
+    printf("cannot read manifest `%s'\n", manifestFilename);
+    return 1;
+  }
+  for (int i = optind; i < argc; i++)
+  {
+    if (gbpregress_listed(argv[i]))
+      continue;
+    if (!gbpregress_add(argv[i]))
+      return 1;
+  }
+  mkdir(outputDir, 0755);
+
+  /* Decode and compare */
+  bool goldenOk = true;
+  uint64_t totalBytes = 0;
+  uint64_t totalNs = 0;
+  printf("%-56s %6s %7s %10s %10s %8s\n", "capture", "images", "golden", "MB/s", "baseline", "change");
+  for (int i = 0; i < caseCount; i++)
+  {
+    gbpregress_case_t *rc = &cases[i];
+    rc->ok = gbpregress_load(rc);
+    uint8_t *bin = rc->ok ? (uint8_t *) malloc(GBP_HEX_OUTPUT_MAX(rc->bytes)) : NULL;
+    rc->ok = rc->ok && bin && gbpregress_decode(rc, outputDir, bin) && gbpregress_time(rc, reps, bin);
+    free(bin);
+    free(rc->text);
+    rc->text = NULL;
+    if (!rc->ok)
+      printf("  %s: cannot read `%s'\n", rc->name, rc->capture);
+    else if (rc->golden[0])
+      gbpregress_compare(rc, outputDir);
+    goldenOk = goldenOk && rc->ok;
+    totalBytes += rc->bytes;
+    totalNs += rc->medianNs;
+
+    printf("%-56s %6u %7s", rc->name, (unsigned) rc->images, !rc->ok ? "FAIL" : rc->golden[0] ? "ok" : "-");
+    gbpregress_printRate(baselineFilename, rc->name, gbpregress_mbps(rc->bytes, rc->medianNs), NULL);
+    if (verbose_flag && rc->golden[0])
+    {
+      for (uint32_t j = 0; j < rc->images; j++)
+        printf("  %s/%s%u.bmp == %s%u.bmp\n", outputDir, rc->name, (unsigned) j, rc->golden, (unsigned) j);
+    }
+  }
+
+  /* Throughput gate */
+  const double totalMbps = gbpregress_mbps(totalBytes, totalNs);
+  double baseline = 0;
+  printf("%-56s %6s %7s", GBPREGRESS_TOTAL, "", goldenOk ? "ok" : "FAIL");
+  gbpregress_printRate(baselineFilename, GBPREGRESS_TOTAL, totalMbps, &baseline);
+
+  bool rateOk = true;
+  if (update)
+  {
+    if (!gbpregress_baselineWrite(baselineFilename, totalMbps))
+    {
+      printf("cannot write baseline `%s'\n", baselineFilename);
+      return 1;
+    }
+    printf("baseline written `%s'\n", baselineFilename);
+  }
+  else if (baseline <= 0)
+  {
+    // A missing baseline must not pass, or a fresh checkout could never fail the gate
+    printf("no throughput baseline `%s', time a known good build with -u first\n", baselineFilename);
+    rateOk = false;
+  }
+  else if (totalMbps < (baseline * (1.0 - threshold / 100.0)))
+  {
+    printf("throughput regression: %.2f MB/s is more than %.1f%% below the baseline %.2f MB/s\n", totalMbps, threshold, baseline);
+    rateOk = false;
+  }
+
+  if (!goldenOk)
+    printf("golden image regression\n");
+  free(cases);
+  return (goldenOk && rateOk) ? 0 : 1;
+}
@@ -27,13 +27,25 @@
 #include <stdbool.h>
 #include <getopt.h>
 #include <sys/types.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
 
+#include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "gameboy_printer_protocol.h"
 #include "gbp_pkt.h"
 #include "gbp_tiles.h"
-#include "gbp_bmp.h"
+#include "gbp_hex.h"
+#include "gbp_decode.h"
+#include "gbp_batch.h"
+#include "gbp_jobs.h"
+#include "gbp_cap.h"
+#include "gbp_pipe.h"
+#include "gbp_trace.h"
+#include "gbp_term.h"
 
 
 /* The official name of this program (e.g., no 'g' prefix).  */
@@ -43,6 +55,14 @@
 
 static bool verbose_flag = false;
 static bool display_flag = false;
+static bool ingestbench_flag = false;
+static bool wholepacket_flag = false;
+static bool pipeline_flag = false;
+static bool follow_flag = false;
+static bool writerbench_flag = false;
+static bool stats_flag = false;
+static int jobsParameter = 0; ///< Batch worker threads (0: one per core)
+static long jobParameter = -1; ///< Only decode this print job (-1: all)
 
 /******************************************************************************/
 
@@ -53,44 +73,62 @@ FILE * ifilePtr = NULL;
 char ofilenameBuf[255] = {0};
 char ofilenameExt[50]  = {0};
 
+// Output format
+const char * formatParameter = NULL;
+const char * metaFilename = NULL; ///< --meta, "-" for stdout
+const char * writerParameter = NULL;
+const char * displayParameter = NULL;
+
+// Extra outputs (--out KIND[/PALLET]:PATH, see gbp_decode.h)
+const char * outParameters[GBP_DECODE_SINKS_MAX] = {0};
+int outCount = 0;
+gbp_decode_sink_t outSinks[GBP_DECODE_SINKS_MAX] = {};
+char outFilenames[GBP_DECODE_SINKS_MAX][255] = {{0}};
+
 /******************************************************************************/
 
 // Pallet
 const char * palletParameter = NULL;
-uint32_t palletColor[4] = {0};
 
 /******************************************************************************/
 
-// Other Variables
-uint8_t pktCounter = 0; // Dev Varible
-gbp_pkt_t gbp_pktBuff = {GBP_REC_NONE, 0};
-uint8_t gbp_pktbuff[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE] = {0};
-uint8_t gbp_pktbuffSize = 0;
-gbp_pkt_tileAcc_t tileBuff = {0};
-gbp_tile_t gbp_tiles = {0};
-gbp_bmp_t  gbp_bmp = {0};
+// Decoder (All decoding state lives in the session, see gbp_decode.h)
+gbp_decode_config_t decodeConfig = {};
+
+// Statistics (--stats)
+const char * statsFilename = NULL; ///< NULL for stdout
+FILE * statsFile = NULL; ///< Stdout data stream when no statsFilename
+gbp_stats_t runStats = {};
+uint64_t runStartNs = 0;
+
+// Tracing (--trace)
+const char * traceFilename = NULL;
+
+// Terminal preview (--display)
+gbp_term_t termPreview = {};
 
 /******************************************************************************/
 
-static void gbpdecoder_gotByte(const uint8_t byte);
+static void gbpdecoder_gotBytes(void *user, const uint8_t *bytes, const size_t bytesSize);
+static void gbpdecoder_gotPacket(void *user, const gbp_pkt_t *pkt, const uint8_t *payload, const uint16_t payloadSize, const uint32_t pktCount);
+static void gbpdecoder_gotPrint(void *user, gbp_tile_t *tiles, const bool cutPaper);
+static size_t gbpdecoder_ingest(FILE *f, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void *user);
+static size_t gbpdecoder_ingest_stdio(FILE *f, void (*gotByte)(const uint8_t byte));
+static int gbpdecoder_ingest_bench(FILE *f);
+static int gbpdecoder_batch(const char * const inputs[], const int inputCount, const char *outputDir);
+static int gbpdecoder_jobs(FILE *f);
+static int gbpdecoder_cap(FILE *f);
+static int gbpdecoder_follow(FILE *f);
+static int gbpdecoder_pipeline(FILE *f);
+static int gbpdecoder_writer_bench(FILE *f);
+static void gbpdecoder_stats_session(gbp_decode_t *session);
+static int gbpdecoder_stats_done(int ret);
+static double gbpdecoder_time_sec(void);
 
 /*******************************************************************************
  * Utilites
 *******************************************************************************/
 
-const char *gbpCommand_toStr(int val)
-{
-  switch (val)
-  {
-    case GBP_COMMAND_INIT    : return "INIT";
-    case GBP_COMMAND_PRINT   : return "PRNT";
-    case GBP_COMMAND_DATA    : return "DATA";
-    case GBP_COMMAND_BREAK   : return "BREK";
-    case GBP_COMMAND_INQUIRY : return "INQY";
-    default: return "?";
-  }
-}
-
 static void filenameExtractPathAndExtention(const char *fname,
                         char *pathBuff, int pathSize,
                         char *extBuff, int extSize)
@@ -194,27 +232,157 @@ int palletColorParse(uint32_t *palletColor, const int palletColorSize, const cha
   return palletCounter;
 }
 
+static bool gbpdecoder_formatParse(const char *str, gbp_decode_output_t *output, int *nameLength)
+{
+  // Longest name first where one is the start of another (bmp4/bmp2 before bmp)
+  static const struct { const char *name; gbp_decode_output_t output; } formats[] =
+  {
+    {"bmp4",  GBP_DECODE_OUTPUT_BMP4},
+    {"bmp2",  GBP_DECODE_OUTPUT_BMP2},
+    {"bmp",   GBP_DECODE_OUTPUT_BMP},
+    {"png",   GBP_DECODE_OUTPUT_PNG},
+    {"ppm",   GBP_DECODE_OUTPUT_PPM},
+    {"pam",   GBP_DECODE_OUTPUT_PAM},
+    {"gray8", GBP_DECODE_OUTPUT_GRAY8},
+    {"2bpp",  GBP_DECODE_OUTPUT_2BPP},
+  };
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+  {
+    const int length = strlen(formats[i].name);
+    if (strncmp(str, formats[i].name, length) != 0)
+      continue;
+    if (!nameLength && (str[length] != '\0'))
+      continue;
+    if (nameLength)
+    {
+      // Followed by nothing or a scale (e.g. bmp2x is bmp at 2x, bmp22x is bmp2 at 2x)
+      int j = length;
+      while (isdigit((unsigned char) str[j]))
+        j++;
+      if (!((str[length] == '\0') || ((j > length) && (str[j] == 'x') && (str[j + 1] == '\0'))))
+        continue;
+      *nameLength = length;
+    }
+    *output = formats[i].output;
+    return true;
+  }
+  return false;
+}
+
+static bool gbpdecoder_outParse(const char *str, gbp_decode_sink_t *sink, char *pathBuff, int pathSize)
+{
+  // KIND[/PALLET]:PATH where KIND is FORMAT, FORMATNx (N times the printed size) or thumbN (N pixels wide)
+  char kind[50] = {0};
+  const char *path = strchr(str, ':');
+  if (!path || ((size_t) (path - str) >= sizeof(kind)))
+    return false;
+  memcpy(kind, str, path - str);
+  path++;
+  char *pallet = strchr(kind, '/');
+  if (pallet)
+    *pallet++ = '\0';
+
+  // Pallet (Default: the main pallet)
+  memcpy(sink->palletColor, decodeConfig.palletColor, sizeof(sink->palletColor));
+  if (pallet && (palletColorParse(sink->palletColor, sizeof(sink->palletColor)/sizeof(sink->palletColor[0]), pallet) == 0))
+    return false;
+
+  // Path (Image number and extention is appended like -o, stream kinds write to the path itself)
+  char ext[50] = {0};
+  filenameExtractPathAndExtention(path, pathBuff, pathSize, ext, sizeof(ext));
+  sink->outputFilename = pathBuff;
+
+  // Kind
+  int nameLength = 0;
+  if (strncmp(kind, "thumb", 5) == 0)
+  {
+    char *end = NULL;
+    const long width = strtol(&kind[5], &end, 10);
+    if ((end == &kind[5]) || (*end != '\0') || (width <= 0) || (width > GBP_DECODE_WIDTH_MAX) || (width % 4))
+      return false;
+    sink->output = (strcmp(ext, "bmp") == 0) ? GBP_DECODE_OUTPUT_BMP : GBP_DECODE_OUTPUT_PNG;
+    sink->width = (uint16_t) width;
+    return true;
+  }
+  if (!gbpdecoder_formatParse(kind, &sink->output, &nameLength))
+    return false;
+  const long scale = (kind[nameLength] != '\0') ? atol(&kind[nameLength]) : 1;
+  if ((scale < 1) || (scale > GBP_DECODE_SCALE_MAX))
+    return false;
+  sink->width = (uint16_t) (GBP_DECODE_WIDTH * scale);
+  return true;
+}
+
+static FILE *gbpdecoder_stdoutData(void)
+{
+  // Stdout carries data (frames or metadata), so log messages move over to stderr
+  static FILE *data = NULL;
+  if (data)
+    return NULL; // Only one kind of data fits on stdout
+  const int fd = dup(STDOUT_FILENO);
+  if ((fd < 0) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0))
+    return NULL;
+  data = fdopen(fd, "wb");
+  return data;
+}
+
+static bool gbpdecoder_inOrder(void)
+{
+  // Verbose, display, frame and metadata output must stay in capture order, so those decode serially
+  for (int i = 0; i < outCount; i++)
+  {
+    if (outSinks[i].stream)
+      return true;
+  }
+  return verbose_flag || display_flag || decodeConfig.stream || decodeConfig.meta;
+}
+
 /*******************************************************************************
  * Main Test Routine
 *******************************************************************************/
 void gpbdecoder_help(void)
 {
   printf (
-      "Usage: gpbdecoder [OPTION]...\n"
+      "Usage: gpbdecoder [OPTION]... [CAPTURE|DIRECTORY]...\n"
       "This program allows for decoding raw hex packets into bmp\n"
       "\n"
       "With no FILE, read standard input.\n"
+      "With CAPTURE or DIRECTORY arguments, decode each capture (`.txt` and `.gbpcap` in directories) in parallel.\n"
       "\n"
       "-i, --input=FILE     input hexfile in ascii format\n"
       "-o, --output=OUTFILE output bmp filename\n"
       "-p, --pallet=PALLET  pallet color in web color format\n"
+      "-f, --format=FORMAT  output format: bmp (24bit, default), bmp4, bmp2 (palettized) or png (2bit indexed)\n"
+      "                     or a frame stream into OUTFILE (default stdout): ppm, pam, gray8 or 2bpp\n"
+      "-M, --meta=FILE      write one line of JSON per image (colors, sheets, margins, density), - for stdout\n"
+      "-O, --out=KIND[/PALLET]:PATH\n"
+      "                     also write each image as KIND to PATH, from the same decode (repeatable, up to 8)\n"
+      "                     KIND is a FORMAT, FORMAT with a scale (e.g. png2x) or thumbN (N pixels wide, .bmp or png)\n"
       "-h, --help           display this help and exit\n"
-      "-d, --display        preview image via vt100 output\n"
+      "-d, --display[=MODE] preview image in the terminal: auto (default), blocks, sixel or kitty\n"
       "-v, --verbose        verbose print\n"
+      "-b, --ingest-bench   compare hex ingest speed of stdio and bulk decoder then exit\n"
+      "-w, --whole-packet   decode each packet payload whole instead of in tile sized chunks\n"
+      "-j, --jobs=N         batch decode with N worker threads (default: one per core)\n"
+      "                     in batch mode -o is an output directory (default: next to each capture)\n"
+      "                     with a single input, print jobs within the capture are decoded in parallel\n"
+      "-n, --job=N          only decode print job N (image N) of the input\n"
+      "-P, --pipeline       decode with ingest, parse and image writes on separate threads\n"
+      "-F, --follow         keep decoding a capture that is still being written (file or pipe) until\n"
+      "                     interrupted or the writer is done, each image is written at its cutting PRINT\n"
+      "-R, --progressive    write each image as FILE.part, valid after every 8 pixel strip, renamed when done\n"
+      "-W, --writer=WRITER  image file writer: stdio (default), pwrite or uring (io_uring, falls back to pwrite)\n"
+      "-B, --writer-bench   compare image writers by decoding the input repeatedly into OUTFILE then exit\n"
+      "-S, --stats[=FILE]   write decoder statistics as one line of JSON at exit (default: stdout, logs to stderr)\n"
+      "-T, --trace=FILE     record hot path events and write them as Chrome trace JSON at exit\n"
+      "\n"
+      "FILE may be ascii hex or a binary .gbpcap capture (see gbpcap)\n"
       "\n"
       "Examples:\n"
       "  cat ./test/test.txt | gpbdecoder -p \"#ffffff#ffad63#833100#000000\" -o ./test/test.bmp    stdin based input, with a defined output filename\n"
       "-p \"#dbf4b4#abc396#7b9278#4c625a#FFFFFF00\" -i ./test/test.txt                              input file used. Output file has similar name to input file\n"
+      "  gpbdecoder -j 8 ../research/Captures ./test/test.txt                                      batch decode a directory and a file\n"
+      "  gpbdecoder -i ./test/test.txt -O png4x:./big.png -O thumb64:./thumb.png                    bmp, a 4x png and a thumbnail in one pass\n"
     );
 }
 
@@ -228,20 +396,34 @@ main (int argc, char **argv)
   static struct option const long_options[] =
   {
     /* These options set a flag. */
-    {"display", no_argument,       (int*)&display_flag, 1},
     {"verbose", no_argument,       (int*)&verbose_flag, 1},
     {"brief",   no_argument,       (int*)&verbose_flag, 0},
     /* These options don’t set a flag.
         We distinguish them by their indices. */
+    {"display", optional_argument, NULL, 'd'},
     {"input",   required_argument, NULL, 'i'},
     {"output",  required_argument, NULL, 'o'},
     {"pallet",  required_argument, NULL, 'p'},
+    {"format",  required_argument, NULL, 'f'},
+    {"meta",    required_argument, NULL, 'M'},
+    {"out",     required_argument, NULL, 'O'},
     {"verbose", no_argument,       NULL, 'v'},
     {"help",    no_argument,       NULL, 'h'},
+    {"ingest-bench", no_argument,  NULL, 'b'},
+    {"whole-packet", no_argument,  NULL, 'w'},
+    {"jobs",    required_argument, NULL, 'j'},
+    {"job",     required_argument, NULL, 'n'},
+    {"pipeline", no_argument,      NULL, 'P'},
+    {"follow",  no_argument,       NULL, 'F'},
+    {"progressive", no_argument,   NULL, 'R'},
+    {"writer",  required_argument, NULL, 'W'},
+    {"writer-bench", no_argument,  NULL, 'B'},
+    {"stats",   optional_argument, NULL, 'S'},
+    {"trace",   required_argument, NULL, 'T'},
     {NULL, 0, NULL, 0}
   };
 
-  while ((c = getopt_long (argc, argv, "o:i:p:vd", long_options, NULL))
+  while ((c = getopt_long (argc, argv, "o:i:p:f:M:O:vd::bwj:n:PFRW:BS::T:", long_options, NULL))
          != -1)
   {
     switch (c)
@@ -258,12 +440,75 @@ main (int argc, char **argv)
           palletParameter = optarg;
           break;
 
+        case 'f':
+          formatParameter = optarg;
+          break;
+
         case 'v':
           verbose_flag = true;
           break;
 
         case 'd':
           display_flag = true;
+          displayParameter = optarg;
+          break;
+
+        case 'b':
+          ingestbench_flag = true;
+          break;
+
+        case 'w':
+          wholepacket_flag = true;
+          break;
+
+        case 'j':
+          jobsParameter = atoi(optarg);
+          break;
+
+        case 'n':
+          jobParameter = atol(optarg);
+          break;
+
+        case 'P':
+          pipeline_flag = true;
+          break;
+
+        case 'F':
+          follow_flag = true;
+          break;
+
+        case 'R':
+          decodeConfig.progressive = true;
+          break;
+
+        case 'M':
+          metaFilename = optarg;
+          break;
+
+        case 'O':
+          if (outCount >= GBP_DECODE_SINKS_MAX)
+          {
+            printf("too many outputs (at most %d)\n", GBP_DECODE_SINKS_MAX);
+            return 1;
+          }
+          outParameters[outCount++] = optarg;
+          break;
+
+        case 'W':
+          writerParameter = optarg;
+          break;
+
+        case 'B':
+          writerbench_flag = true;
+          break;
+
+        case 'S':
+          stats_flag = true;
+          statsFilename = optarg;
+          break;
+
+        case 'T':
+          traceFilename = optarg;
           break;
 
         case 'h':
@@ -273,8 +518,25 @@ main (int argc, char **argv)
     }
   }
 
+  /* Statistics to stdout (Claimed before any log message, which then go to stderr) */
+  if (stats_flag && !statsFilename)
+  {
+    statsFile = gbpdecoder_stdoutData();
+    if (!statsFile)
+    {
+      printf("cannot write `stdout'\n");
+      return 1;
+    }
+  }
+
   /* Input File */
-  if (ifilename)
+  const int batchInputCount = argc - optind;
+  if (batchInputCount > 0)
+  {
+    // Batch decode of the remaining arguments
+    printf("batch input %d path(s)\n", batchInputCount);
+  }
+  else if (ifilename)
   {
     ifilePtr = fopen(ifilename, "r+");
     if (ifilePtr == NULL)
@@ -293,6 +555,8 @@ main (int argc, char **argv)
   }
 
   /* Output File */
+  const char * batchOutputDir = ofilename; ///< Only an explicit output is used as a batch output directory
+  const char * streamFilename = ofilename; ///< Only an explicit output is used for a frame stream (Else stdout)
   if (!ofilename)
   {
     // Default output filename if not defined
@@ -309,8 +573,80 @@ main (int argc, char **argv)
   filenameExtractPathAndExtention(ofilename, ofilenameBuf, sizeof(ofilenameBuf), ofilenameExt, sizeof(ofilenameExt));
   printf("file requested output `%s' (%s)\n", ofilenameBuf, ofilenameExt);
 
+  /* Output Format */
+  if (!formatParameter)
+  {
+    // Follow output filename extention if no format was requested
+    formatParameter = (strcmp(ofilenameExt, "png") == 0) ? "png" : "bmp";
+  }
+  if (!gbpdecoder_formatParse(formatParameter, &decodeConfig.output, NULL))
+  {
+    printf("unknown output format `%s'\n", formatParameter);
+    gpbdecoder_help();
+    return 1;
+  }
+
+  /* Frame Stream and Metadata (See gbp_raw.h and gbp_decode.h) */
+  const bool streamOutput = (decodeConfig.output >= GBP_DECODE_OUTPUT_PPM);
+  if ((streamOutput || metaFilename) && ((batchInputCount > 0) || writerbench_flag))
+  {
+    printf("frame streams and metadata need a single input and no writer bench\n");
+    return 1;
+  }
+  if (streamOutput)
+  {
+    const bool toStdout = !streamFilename || (strcmp(streamFilename, "-") == 0);
+    decodeConfig.stream = toStdout ? gbpdecoder_stdoutData() : fopen(streamFilename, "wb");
+    if (!decodeConfig.stream)
+    {
+      printf("cannot write `%s'\n", toStdout ? "stdout (statistics go there)" : streamFilename);
+      return 1;
+    }
+    printf("stream: %s frames to %s\n", formatParameter, toStdout ? "stdout" : streamFilename);
+  }
+  if (metaFilename)
+  {
+    const bool toStdout = (strcmp(metaFilename, "-") == 0);
+    decodeConfig.meta = toStdout ? gbpdecoder_stdoutData() : fopen(metaFilename, "w");
+    if (!decodeConfig.meta)
+    {
+      printf("cannot write `%s'\n", toStdout ? "stdout (frames or statistics go there)" : metaFilename);
+      return 1;
+    }
+    printf("metadata to %s\n", toStdout ? "stdout" : metaFilename);
+  }
+
+  /* Image Writer */
+  if (writerParameter && !gbp_out_writerParse(writerParameter, &decodeConfig.writer))
+  {
+    printf("unknown writer `%s'\n", writerParameter);
+    gpbdecoder_help();
+    return 1;
+  }
+
+  /* Terminal Preview */
+  gbp_term_mode_t displayMode = GBP_TERM_MODE_AUTO;
+  if (displayParameter && !gbp_term_parseMode(displayParameter, &displayMode))
+  {
+    printf("unknown display `%s'\n", displayParameter);
+    gpbdecoder_help();
+    return 1;
+  }
+
+  /* Statistics */
+  decodeConfig.stats = stats_flag;
+  runStartNs = gbp_stats_nowNs();
+
+  /* Tracing */
+  if (traceFilename && !gbp_trace_start(GBP_TRACE_DEFAULT_EVENTS))
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+
   /* Custom Pallet */
-  if (palletColorParse(palletColor, sizeof(palletColor)/sizeof(palletColor[0]), palletParameter) == 0)
+  uint32_t *palletColor = decodeConfig.palletColor;
+  if (palletColorParse(palletColor, sizeof(decodeConfig.palletColor)/sizeof(decodeConfig.palletColor[0]), palletParameter) == 0)
   {
     palletColor[0] = 0xFFFFFF;
     palletColor[1] = 0xAAAAAA;
@@ -319,21 +655,590 @@ main (int argc, char **argv)
   }
   printf("Pallet: 0x%06X, 0x%06X, 0x%06X, 0x%06X\n", palletColor[0], palletColor[1], palletColor[2], palletColor[3]);
 
+  /* Extra Outputs (After the pallet, it is their default) */
+  if ((outCount > 0) && ((batchInputCount > 0) || writerbench_flag))
+  {
+    printf("extra outputs need a single input and no writer bench\n");
+    return 1;
+  }
+  for (int i = 0; i < outCount; i++)
+  {
+    gbp_decode_sink_t *sink = &outSinks[i];
+    if (!gbpdecoder_outParse(outParameters[i], sink, outFilenames[i], sizeof(outFilenames[i])))
+    {
+      printf("bad output `%s'\n", outParameters[i]);
+      gpbdecoder_help();
+      return 1;
+    }
+    if (sink->output >= GBP_DECODE_OUTPUT_PPM)
+    {
+      // Frame streams write to the path as given
+      const char *path = strchr(outParameters[i], ':') + 1;
+      const bool toStdout = (strcmp(path, "-") == 0);
+      sink->stream = toStdout ? gbpdecoder_stdoutData() : fopen(path, "wb");
+      if (!sink->stream)
+      {
+        printf("cannot write `%s'\n", toStdout ? "stdout (other data goes there)" : path);
+        return 1;
+      }
+    }
+    printf("output: %s (%u wide)\n", outParameters[i], (unsigned) sink->width);
+  }
+  decodeConfig.sinks = outSinks;
+  decodeConfig.sinkCount = (uint8_t) outCount;
+  if (display_flag)
+  {
+    gbp_term_init(&termPreview, fileno(stdout), displayMode, palletColor);
+    printf("Display: %s\n", gbp_term_modeName(termPreview.mode));
+  }
+
   /****************************************************************************/
-  gbp_pkt_init(&gbp_pktBuff);
+  if (batchInputCount > 0)
+  {
+    return gbpdecoder_stats_done(gbpdecoder_batch((const char * const *) &argv[optind], batchInputCount, batchOutputDir));
+  }
+
+  if (ingestbench_flag)
+  {
+    return gbpdecoder_ingest_bench(ifilePtr);
+  }
 
+  /* Decoder Session */
+  decodeConfig.outputFilename = ofilenameBuf;
+  decodeConfig.wholePacket = wholepacket_flag;
+  decodeConfig.onPacket = verbose_flag ? gbpdecoder_gotPacket : NULL;
+  if (display_flag)
+  {
+    // Preview only, nothing is written to file
+    decodeConfig.output = GBP_DECODE_OUTPUT_NONE;
+    decodeConfig.onPrint = gbpdecoder_gotPrint;
+  }
+  if (follow_flag)
+  {
+    // Dev Note: A .gbpcap is only complete once closed, and parallel decodes need the whole capture up front
+    if (gbp_cap_isCap(fileno(ifilePtr)))
+    {
+      printf("cannot follow a .gbpcap capture\n");
+      return 1;
+    }
+    return gbpdecoder_stats_done(gbpdecoder_follow(ifilePtr));
+  }
+  if (ifilename && gbp_cap_isCap(fileno(ifilePtr)))
+  {
+    // Binary capture (Print jobs are already indexed)
+    return gbpdecoder_stats_done(gbpdecoder_cap(ifilePtr));
+  }
+  if ((jobParameter >= 0) || ((jobsParameter > 0) && !gbpdecoder_inOrder()))
+  {
+    // Dev Note: Some output must stay in capture order, so it decodes serially (See gbpdecoder_inOrder())
+    return gbpdecoder_stats_done(gbpdecoder_jobs(ifilePtr));
+  }
+  if (writerbench_flag)
+  {
+    return gbpdecoder_writer_bench(ifilePtr);
+  }
+  if (pipeline_flag && !gbpdecoder_inOrder())
+  {
+    return gbpdecoder_stats_done(gbpdecoder_pipeline(ifilePtr));
+  }
+  if ((jobsParameter > 0) || pipeline_flag)
+  {
+    // Verbose and display output come from the parse stage, metadata needs each PRINT packet with its rows
+    printf("%s disabled, verbose, display, frame and metadata output decode serially\n", pipeline_flag ? "pipeline" : "parallel jobs");
+  }
+  gbp_decode_t *session = gbp_decode_create(&decodeConfig);
+  if (!session)
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+
+  gbpdecoder_ingest(ifilePtr, gbpdecoder_gotBytes, session);
+
+  gbp_decode_flush(session);
+  gbpdecoder_stats_session(session);
+  gbp_decode_destroy(session);
+
+  return gbpdecoder_stats_done(0);
+}
+
+
+void gbpdecoder_gotBytes(void *user, const uint8_t *bytes, const size_t bytesSize)
+{
+  gbp_decode_feed((gbp_decode_t *) user, bytes, bytesSize);
+}
+
+void gbpdecoder_gotPacket(void *user, const gbp_pkt_t *pkt, const uint8_t *payload, const uint16_t payloadSize, const uint32_t pktCount)
+{
+  // Verbose Print
+  (void) user;
+  printf("// %s | compression: %1u, dlength: %3u, printerID: 0x%02X, status: %u | %u | ",
+      gbpCommand_toStr(pkt->command),
+      (unsigned) pkt->compression,
+      (unsigned) pkt->dataLength,
+      (unsigned) pkt->printerID,
+      (unsigned) pkt->status,
+      (unsigned) pktCount
+    );
+  for (int i = 0 ; i < payloadSize ; i++)
+  {
+    printf("%02X ", payload[i]);
+  }
+  printf("\r\n");
+}
+
+void gbpdecoder_gotPrint(void *user, gbp_tile_t *tiles, const bool cutPaper)
+{
+  // Display Preview
+  // Dev Note: Rows are shown as soon as they are printed (Harmonised) instead of waiting on a cut
+  (void) user;
+  (void) cutPaper;
+  fflush(stdout); // Keep printf() output in order with the preview write()
+  gbp_term_rows(&termPreview, tiles, 0, tiles->tileRowOffset);
+}
+
+
+/*******************************************************************************
+ * Batch Decode
+*******************************************************************************/
+
+int gbpdecoder_batch(const char * const inputs[], const int inputCount, const char *outputDir)
+{
+  // Each worker gets its own session built from the same settings as a single capture decode
+  // Dev Note: Verbose packet dump and display preview are per capture, so they are not used here
+  gbp_batch_config_t batchConfig = {};
+  gbp_batch_result_t result = {};
+  batchConfig.decodeConfig = decodeConfig;
+  batchConfig.decodeConfig.wholePacket = wholepacket_flag;
+  batchConfig.outputDir = outputDir;
+  batchConfig.threads = jobsParameter;
+  batchConfig.verbose = verbose_flag;
+
+  const bool ok = gbp_batch_run(&batchConfig, inputs, inputCount, &result);
+  gbp_stats_merge(&runStats, &result.stats);
+
+  const double mb = result.bytes / (1024.0 * 1024.0);
+  const double sec = (result.seconds > 0) ? result.seconds : 1e-9;
+  printf("batch: %lu files (%lu failed), %.2f MB, %lu images, %d threads in %.3f s\n",
+      (unsigned long) result.files, (unsigned long) result.filesFailed, mb,
+      (unsigned long) result.images, result.threads, result.seconds);
+  printf("batch: %.1f files/s, %.2f MB/s, %.1f images/s\n",
+      result.files / sec, mb / sec, result.images / sec);
+  return ok ? 0 : 1;
+}
+
+/*******************************************************************************
+ * Parallel Print Jobs
+*******************************************************************************/
+
+typedef struct
+{
+  uint8_t *bytes;
+  size_t size;
+  size_t max;
+  bool ok;
+} gbpdecoder_capture_t;
+
+static void gbpdecoder_capture_gotBytes(void *user, const uint8_t *bytes, const size_t bytesSize)
+{
+  gbpdecoder_capture_t *capture = (gbpdecoder_capture_t *) user;
+  if (!capture->ok)
+    return;
+  if ((capture->size + bytesSize) > capture->max)
+  {
+    size_t max = capture->max ? capture->max : (1024 * 1024);
+    while (max < (capture->size + bytesSize))
+      max *= 2;
+    uint8_t *grown = (uint8_t *) realloc(capture->bytes, max);
+    if (!grown)
+    {
+      capture->ok = false;
+      return;
+    }
+    capture->bytes = grown;
+    capture->max = max;
+  }
+  memcpy(&capture->bytes[capture->size], bytes, bytesSize);
+  capture->size += bytesSize;
+}
+
+static int gbpdecoder_jobs_decodeOne(const gbp_jobs_job_t *job, const uint8_t *bytes, const uint32_t jobIndex)
+{
+  // A single print job renders the same image (and image number) as a full decode
+  gbp_decode_t *session = gbp_decode_create(&decodeConfig);
+  if (!session)
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+  gbp_decode_setImageNumber(session, jobIndex);
+  gbp_decode_feed(session, &bytes[job->start], job->end - job->start);
+  gbp_decode_flush(session);
+  printf("job %u: %u packets, %u images%s\n", (unsigned) jobIndex, (unsigned) job->packets,
+      (unsigned) gbp_decode_imageCount(session), job->cut ? "" : " (uncut)");
+  gbpdecoder_stats_session(session);
+  gbp_decode_destroy(session);
+  return 0;
+}
+
+static int gbpdecoder_jobs_decode(const gbp_jobs_index_t *index, const uint8_t *bytes, const size_t bytesSize)
+{
+  uint64_t images = 0;
+
+  if (jobParameter >= 0)
+  {
+    if ((size_t) jobParameter >= index->count)
+    {
+      printf("print job %ld not found (%lu print jobs)\n", jobParameter, (unsigned long) index->count);
+      return 1;
+    }
+    return gbpdecoder_jobs_decodeOne(&index->jobs[jobParameter], bytes, (uint32_t) jobParameter);
+  }
+
+  const double start = gbpdecoder_time_sec();
+  if (!gbp_jobs_decode(index, bytes, &decodeConfig, jobsParameter, &images, stats_flag ? &runStats : NULL))
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+  const double decodeSec = gbpdecoder_time_sec() - start;
+
+  printf("jobs: %lu print jobs (%u packets), %lu images, %d threads\n",
+      (unsigned long) index->count, (unsigned) index->packets, (unsigned long) images, jobsParameter);
+  printf("jobs: decode %.3f s (%.2f MB/s)\n",
+      decodeSec, (bytesSize / (1024.0 * 1024.0)) / ((decodeSec > 0) ? decodeSec : 1e-9));
+  return 0;
+}
+
+int gbpdecoder_jobs(FILE *f)
+{
+  // Two phase decode: index the print jobs of the whole capture, then decode jobs concurrently
+  gbpdecoder_capture_t capture = {NULL, 0, 0, true};
+  gbp_jobs_index_t index = {};
+
+  double start = gbpdecoder_time_sec();
+  gbpdecoder_ingest(f, gbpdecoder_capture_gotBytes, &capture);
+  const double ingestSec = gbpdecoder_time_sec() - start;
+
+  start = gbpdecoder_time_sec();
+  const bool scanned = capture.ok && gbp_jobs_scan(&index, capture.bytes, capture.size);
+  const double scanSec = gbpdecoder_time_sec() - start;
+
+  int ret = 1;
+  if (!scanned)
+  {
+    printf("out of memory\n");
+  }
+  else
+  {
+    printf("jobs: ingest %.3f s, scan %.3f s\n", ingestSec, scanSec);
+    ret = gbpdecoder_jobs_decode(&index, capture.bytes, capture.size);
+  }
+
+  gbp_jobs_free(&index);
+  free(capture.bytes);
+  return ret;
+}
+
+/*******************************************************************************
+ * Pipelined Decode
+*******************************************************************************/
+
+static void gbpdecoder_pipeline_queue(const char *name, const gbp_pipe_queueStats_t *queue)
+{
+  printf("pipeline: %-6s queue: %6lu items, depth avg %.2f max %lu, stalls producer %lu consumer %lu\n",
+      name, (unsigned long) queue->items, queue->depthAvg, (unsigned long) queue->depthMax,
+      (unsigned long) queue->producerStalls, (unsigned long) queue->consumerStalls);
+}
+
+int gbpdecoder_pipeline(FILE *f)
+{
+  gbp_pipe_stats_t stats;
+  if (!gbp_pipe_run(fileno(f), &decodeConfig, &stats))
+  {
+    printf("pipeline failed\n");
+    return 1;
+  }
+  printf("pipeline: %lu bytes, %lu images, %.3f s (%.2f MB/s)\n",
+      (unsigned long) stats.bytesIngested, (unsigned long) stats.images, stats.seconds,
+      (stats.bytesIngested / (1024.0 * 1024.0)) / ((stats.seconds > 0) ? stats.seconds : 1e-9));
+  gbpdecoder_pipeline_queue("bytes", &stats.bytes);
+  gbpdecoder_pipeline_queue("rows", &stats.rows);
+  gbp_stats_merge(&runStats, &stats.decode);
+  return 0;
+}
+
+/*******************************************************************************
+ * Follow (Live Tail)
+*******************************************************************************/
+
+static volatile sig_atomic_t followStop = 0;
+static uint32_t followImageBase = 0; ///< Images written before the last truncation
+
+static void gbpdecoder_follow_signal(int sig)
+{
+  (void) sig;
+  followStop = 1;
+}
+
+static void gbpdecoder_follow_gotBytes(void *user, const uint8_t *bytes, const size_t bytesSize)
+{
+  // Report each image as soon as its cutting PRINT is decoded (The image file is complete by then)
+  gbp_decode_t *session = (gbp_decode_t *) user;
+  const uint32_t before = gbp_decode_imageCount(session);
+  gbp_decode_feed(session, bytes, bytesSize);
+  const uint32_t after = gbp_decode_imageCount(session);
+  for (uint32_t i = before; i < after; i++)
+    printf("image %u written\n", (unsigned) (followImageBase + i));
+  if (after != before)
+    fflush(stdout);
+}
+
+static void gbpdecoder_follow_restart(void *user)
+{
+  // The capture was truncated and starts over, so the old packet, tile and image state goes
+  // (Its last image is written as it was, then numbering carries on so no written image is overwritten)
+  gbp_decode_t *session = (gbp_decode_t *) user;
+  const uint32_t before = gbp_decode_imageCount(session);
+  gbp_decode_flush(session);
+  if (gbp_decode_imageCount(session) != before)
+    printf("image %u written\n", (unsigned) (followImageBase + before));
+  followImageBase += gbp_decode_imageCount(session);
+  gbp_decode_reset(session, NULL);
+  gbp_decode_setImageNumber(session, followImageBase);
+  printf("input truncated, decoding from the start\n");
+  fflush(stdout);
+}
+
+int gbpdecoder_follow(FILE *f)
+{
+  // One session for the whole run, so parser, tile and image state carry across reads
+  struct sigaction sa = {};
+  sa.sa_handler = gbpdecoder_follow_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL); // No SA_RESTART, so a blocked read or wait returns at once
+  sigaction(SIGTERM, &sa, NULL);
+
+  gbp_decode_t *session = gbp_decode_create(&decodeConfig);
+  if (!session)
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+  printf("following input, interrupt (Ctrl-C) to stop\n");
+  fflush(stdout);
+
+  gbp_hex_follow(fileno(f), ifilename, gbpdecoder_follow_gotBytes, gbpdecoder_follow_restart, session, &followStop);
+
+  // An image that was printed but not yet cut is written as is
+  gbp_decode_flush(session);
+  gbpdecoder_stats_session(session);
+  gbp_decode_destroy(session);
+  return 0;
+}
+
+/*******************************************************************************
+ * Statistics
+*******************************************************************************/
+
+void gbpdecoder_stats_session(gbp_decode_t *session)
+{
+  if (gbp_decode_stats(session))
+    gbp_stats_merge(&runStats, gbp_decode_stats(session));
+}
+
+int gbpdecoder_stats_done(int ret)
+{
+  // Decode is finished (All decoding threads joined), write trace and statistics
+  if (traceFilename)
+  {
+    gbp_trace_stop();
+    if (gbp_trace_dropped() > 0)
+      printf("trace: %llu oldest events dropped\n", (unsigned long long) gbp_trace_dropped());
+    if (!gbp_trace_dumpChrome(traceFilename))
+    {
+      printf("cannot write `%s'\n", traceFilename);
+      return 1;
+    }
+  }
+  if (!stats_flag)
+    return ret;
+  runStats.wallNs = gbp_stats_nowNs() - runStartNs;
+  FILE *f = statsFilename ? fopen(statsFilename, "w") : statsFile;
+  if (!f)
+  {
+    printf("cannot write `%s'\n", statsFilename ? statsFilename : "stdout");
+    return 1;
+  }
+  gbp_stats_json(f, &runStats);
+  fclose(f);
+  return ret;
+}
+
+/*******************************************************************************
+ * Image Writer Benchmark
+*******************************************************************************/
+
+int gbpdecoder_writer_bench(FILE *f)
+{
+  // Decode the same capture into many numbered images with each writer
+  const uint32_t minImages = 512;
+  gbpdecoder_capture_t capture = {NULL, 0, 0, true};
+  gbpdecoder_ingest(f, gbpdecoder_capture_gotBytes, &capture);
+  if (!capture.ok)
+  {
+    printf("out of memory\n");
+    free(capture.bytes);
+    return 1;
+  }
+
+  printf("writer bench: io_uring %s\n", gbp_out_uringAvailable() ? "available" : "not available (uring falls back to pwrite)");
+  const gbp_out_writer_t writers[] = {GBP_OUT_WRITER_STDIO, GBP_OUT_WRITER_PWRITE, GBP_OUT_WRITER_URING};
+  int ret = 0;
+  for (size_t w = 0; w < sizeof(writers) / sizeof(writers[0]); w++)
+  {
+    gbp_decode_config_t config = decodeConfig;
+    config.writer = writers[w];
+    gbp_decode_t *session = gbp_decode_create(&config);
+    if (!session)
+    {
+      printf("out of memory\n");
+      ret = 1;
+      break;
+    }
+
+    uint32_t images = 0;
+    uint32_t passes = 0;
+    const double start = gbpdecoder_time_sec();
+    do
+    {
+      gbp_decode_reset(session, NULL);
+      gbp_decode_setImageNumber(session, images);
+      gbp_decode_feed(session, capture.bytes, capture.size);
+      gbp_decode_flush(session);
+      images += gbp_decode_imageCount(session);
+      passes++;
+    } while ((images > 0) && (images < minImages));
+    gbp_decode_destroy(session);
+    const double elapsed = gbpdecoder_time_sec() - start;
+
+    const double sec = (elapsed > 0) ? elapsed : 1e-9;
+    printf("writer %-6s : %5u images in %.3f s, %9.1f images/s, %8.2f MB/s decoded\n",
+        gbp_out_writerName(writers[w]), (unsigned) images, elapsed, images / sec,
+        (passes * capture.size / (1024.0 * 1024.0)) / sec);
+  }
+  free(capture.bytes);
+  return ret;
+}
+
+/*******************************************************************************
+ * Binary Capture
+*******************************************************************************/
+
+int gbpdecoder_cap(FILE *f)
+{
+  gbp_cap_t cap;
+  if (!gbp_cap_open(&cap, fileno(f)))
+  {
+    printf("invalid .gbpcap (bad header or index)\n");
+    return 1;
+  }
+  printf("gbpcap: %u packets, %u print jobs\n", (unsigned) cap.packetCount, (unsigned) cap.jobCount);
+
+  int ret = 0;
+  if (jobParameter >= 0)
+  {
+    // Random access, one job table entry
+    gbp_jobs_job_t job;
+    if (!gbp_cap_job(&cap, (uint32_t) jobParameter, &job, NULL))
+    {
+      if ((uint32_t) jobParameter < cap.jobCount)
+        printf("invalid .gbpcap job index\n");
+      else
+        printf("print job %ld not found (%u print jobs)\n", jobParameter, (unsigned) cap.jobCount);
+      ret = 1;
+    }
+    else
+    {
+      ret = gbpdecoder_jobs_decodeOne(&job, cap.stream, (uint32_t) jobParameter);
+    }
+  }
+  else if ((jobsParameter > 0) && !gbpdecoder_inOrder())
+  {
+    gbp_jobs_index_t index;
+    if (!gbp_cap_jobIndex(&cap, &index))
+    {
+      printf("invalid .gbpcap job index\n");
+      ret = 1;
+    }
+    else
+    {
+      ret = gbpdecoder_jobs_decode(&index, cap.stream, (size_t) cap.streamSize);
+      gbp_jobs_free(&index);
+    }
+  }
+  else
+  {
+    // The packet stream is fed as is
+    gbp_decode_t *session = gbp_decode_create(&decodeConfig);
+    if (!session)
+    {
+      printf("out of memory\n");
+      ret = 1;
+    }
+    else
+    {
+      gbp_decode_feed(session, cap.stream, (size_t) cap.streamSize);
+      gbp_decode_flush(session);
+      gbpdecoder_stats_session(session);
+      gbp_decode_destroy(session);
+    }
+  }
+
+  gbp_cap_close(&cap);
+  return ret;
+}
+
+/*******************************************************************************
+ * Hex Ingest
+*******************************************************************************/
+
+size_t gbpdecoder_ingest(FILE *f, void (*gotBytes)(void *user, const uint8_t *bytes, const size_t bytesSize), void *user)
+{
+  // Bulk ingest (mmap or large block read, then block hex decode)
+  return gbp_hex_ingestTimed(fileno(f), gotBytes, user, stats_flag ? &runStats.stageNs[GBP_STATS_STAGE_HEX_PARSE] : NULL);
+}
+
+size_t gbpdecoder_ingest_stdio(FILE *f, void (*gotByte)(const uint8_t byte))
+{
+  // Character by character fgetc() ingest (Same grammar as gbp_hex_decode_scalar, kept as reference for benchmarking)
   char ch = 0;
+  bool slash = false;
   bool skipLine = false;
+  bool skipBlock = false;
+  char prev = 0;
   int  lowNibFound = 0;
   uint8_t byte = 0;
-  unsigned int bytec = 0;
-  while ((ch = fgetc(ifilePtr)) != EOF)
+  size_t bytec = 0;
+  while ((ch = fgetc(f)) != EOF)
   {
     // Skip Comments
-    if (ch == '/')
+    if (slash)
     {
       // Might be `//` or `/*`
-      skipLine = true;
+      slash = false;
+      skipBlock = (ch == '*');
+      skipLine = !skipBlock;
+      prev = 0;
+      if (skipBlock)
+        continue;
+    }
+    if (skipBlock)
+    {
+      // Discarding up to `*/`
+      if ((ch == '/') && (prev == '*'))
+        skipBlock = false;
+      prev = ch;
       continue;
     }
     else if (skipLine)
@@ -343,6 +1248,11 @@ main (int argc, char **argv)
         skipLine = false;
       continue;
     }
+    else if (ch == '/')
+    {
+      slash = true;
+      continue;
+    }
 
     // Parse Nibble
     char nib = -1;
@@ -385,140 +1295,88 @@ main (int argc, char **argv)
     if (byteFound)
     {
       bytec++;
-      gbpdecoder_gotByte(byte);
+      gotByte(byte);
     }
   }
+  return bytec;
+}
 
-  return 0;
+/******************************************************************************/
+
+static uint32_t ingestBenchHash = 0;
+
+static void gbpdecoder_ingest_bench_gotByte(const uint8_t byte)
+{
+  // FNV-1a over the decoded byte stream
+  ingestBenchHash = (ingestBenchHash ^ byte) * 16777619u;
 }
 
+static void gbpdecoder_ingest_bench_gotBytes(void *user, const uint8_t *bytes, const size_t bytesSize)
+{
+  (void) user;
+  for (size_t i = 0; i < bytesSize; i++)
+  {
+    gbpdecoder_ingest_bench_gotByte(bytes[i]);
+  }
+}
 
-void gbpdecoder_gotByte(const uint8_t byte)
+static double gbpdecoder_time_sec(void)
 {
-  if (gbp_pkt_processByte(&gbp_pktBuff, byte, gbp_pktbuff, &gbp_pktbuffSize, sizeof(gbp_pktbuff)))
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int gbpdecoder_ingest_bench(FILE *f)
+{
+  const int passes = 8;
+  double bestStdio = 1e9;
+  double bestBulk  = 1e9;
+  uint32_t hashStdio = 0;
+  uint32_t hashBulk  = 0;
+  size_t bytesStdio = 0;
+  size_t bytesBulk  = 0;
+  long inputSize = 0;
+
+  if (fseek(f, 0, SEEK_END) != 0)
   {
-    if (gbp_pktBuff.received == GBP_REC_GOT_PACKET)
-    {
-      pktCounter++;
-      if (verbose_flag)
-      {
-        printf("// %s | compression: %1u, dlength: %3u, printerID: 0x%02X, status: %u | %d | ",
-            gbpCommand_toStr(gbp_pktBuff.command),
-            (unsigned) gbp_pktBuff.compression,
-            (unsigned) gbp_pktBuff.dataLength,
-            (unsigned) gbp_pktBuff.printerID,
-            (unsigned) gbp_pktBuff.status,
-            (unsigned) pktCounter
-          );
-        for (int i = 0 ; i < gbp_pktbuffSize ; i++)
-        {
-          printf("%02X ", gbp_pktbuff[i]);
-        }
-        printf("\r\n");
-      }
-      if (gbp_pktBuff.command == GBP_COMMAND_PRINT)
-      {
-        const bool cutPaper = ((gbp_pktbuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED]&0xF) != 0) ? true : false;  ///< if lower margin is zero, then new pic
-        gbp_tiles_print(&gbp_tiles,
-            gbp_pktbuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_SHEETS],
-            gbp_pktbuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED],
-            gbp_pktbuff[GBP_PRINT_INSTRUCT_INDEX_PALETTE_VALUE],
-            gbp_pktbuff[GBP_PRINT_INSTRUCT_INDEX_PRINT_DENSITY]);
-
-        if (display_flag)
-        {
-          if (cutPaper)
-          {
-            // Display Preview
-            for (int j = 0; j < (GBP_TILE_PIXEL_HEIGHT * gbp_tiles.tileRowOffset); j++)
-            {
-              for (int i = 0; i < (GBP_TILE_PIXEL_WIDTH * GBP_TILES_PER_LINE); i++)
-              {
-                const int pixel = 0b11 & (gbp_tiles.bmpLineBuffer[j][GBP_TILE_2BIT_LINEPACK_INDEX(i)] >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(i));
-                int b = 0;
-                switch (pixel)
-                {
-                  default:
-                  case 3: b = 0; break;
-                  case 2: b = 64; break;
-                  case 1: b = 130; break;
-                  case 0: b = 255; break;
-                }
-                printf("\x1B[48;2;%d;%d;%dm \x1B[0m", b, b, b);
-              }
-              printf("\r\n");
-            }
-            gbp_tiles_reset(&gbp_tiles);
-          }
-        }
-        else
-        {
-          // Streaming BMP Writer
-          // Dev Note: Done this way to allow for streaming writes to file without a large buffer
-
-          // Open New File
-          if (!gbp_bmp_isopen(&gbp_bmp))
-          {
-            gbp_bmp_open(&gbp_bmp, ofilenameBuf, GBP_TILE_PIXEL_WIDTH*GBP_TILES_PER_LINE);
-          }
+    printf("ingest bench requires a seekable input file (-i)\n");
+    return 1;
+  }
+  inputSize = ftell(f);
 
-          // Write Decode Data Buffer Into BMP
-          for (int j = 0; j < gbp_tiles.tileRowOffset; j++)
-          {
-            const long int tileHeightIncrement = GBP_TILE_PIXEL_HEIGHT*GBP_BMP_MAX_TILE_HEIGHT;
-            gbp_bmp_add(&gbp_bmp, (const uint8_t *) &gbp_tiles.bmpLineBuffer[tileHeightIncrement*j][0], (GBP_TILE_PIXEL_WIDTH*GBP_TILES_PER_LINE), tileHeightIncrement, palletColor);
-          }
-          gbp_tiles_reset(&gbp_tiles); ///< Written to file, clear decoded tile line buffer
+  for (int pass = 0; pass < passes; pass++)
+  {
+    // Character by character fgetc() path
+    rewind(f);
+    ingestBenchHash = 2166136261u;
+    double start = gbpdecoder_time_sec();
+    bytesStdio = gbpdecoder_ingest_stdio(f, gbpdecoder_ingest_bench_gotByte);
+    double elapsed = gbpdecoder_time_sec() - start;
+    bestStdio = (elapsed < bestStdio) ? elapsed : bestStdio;
+    hashStdio = ingestBenchHash;
 
-          // Print finished and cut requested
-          if (cutPaper)
-          {
-            gbp_bmp_render(&gbp_bmp);
-          }
-        }
-      }
-    }
-    else
-    {
-      // Support compression payload
-      while (gbp_pkt_decompressor(&gbp_pktBuff, gbp_pktbuff, gbp_pktbuffSize, &tileBuff))
-      {
-        if (gbp_pkt_tileAccu_tileReadyCheck(&tileBuff))
-        {
-          // Got tile
-#if 0     // Output Tile As Hex For Debugging purpose
-          for (int i = 0 ; i < GBP_TILE_SIZE_IN_BYTE ; i++)
-          {
-            printf("%02X ", tileBuff.tile[i]);
-          }
-          printf("\r\n");
-#endif
-          if (gbp_tiles_line_decoder(&gbp_tiles, tileBuff.tile))
-          {
-            // Line Obtained
-#if 0       // Per Line Decoded (Pre Pallet Harmonisation)
-            for (int j = 0; j < GBP_TILE_PIXEL_HEIGHT; j++)
-            {
-              for (int i = 0; i < (GBP_TILE_PIXEL_WIDTH * GBP_TILES_PER_LINE); i++)
-              {
-                int pixel = 0b11 & (gbp_tiles.bmpLineBuffer[j+(gbp_tiles.tileRowOffset-1)*8][GBP_TILE_2BIT_LINEPACK_INDEX(i)] >> GBP_TILE_2BIT_LINEPACK_BITOFFSET(i));;
-                int b = 0;
-                switch (pixel)
-                {
-                  case 0: b = 0; break;
-                  case 1: b = 64; break;
-                  case 2: b = 130; break;
-                  case 3: b = 255; break;
-                }
-                printf("\x1B[48;2;%d;%d;%dm \x1B[0m", b, b, b);
-              }
-              printf("\r\n");
-            }
-#endif
-          }
-        }
-      }
-    }
+    // Bulk path
+    rewind(f);
+    ingestBenchHash = 2166136261u;
+    start = gbpdecoder_time_sec();
+    bytesBulk = gbpdecoder_ingest(f, gbpdecoder_ingest_bench_gotBytes, NULL);
+    elapsed = gbpdecoder_time_sec() - start;
+    bestBulk = (elapsed < bestBulk) ? elapsed : bestBulk;
+    hashBulk = ingestBenchHash;
   }
-}
 
+  const double mb = inputSize / (1024.0 * 1024.0);
+  printf("ingest stdio  : %ld chars -> %lu bytes (hash 0x%08X) %8.2f MB/s\n",
+      inputSize, (unsigned long) bytesStdio, (unsigned) hashStdio, mb / bestStdio);
+  printf("ingest %-6s : %ld chars -> %lu bytes (hash 0x%08X) %8.2f MB/s\n",
+      gbp_hex_simd_name(), inputSize, (unsigned long) bytesBulk, (unsigned) hashBulk, mb / bestBulk);
+
+  if ((bytesStdio != bytesBulk) || (hashStdio != hashBulk))
+  {
+    printf("ingest mismatch!\n");
+    return 1;
+  }
+  printf("ingest match (x%.1f)\n", bestStdio / bestBulk);
+  return 0;
+}
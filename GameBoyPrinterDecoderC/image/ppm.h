@@ -1,12 +1,48 @@
 /* 24-bit PPM (Bitmap) ANSI C header library
  * This is free and unencumbered software released into the public domain.
  */
-// Work in progress
+#ifndef PPM_H
+#define PPM_H
 
-static void
+#include <stdio.h>
+
+/* Header is at most this long (Two 5 digit sizes) */
+#define PPM_HEADER_MAX 32
+#define PAM_HEADER_MAX 80
+
+static int
+ppm_header(char *buf, int sizex, int sizey)
+{
+    return sprintf(buf, "P6\n%d %d\n255\n", sizex, sizey);
+}
+
+static int
+pam_header(char *buf, int sizex, int sizey)
+{
+    return sprintf(buf, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n", sizex, sizey);
+}
+
+/* Write one RGB frame (buf is sizex * sizey * 3 bytes, top row first)
+ * Frames may be written back to back to one stream. Returns 0 on a write error.
+ */
+static int
 ppm_write(const unsigned char *buf, int sizex, int sizey, FILE *f)
 {
-    fprintf(f, "P6\n%d %d\n255\n", sizex, sizey);
-    fwrite(buf, sizex*3, sizey, f);
-    fflush(f);
-}
\ No newline at end of file
+    char header[PPM_HEADER_MAX];
+    int len = ppm_header(header, sizex, sizey);
+    if (fwrite(header, 1, len, f) != (size_t)len)
+        return 0;
+    return fwrite(buf, (size_t)sizex * 3, sizey, f) == (size_t)sizey;
+}
+
+static int
+pam_write(const unsigned char *buf, int sizex, int sizey, FILE *f)
+{
+    char header[PAM_HEADER_MAX];
+    int len = pam_header(header, sizex, sizey);
+    if (fwrite(header, 1, len, f) != (size_t)len)
+        return 0;
+    return fwrite(buf, (size_t)sizex * 3, sizey, f) == (size_t)sizey;
+}
+
+#endif
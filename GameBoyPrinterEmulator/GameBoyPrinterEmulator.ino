@@ -108,7 +108,7 @@ uint8_t gbp_serialIO_raw_buffer[GBP_BUFFER_SIZE] = { 0 };
 /* Packet Buffer */
 gbp_pkt_t gbp_pktState                                 = { GBP_REC_NONE, 0 };
 uint8_t gbp_pktbuff[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE] = { 0 };
-uint8_t gbp_pktbuffSize                                = 0;
+uint16_t gbp_pktbuffSize                               = 0;
 #ifdef GBP_FEATURE_PARSE_PACKET_USE_DECOMPRESSOR
 gbp_pkt_tileAcc_t tileBuff = { 0 };
 #endif
@@ -288,9 +288,13 @@ void loop()
 inline void gbp_parse_packet_loop(void)
 {
   const char nibbleToCharLUT[] = "0123456789ABCDEF";
-  for (int i = 0; i < gbp_serial_io_dataBuff_getByteCount(); i++)
+  const uint8_t *span          = NULL;
+  size_t spanSize              = 0;
+  while ((spanSize = gbp_serial_io_dataBuff_getSpan(&span)) > 0)
   {
-    if (gbp_pkt_processByte(&gbp_pktState, (const uint8_t)gbp_serial_io_dataBuff_getByte(), gbp_pktbuff, &gbp_pktbuffSize, sizeof(gbp_pktbuff)))
+    const uint8_t *payload = NULL;
+    const size_t used      = gbp_pkt_processBytes(&gbp_pktState, span, spanSize, gbp_pktbuff, &gbp_pktbuffSize, sizeof(gbp_pktbuff), &payload);
+    if (gbp_pktState.received != GBP_REC_NONE)
     {
       if (gbp_pktState.received == GBP_REC_GOT_PACKET)
       {
@@ -325,15 +329,15 @@ inline void gbp_parse_packet_loop(void)
         {
           //!{"command":"PRNT","sheets":1,"margin_upper":1,"margin_lower":3,"pallet":228,"density":64 }
           Serial.print(", \"sheets\":");
-          Serial.print(gbp_pkt_printInstruction_num_of_sheets(gbp_pktbuff));
+          Serial.print(gbp_pkt_printInstruction_num_of_sheets(payload));
           Serial.print(", \"margin_upper\":");
-          Serial.print(gbp_pkt_printInstruction_num_of_linefeed_before_print(gbp_pktbuff));
+          Serial.print(gbp_pkt_printInstruction_num_of_linefeed_before_print(payload));
           Serial.print(", \"margin_lower\":");
-          Serial.print(gbp_pkt_printInstruction_num_of_linefeed_after_print(gbp_pktbuff));
+          Serial.print(gbp_pkt_printInstruction_num_of_linefeed_after_print(payload));
           Serial.print(", \"pallet\":");
-          Serial.print(gbp_pkt_printInstruction_palette_value(gbp_pktbuff));
+          Serial.print(gbp_pkt_printInstruction_palette_value(payload));
           Serial.print(", \"density\":");
-          Serial.print(gbp_pkt_printInstruction_print_density(gbp_pktbuff));
+          Serial.print(gbp_pkt_printInstruction_print_density(payload));
         }
         if (gbp_pktState.command == GBP_COMMAND_DATA)
         {
@@ -354,7 +358,7 @@ inline void gbp_parse_packet_loop(void)
       {
 #ifdef GBP_FEATURE_PARSE_PACKET_USE_DECOMPRESSOR
         // Required for more complex games with compression support
-        while (gbp_pkt_decompressor(&gbp_pktState, gbp_pktbuff, gbp_pktbuffSize, &tileBuff))
+        while (gbp_pkt_decompressor(&gbp_pktState, payload, gbp_pktbuffSize, &tileBuff))
         {
           if (gbp_pkt_tileAccu_tileReadyCheck(&tileBuff))
           {
@@ -385,7 +389,7 @@ inline void gbp_parse_packet_loop(void)
           // Got Tile
           for (int i = 0; i < gbp_pktbuffSize; i++)
           {
-            const uint8_t data_8bit = gbp_pktbuff[i];
+            const uint8_t data_8bit = payload[i];
             if (i == gbp_pktbuffSize - 1)
             {
               Serial.print((char)nibbleToCharLUT[(data_8bit >> 4) & 0xF]);
@@ -403,6 +407,8 @@ inline void gbp_parse_packet_loop(void)
 #endif
       }
     }
+    // Release bytes only after the payload (which may point into the circular buffer) was handled
+    gbp_serial_io_dataBuff_skip(used);
   }
 }
 #endif
@@ -110,6 +110,25 @@ static inline bool gpb_cbuff_Dequeue_Peek(gpb_cbuff_t *cb, uint8_t *b, uint32_t
   return true; ///< Successful
 }
 
+// Contiguous run of bytes from the tail (up to the wrap around point). Use with gpb_cbuff_Dequeue_Skip()
+static inline size_t gpb_cbuff_Dequeue_Span(gpb_cbuff_t *cb, const uint8_t **span)
+{
+  const size_t toEnd = cb->capacity - cb->tail;
+  const size_t count = cb->count;
+  *span = &cb->buffer[cb->tail];
+  return (count < toEnd) ? count : toEnd;
+}
+
+static inline bool gpb_cbuff_Dequeue_Skip(gpb_cbuff_t *cb, size_t n)
+{
+  if (cb->count < n)
+    return false; ///< Failed
+  // Increment tail
+  cb->tail = (cb->tail + n) % cb->capacity;
+  cb->count = cb->count - n;
+  return true; ///< Successful
+}
+
 static inline size_t gpb_cbuff_Capacity(gpb_cbuff_t *cb) { return cb->capacity;}
 static inline size_t gpb_cbuff_Count(gpb_cbuff_t *cb)   { return cb->count;}
 static inline bool gpb_cbuff_IsFull(gpb_cbuff_t *cb)    { return (cb->count >= cb->capacity);}
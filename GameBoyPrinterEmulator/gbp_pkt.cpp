@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "gameboy_printer_protocol.h"
 #include "gbp_serial_io.h"
@@ -44,7 +45,7 @@ bool gbp_pkt_reset(gbp_pkt_t *_pkt)
 }
 
 // returns true if packet is received
-bool gbp_pkt_processByte(gbp_pkt_t *_pkt, const uint8_t _byte, uint8_t buffer[], uint8_t *bufferSize, const size_t bufferMax)
+bool gbp_pkt_processByte(gbp_pkt_t *_pkt, const uint8_t _byte, uint8_t buffer[], uint16_t *bufferSize, const size_t bufferMax)
 {
   /*
     [ 00 ][ 01 ][ 02 ][ 03 ][ 04 ][ 05 ][ 5+X ][5+X+1][5+X+2][5+X+3][5+X+4]
@@ -165,6 +166,75 @@ bool gbp_pkt_processByte(gbp_pkt_t *_pkt, const uint8_t _byte, uint8_t buffer[],
   return _pkt->received != GBP_REC_NONE;
 }
 
+// Bulk version of gbp_pkt_processByte(). Consumes bytes until a packet event is
+// reached (or input runs out) and returns the number of bytes consumed.
+// On event `*payload` holds the same `*bufferSize` bytes the byte wise parser would
+// have placed in `buffer`. This is a sub-span of `bytes` if the payload chunk arrived
+// within this call, otherwise it is `buffer` (only chunks straddling calls are copied).
+size_t gbp_pkt_processBytes(gbp_pkt_t *_pkt, const uint8_t bytes[], const size_t bytesSize, uint8_t buffer[], uint16_t *bufferSize, const size_t bufferMax, const uint8_t **payload)
+{
+  const uint8_t *chunk = NULL;  ///< Start of current payload chunk in `bytes` (NULL if started in a previous call)
+  size_t chunkSize     = 0;
+  size_t i             = 0;
+
+  _pkt->received = GBP_REC_NONE;
+  *payload       = buffer;
+
+  // Dev Note: Same minimum size as gbp_pkt_processByte()
+  if (bufferMax < 4)
+    return bytesSize;
+
+  while (i < bytesSize)
+  {
+    if ((6 <= _pkt->pktByteIndex) && (_pkt->pktByteIndex < (6 + _pkt->dataLength)))
+    {
+      // Payload bytes are taken in bulk up to the end of the current chunk
+      const size_t payloadIndex = _pkt->pktByteIndex - 6;
+      const size_t offset       = payloadIndex % bufferMax;
+      size_t n                  = bufferMax - offset;
+      if (n > (_pkt->dataLength - payloadIndex))
+        n = _pkt->dataLength - payloadIndex;
+      if (n > (bytesSize - i))
+        n = bytesSize - i;
+
+      if (offset == 0)
+        chunk = &bytes[i];
+      else if (!chunk)
+        memcpy(&buffer[offset], &bytes[i], n);
+
+      i += n;
+      _pkt->pktByteIndex += n;
+      chunkSize   = offset + n;
+      *bufferSize = chunkSize;
+
+      if (chunkSize == _pkt->dataLength)
+      {
+        // Fits fully in buffer
+      }
+      else if (chunkSize == bufferMax)
+      {
+        _pkt->received = GBP_REC_GOT_PAYLOAD_PARTAL;
+        *payload       = chunk ? chunk : buffer;
+        return i;
+      }
+      continue;
+    }
+
+    // Header and trailer bytes
+    if (gbp_pkt_processByte(_pkt, bytes[i++], buffer, bufferSize, bufferMax))
+    {
+      *payload = chunk ? chunk : buffer;
+      return i;
+    }
+  }
+
+  // Out of input before the event, keep what we have of this chunk for the next call
+  if (chunk)
+    memcpy(buffer, chunk, chunkSize);
+
+  return i;
+}
+
 
 /*******************************************************************************
   Tile Accumulator
@@ -195,47 +265,101 @@ bool gbp_pkt_tileAccu_tileReadyCheck(gbp_pkt_tileAcc_t *tileBuff)
 
 bool gbp_pkt_decompressor(gbp_pkt_t *_pkt, const uint8_t buff[], const size_t buffSize, gbp_pkt_tileAcc_t *tileBuff)
 {
+  /*
+    Dev Note: Runs are emitted in bulk into the tile accumulator (memcpy for raw runs, memset for repeated runs)
+              up to the next tile boundary. Run state is kept in `_pkt` so a run can span across tiles and buffers.
+              A full tile left in the accumulator (no tileReadyCheck()) still swallows the next byte like insertByte().
+  */
   if (!_pkt->compression)
   {
     // Uncompressed payload // e.g. Gameboy Camera
-    while (1)
+    if (_pkt->buffIndex < buffSize)
     {
-      // for (buffIndex = 0; buffIndex < buffSize ; buffIndex++)
-      if (_pkt->buffIndex < buffSize)
+      size_t n = GBP_TILE_SIZE_IN_BYTE - tileBuff->count;
+      const size_t avail = buffSize - _pkt->buffIndex;
+      if (n == 0)
       {
-        if (gbp_pkt_tileAccu_insertByte(tileBuff, buff[_pkt->buffIndex++]))
-        {
-          return true;  // Got tile
-        }
+        _pkt->buffIndex++;
+        return true;  // Got tile
       }
-      else
+      if (n > avail)
       {
-        _pkt->buffIndex = 0;  // Reset for next buffer
-        return false;
+        n = avail;
+      }
+      memcpy(&tileBuff->tile[tileBuff->count], &buff[_pkt->buffIndex], n);
+      tileBuff->count += n;
+      _pkt->buffIndex += n;
+      if (tileBuff->count == GBP_TILE_SIZE_IN_BYTE)
+      {
+        return true;  // Got tile
       }
     }
+    _pkt->buffIndex = 0;  // Reset for next buffer
+    return false;
   }
   else
   {
     // Compressed payload (Run length encoding) // e.g. Pokemon Trading Card
     while (1)
     {
-      // for (buffIndex = 0; buffIndex < buffSize ; buffIndex++)
-      // Dev Note: Need to also check if we have completed adding looped byte even if all incoming bytes have been read
-      if ((_pkt->buffIndex < buffSize) || (_pkt->compressedRun && !_pkt->repeatByteGet && (_pkt->loopRunLength != 0)))
+      if ((_pkt->loopRunLength != 0) && !_pkt->repeatByteGet)
+      {
+        // Emit as much of the current run as the tile has space for
+        // Dev Note: A repeated run can still be emitted even if all incoming bytes have been read
+        size_t n = GBP_TILE_SIZE_IN_BYTE - tileBuff->count;
+        if (n > _pkt->loopRunLength)
+        {
+          n = _pkt->loopRunLength;
+        }
+        if (!_pkt->compressedRun)
+        {
+          const size_t avail = buffSize - _pkt->buffIndex;
+          if (avail == 0)
+          {
+            break;  // Rest of raw run is in the next buffer
+          }
+          if (n > avail)
+          {
+            n = avail;
+          }
+        }
+        if (n == 0)
+        {
+          // Tile was not cleared, drop a byte of this run
+          _pkt->loopRunLength--;
+          _pkt->buffIndex += _pkt->compressedRun ? 0 : 1;
+          return true;  // Got tile
+        }
+        if (_pkt->compressedRun)
+        {
+          memset(&tileBuff->tile[tileBuff->count], _pkt->repeatByte, n);
+        }
+        else
+        {
+          memcpy(&tileBuff->tile[tileBuff->count], &buff[_pkt->buffIndex], n);
+          _pkt->buffIndex += n;
+        }
+        tileBuff->count += n;
+        _pkt->loopRunLength -= n;
+        if (tileBuff->count == GBP_TILE_SIZE_IN_BYTE)
+        {
+          return true;  // Got tile
+        }
+      }
+      else if (_pkt->buffIndex < buffSize)
       {
         // Incoming Bytes Avaliable
+        const uint8_t b = buff[_pkt->buffIndex++];
         if (_pkt->loopRunLength == 0)
         {
           // Start of either a raw run of byte or compressed run of byte
-          uint8_t b = buff[_pkt->buffIndex++];
           if (b < 128)
           {
             // (0x7F=127) its a classical run, read the n bytes after (Raphael-Boichot)
             _pkt->loopRunLength = b + 1;
             _pkt->compressedRun = false;
           }
-          else if (b >= 128)
+          else
           {
             // (0x80 = 128) its a compressed run, read the next byte and repeat (Raphael-Boichot)
             _pkt->loopRunLength = b - 128 + 2;
@@ -243,29 +367,19 @@ bool gbp_pkt_decompressor(gbp_pkt_t *_pkt, const uint8_t buff[], const size_t bu
             _pkt->repeatByteGet = true;
           }
         }
-        else if (_pkt->repeatByteGet)
+        else
         {
           // Grab loop byte
-          uint8_t b           = buff[_pkt->buffIndex++];
           _pkt->repeatByte    = b;
           _pkt->repeatByteGet = false;
         }
-        else
-        {
-          const uint8_t b = (_pkt->compressedRun) ? _pkt->repeatByte : buff[_pkt->buffIndex++];
-          _pkt->loopRunLength--;
-          if (gbp_pkt_tileAccu_insertByte(tileBuff, b))
-          {
-            return true;  // Got tile
-          }
-        }
       }
       else
       {
-        _pkt->buffIndex = 0;  // Reset for next buffer
-        return false;
+        break;
       }
     }
+    _pkt->buffIndex = 0;  // Reset for next buffer
+    return false;
   }
-  return false;
 }
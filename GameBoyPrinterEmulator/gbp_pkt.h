@@ -69,7 +69,8 @@ typedef struct
 
 bool gbp_pkt_init(gbp_pkt_t *_pkt);
 bool gbp_pkt_reset(gbp_pkt_t *_pkt);
-bool gbp_pkt_processByte(gbp_pkt_t *_pkt, const uint8_t _byte, uint8_t buffer[], uint8_t *bufferSize, const size_t bufferMax);
+bool gbp_pkt_processByte(gbp_pkt_t *_pkt, const uint8_t _byte, uint8_t buffer[], uint16_t *bufferSize, const size_t bufferMax);
+size_t gbp_pkt_processBytes(gbp_pkt_t *_pkt, const uint8_t bytes[], const size_t bytesSize, uint8_t buffer[], uint16_t *bufferSize, const size_t bufferMax, const uint8_t **payload);
 bool gbp_pkt_decompressor(gbp_pkt_t *_pkt, const uint8_t buff[], const size_t buffSize, gbp_pkt_tileAcc_t *tileBuff);
 bool gbp_pkt_tileAccu_tileReadyCheck(gbp_pkt_tileAcc_t *tileBuff);
 
@@ -77,27 +78,27 @@ bool gbp_pkt_tileAccu_tileReadyCheck(gbp_pkt_tileAcc_t *tileBuff);
  * Print Instruction
 *******************************************************************************/
 
-static inline int gbp_pkt_printInstruction_num_of_sheets(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_num_of_sheets(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_SHEETS]);
 }
 
-static inline int gbp_pkt_printInstruction_num_of_linefeed_before_print(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_num_of_linefeed_before_print(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED] >> 4) & 0x0F;
 }
 
-static inline int gbp_pkt_printInstruction_num_of_linefeed_after_print(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_num_of_linefeed_after_print(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_NUM_OF_LINEFEED]) & 0x0F;
 }
 
-static inline int gbp_pkt_printInstruction_palette_value(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_palette_value(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_PALETTE_VALUE]);
 }
 
-static inline int gbp_pkt_printInstruction_print_density(uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
+static inline int gbp_pkt_printInstruction_print_density(const uint8_t payloadBuff[GBP_PRINT_INSTRUCT_PAYLOAD_SIZE])
 {
   return (payloadBuff[GBP_PRINT_INSTRUCT_INDEX_PRINT_DENSITY]);
 }
@@ -238,6 +238,22 @@ uint8_t gbp_serial_io_dataBuff_getByte_Peek(uint32_t offset)
   return b;
 }
 
+size_t gbp_serial_io_dataBuff_getSpan(const uint8_t **span)
+{
+  return gpb_cbuff_Dequeue_Span(&gpb_pktIO.dataBuffer, span);
+}
+
+bool gbp_serial_io_dataBuff_skip(size_t count)
+{
+  if (!gpb_cbuff_Dequeue_Skip(&gpb_pktIO.dataBuffer, count))
+    return false;
+
+  /* Packet Timeout Reset (Still Processing) */
+  gpb_pktIO.timeout_ms = GBP_PKT10_TIMEOUT_MS;
+
+  return true;
+}
+
 uint16_t gbp_serial_io_dataBuff_waterline(bool resetWaterline)
 {
   uint16_t retval = gpb_pktIO.dataBufferWaterline;
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
 
 #include "gameboy_printer_protocol.h"
 #include "gbp_serial_io.h"
@@ -8,6 +10,8 @@
 
 //#define FEATURE_PACKET_SERIAL_IO
 #define FEATURE_PACKET_TEST_PARSE
+#define FEATURE_PACKET_TEST_PARSE_BULK
+#define FEATURE_PACKET_TEST_DECOMPRESSOR
 
 
 /*******************************************************************************
@@ -95,6 +99,106 @@ void dummy_ISR(const bool GBP_SCLK, const bool GBP_SOUT)
 }
 
 
+#ifdef FEATURE_PACKET_TEST_PARSE_BULK
+// Hash of every parser event (packet header, status and payload) for comparing parsers
+uint32_t pktEventHash(uint32_t hash, const gbp_pkt_t *pkt, const uint8_t *payload, const uint16_t payloadSize)
+{
+  const uint8_t header[] = {(uint8_t)pkt->received, pkt->command, pkt->compression,
+                            (uint8_t)(pkt->dataLength >> 0), (uint8_t)(pkt->dataLength >> 8),
+                            pkt->printerID, pkt->status,
+                            (uint8_t)(payloadSize >> 0), (uint8_t)(payloadSize >> 8)};
+  for (size_t i = 0 ; i < sizeof(header) ; i++)
+    hash = (hash ^ header[i]) * 16777619u;
+  for (size_t i = 0 ; i < payloadSize ; i++)
+    hash = (hash ^ payload[i]) * 16777619u;
+  return hash;
+}
+#endif
+
+
+#ifdef FEATURE_PACKET_TEST_DECOMPRESSOR
+// Original byte at a time decompressor, kept as reference for the run aware gbp_pkt_decompressor()
+bool decompressorReference(gbp_pkt_t *_pkt, const uint8_t buff[], const size_t buffSize, gbp_pkt_tileAcc_t *tileBuff)
+{
+  while (1)
+  {
+    if ((_pkt->buffIndex < buffSize) || (_pkt->compression && _pkt->compressedRun && !_pkt->repeatByteGet && (_pkt->loopRunLength != 0)))
+    {
+      uint8_t b = 0;
+      if (!_pkt->compression)
+      {
+        b = buff[_pkt->buffIndex++];
+      }
+      else if (_pkt->loopRunLength == 0)
+      {
+        b = buff[_pkt->buffIndex++];
+        _pkt->loopRunLength = (b < 128) ? (b + 1) : (b - 128 + 2);
+        _pkt->compressedRun = (b >= 128);
+        _pkt->repeatByteGet = (b >= 128);
+        continue;
+      }
+      else if (_pkt->repeatByteGet)
+      {
+        _pkt->repeatByte = buff[_pkt->buffIndex++];
+        _pkt->repeatByteGet = false;
+        continue;
+      }
+      else
+      {
+        b = (_pkt->compressedRun) ? _pkt->repeatByte : buff[_pkt->buffIndex++];
+        _pkt->loopRunLength--;
+      }
+      if (tileBuff->count == GBP_TILE_SIZE_IN_BYTE)
+        return true;
+      tileBuff->tile[tileBuff->count++] = b;
+      if (tileBuff->count == GBP_TILE_SIZE_IN_BYTE)
+        return true;
+    }
+    else
+    {
+      _pkt->buffIndex = 0;
+      return false;
+    }
+  }
+}
+
+typedef bool (*decompressor_t)(gbp_pkt_t *_pkt, const uint8_t buff[], const size_t buffSize, gbp_pkt_tileAcc_t *tileBuff);
+
+// Decompress every payload in `payloads` (fed in `split` sized buffers) and hash the tiles produced
+uint32_t decompressorHash(decompressor_t decompressor, const uint8_t *payloads, const size_t *payloadSizes, const size_t payloadCount, const bool compression, const size_t split, size_t *tileBytes)
+{
+  uint32_t hash = 2166136261u;
+  gbp_pkt_t pkt = {GBP_REC_NONE, 0};
+  gbp_pkt_tileAcc_t tileBuff = {0};
+  pkt.compression = compression;
+  for (size_t p = 0 ; p < payloadCount ; payloads += payloadSizes[p++])
+  {
+    for (size_t pos = 0 ; pos < payloadSizes[p] ; pos += split)
+    {
+      const size_t size = ((payloadSizes[p] - pos) < split) ? (payloadSizes[p] - pos) : split;
+      while (decompressor(&pkt, &payloads[pos], size, &tileBuff))
+      {
+        if (gbp_pkt_tileAccu_tileReadyCheck(&tileBuff))
+        {
+          for (int i = 0 ; i < GBP_TILE_SIZE_IN_BYTE ; i++)
+            hash = (hash ^ tileBuff.tile[i]) * 16777619u;
+          *tileBytes += GBP_TILE_SIZE_IN_BYTE;
+        }
+      }
+    }
+  }
+  return hash;
+}
+
+double timeSec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#endif
+
+
 /*******************************************************************************
  * Main Test Routine
 *******************************************************************************/
@@ -291,7 +395,7 @@ int main(void)
   //////
   gbp_pkt_t gbp_pktBuff = {GBP_REC_NONE, 0};
   uint8_t gbp_pktbuff[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE] = {0};
-  uint8_t gbp_pktbuffSize = 0;
+  uint16_t gbp_pktbuffSize = 0;
   gbp_pkt_tileAcc_t tileBuff = {0};
   //////
   gbp_pkt_init(&gbp_pktBuff);
@@ -337,5 +441,105 @@ int main(void)
   }
 #endif //FEATURE_PACKET_TEST_PARSE
 
+#ifdef FEATURE_PACKET_TEST_PARSE_BULK
+  {
+    // Byte wise reference
+    uint32_t refHash = 2166136261u;
+    gbp_pkt_t refPkt = {GBP_REC_NONE, 0};
+    uint8_t refBuff[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE] = {0};
+    uint16_t refBuffSize = 0;
+    gbp_pkt_init(&refPkt);
+    for (size_t i = 0 ; i < sizeof(testVector) ; i++)
+    {
+      if (gbp_pkt_processByte(&refPkt, testVector[i], refBuff, &refBuffSize, sizeof(refBuff)))
+        refHash = pktEventHash(refHash, &refPkt, refBuff, refBuffSize);
+    }
+
+    // Bulk parser fed in various chunk sizes (to test payload chunks straddling calls)
+    const size_t chunkSizes[] = {1, 3, 7, 16, 17, 100, 640, sizeof(testVector)};
+    bool bulkMatch = true;
+    for (size_t c = 0 ; c < sizeof(chunkSizes)/sizeof(chunkSizes[0]) ; c++)
+    {
+      uint32_t hash = 2166136261u;
+      gbp_pkt_t pkt = {GBP_REC_NONE, 0};
+      uint8_t buff[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE] = {0};
+      uint16_t buffSize = 0;
+      gbp_pkt_init(&pkt);
+      for (size_t pos = 0 ; pos < sizeof(testVector) ; pos += chunkSizes[c])
+      {
+        const size_t chunkSize = ((sizeof(testVector) - pos) < chunkSizes[c]) ? (sizeof(testVector) - pos) : chunkSizes[c];
+        size_t used = 0;
+        while (used < chunkSize)
+        {
+          const uint8_t *payload = NULL;
+          used += gbp_pkt_processBytes(&pkt, &testVector[pos + used], chunkSize - used, buff, &buffSize, sizeof(buff), &payload);
+          if (pkt.received != GBP_REC_NONE)
+            hash = pktEventHash(hash, &pkt, payload, buffSize);
+        }
+      }
+      printf("/* Bulk parser (chunk %4lu) %s */\r\n", (unsigned long) chunkSizes[c], (hash == refHash) ? "match" : "MISMATCH");
+      bulkMatch = bulkMatch && (hash == refHash);
+    }
+    if (!bulkMatch)
+      return 1;
+  }
+#endif // FEATURE_PACKET_TEST_PARSE_BULK
+
+#ifdef FEATURE_PACKET_TEST_DECOMPRESSOR
+  {
+    // Gather the payload of every data packet
+    static uint8_t payloads[sizeof(testVector)];
+    static size_t payloadSizes[sizeof(testVector)];
+    size_t payloadCount = 0;
+    size_t payloadsSize = 0;
+    bool compression = false;
+    gbp_pkt_t pkt = {GBP_REC_NONE, 0};
+    uint8_t buff[GBP_PKT_PAYLOAD_BUFF_SIZE_IN_BYTE] = {0};
+    uint16_t buffSize = 0;
+    gbp_pkt_init(&pkt);
+    for (size_t i = 0 ; i < sizeof(testVector) ; i++)
+    {
+      if (gbp_pkt_processByte(&pkt, testVector[i], buff, &buffSize, sizeof(buff)) && (pkt.received != GBP_REC_GOT_PACKET))
+      {
+        memcpy(&payloads[payloadsSize], buff, buffSize);
+        payloadSizes[payloadCount++] = buffSize;
+        payloadsSize += buffSize;
+        compression = compression || pkt.compression;
+      }
+    }
+
+    // Run aware decompressor must match the reference for any buffer split (Run state straddling buffers and tiles)
+    const size_t splits[] = {1, 2, 3, 16, 17, 100, sizeof(testVector)};
+    bool decompMatch = true;
+    for (size_t c = 0 ; c < sizeof(splits)/sizeof(splits[0]) ; c++)
+    {
+      size_t refBytes = 0;
+      size_t tileBytes = 0;
+      const uint32_t refHash = decompressorHash(decompressorReference, payloads, payloadSizes, payloadCount, compression, splits[c], &refBytes);
+      const uint32_t hash = decompressorHash(gbp_pkt_decompressor, payloads, payloadSizes, payloadCount, compression, splits[c], &tileBytes);
+      const bool match = (hash == refHash) && (tileBytes == refBytes) && (tileBytes > 0);
+      printf("/* Decompressor (split %4lu) %s */\r\n", (unsigned long) splits[c], match ? "match" : "MISMATCH");
+      decompMatch = decompMatch && match;
+    }
+    if (!decompMatch)
+      return 1;
+
+    // Microbenchmark (Tile bytes produced per second)
+    const int reps = 200;
+    double t[2] = {0};
+    size_t tileBytes = 0;
+    for (int d = 0 ; d < 2 ; d++)
+    {
+      const double start = timeSec();
+      for (int r = 0 ; r < reps ; r++)
+        decompressorHash(d ? gbp_pkt_decompressor : decompressorReference, payloads, payloadSizes, payloadCount, compression, sizeof(payloads), &tileBytes);
+      t[d] = timeSec() - start;
+    }
+    tileBytes /= 2;
+    printf("/* Decompressor bench: reference %.1f MB/s, run aware %.1f MB/s (x%.1f) */\r\n",
+        tileBytes / t[0] / 1e6, tileBytes / t[1] / 1e6, t[0] / t[1]);
+  }
+#endif // FEATURE_PACKET_TEST_DECOMPRESSOR
+
   printf("/* Done */\r\n");
 }
\ No newline at end of file